@@ -4,6 +4,8 @@
 #include <iostream>
 #include <fstream>
 #include <cassert>
+#include <algorithm>
+#include <iterator>
 
 //-------------------------------------------------------------------------------------------------
 
@@ -25,26 +27,70 @@ BPELearner::BPELearner()
 
 void BPELearner::Learn(const uint32_t vocabSize, const char* inputFileName)
 {
+	LearnFromFiles(vocabSize, { inputFileName });
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPELearner::LearnFromFiles(const uint32_t vocabSize, const std::vector<std::string>& inputPaths)
+{
+	readAndPrepare([&](MultiThreadFileReader& reader, std::vector<MapType>& wordCounts, const MultiThreadFileReader::PartitionCallback& onPartitionReady)
 	{
-		MapType wordCountHashTable;
-		MultiThreadFileReader MTFRead;
-		MTFRead.ReadText(inputFileName, wordCountHashTable);
+		reader.ReadText(inputPaths, wordCounts, onPartitionReady);
+	});
 
-		prepare(wordCountHashTable);
-	} // Unload mapped file and wordCountHashTable
+	internalLearn(vocabSize);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPELearner::LearnFromStream(const uint32_t vocabSize, const int fd)
+{
+	readAndPrepare([&](MultiThreadFileReader& reader, std::vector<MapType>& wordCounts, const MultiThreadFileReader::PartitionCallback& onPartitionReady)
+	{
+		reader.ReadStream(fd, wordCounts, onPartitionReady);
+	});
 
 	internalLearn(vocabSize);
 }
 
 //-------------------------------------------------------------------------------------------------
 
+template<typename ReadFunction>
+void BPELearner::readAndPrepare(ReadFunction&& read)
+{
+	std::vector<MapType> wordCountHashTables;
+	MultiThreadFileReader MTFRead;
+	MTFRead.SetInputOptions(mInputOptions);
+
+	if (mPipelinedIngestion)
+	{
+		std::vector<PreparedPartition> partitions(MultiThreadFileReader::PartitionCount);
+		read(MTFRead, wordCountHashTables, [&](const uint32_t partition, MapType& wordCount)
+		{
+			preparePartition(wordCount, partitions[partition]);
+			wordCount.clear(); // Words are in ids now
+		});
+
+		foldPartitions(partitions);
+	}
+	else
+	{
+		read(MTFRead, wordCountHashTables, nullptr);
+		prepare(wordCountHashTables);
+	}
+} // Unload mapped files and wordCountHashTables
+
+//-------------------------------------------------------------------------------------------------
+
 void BPELearner::Learn(const uint32_t vocabSize, const std::vector<std::string>& textChunks)
 {
 	{
-		MapType wordCountHashTable;
-		countWords(textChunks, wordCountHashTable);
+		// Words are copied to the map's arena, compact and independent of textChunks.
+		std::vector<MapType> wordCountHashTables;
+		countWords(textChunks, wordCountHashTables.emplace_back(MapType::KeyStorage::Interned));
 
-		prepare(wordCountHashTable);
+		prepare(wordCountHashTables);
 	}
 
 	internalLearn(vocabSize);
@@ -75,32 +121,154 @@ void BPELearner::countWords(const std::vector<std::string>& textChunks, MapType&
 
 //-------------------------------------------------------------------------------------------------
 // Split words to a list of Ids (unsigned int), also flattens the word counts.
-void BPELearner::prepare(const MapType& wordCount)
+// Word counts can be split in several maps as long as a word appears in only one of them.
+void BPELearner::prepare(const std::vector<MapType>& wordCounts)
 {
-	mSplitedWords.reserve(wordCount.size());
-	mWordCounts.reserve(wordCount.size());
+	size_t uniqueWords = 0;
+	for (const auto& wordCount : wordCounts)
+	{
+		uniqueWords += wordCount.size();
+	}
+
+	mSplitedWords.reserve(uniqueWords);
+	mWordCounts.reserve(uniqueWords);
 	
+	for (const auto& wordCount : wordCounts)
+	{
+		for (const auto& item : wordCount)
+		{
+			const auto& word = item.first;
+
+			auto& currentSplitedWord = mSplitedWords.emplace_back(word.size(), 0);
+			for (size_t i = 0; i < word.size(); ++i)
+			{
+				// We should cast to uchar first and then to uint
+				currentSplitedWord[i] = static_cast<uint8_t>(word[i]);
+			}
+
+			mWordCounts.push_back(item.second);
+		}
+	}
+
+	for (uint32_t wi = 0; wi < mSplitedWords.size(); ++wi)
+	{
+		countPairsInWord(wi,
+			mSplitedWords[wi],
+			mWordCounts[wi]
+		);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Same as prepare for a single partition, without touching shared state so partitions can be
+// prepared concurrently. Runs on the reader's merge threads.
+void BPELearner::preparePartition(const MapType& wordCount, PreparedPartition& outPartition)
+{
+	outPartition.SplitedWords.reserve(wordCount.size());
+	outPartition.WordCounts.reserve(wordCount.size());
+	outPartition.PairCounts.assign(BytePairCount, 0);
+	outPartition.PairWordOffsets.assign(BytePairCount + 1, 0);
+
+	// (pair, local word index) of each distinct pair of each word
+	std::vector<std::pair<uint32_t, uint32_t>> occurrences;
+	std::vector<uint32_t> lastWord(BytePairCount, UINT32_MAX);
+
 	for (const auto& item : wordCount)
 	{
 		const auto& word = item.first;
+		const uint32_t wordIndex = static_cast<uint32_t>(outPartition.SplitedWords.size());
 
-		auto& currentSplitedWord = mSplitedWords.emplace_back(word.size(), 0);
+		auto& currentSplitedWord = outPartition.SplitedWords.emplace_back(word.size(), 0);
 		for (size_t i = 0; i < word.size(); ++i)
 		{
 			// We should cast to uchar first and then to uint
 			currentSplitedWord[i] = static_cast<uint8_t>(word[i]);
 		}
 
-		mWordCounts.push_back(item.second);
+		outPartition.WordCounts.push_back(item.second);
+
+		for (size_t i = 1; i < currentSplitedWord.size(); ++i)
+		{
+			const uint32_t pair = (currentSplitedWord[i - 1] << 8) | currentSplitedWord[i];
+			outPartition.PairCounts[pair] += item.second;
+
+			if (lastWord[pair] != wordIndex)
+			{
+				lastWord[pair] = wordIndex;
+				occurrences.emplace_back(pair, wordIndex);
+				outPartition.PairWordOffsets[pair + 1]++;
+			}
+		}
 	}
 
-	for (uint32_t wi = 0; wi < mSplitedWords.size(); ++wi)
+	for (uint32_t pair = 0; pair < BytePairCount; ++pair)
 	{
-		countPairsInWord(wi,
-			mSplitedWords[wi],
-			mWordCounts[wi]
-		);
+		outPartition.PairWordOffsets[pair + 1] += outPartition.PairWordOffsets[pair];
 	}
+
+	// Counting sort by pair, words stay in index order.
+	std::vector<uint32_t> cursor(outPartition.PairWordOffsets.begin(), outPartition.PairWordOffsets.end() - 1);
+	outPartition.PairWords.resize(occurrences.size());
+	for (const auto& [pair, wordIndex] : occurrences)
+	{
+		outPartition.PairWords[cursor[pair]++] = wordIndex;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Concatenates prepared partitions into the learner state and builds the heap in one pass.
+void BPELearner::foldPartitions(std::vector<PreparedPartition>& partitions)
+{
+	std::vector<uint32_t> firstWordIndex(partitions.size());
+	size_t uniqueWords = 0;
+	for (size_t p = 0; p < partitions.size(); ++p)
+	{
+		firstWordIndex[p] = static_cast<uint32_t>(uniqueWords);
+		uniqueWords += partitions[p].SplitedWords.size();
+	}
+
+	mSplitedWords.reserve(uniqueWords);
+	mWordCounts.reserve(uniqueWords);
+
+	for (auto& partition : partitions)
+	{
+		std::move(partition.SplitedWords.begin(), partition.SplitedWords.end(), std::back_inserter(mSplitedWords));
+		mWordCounts.insert(mWordCounts.end(), partition.WordCounts.begin(), partition.WordCounts.end());
+		std::vector<std::vector<uint32_t>>().swap(partition.SplitedWords);
+	}
+
+	std::vector<PairData> heapItems;
+	for (uint32_t pair = 0; pair < BytePairCount; ++pair)
+	{
+		uint32_t pairCount = 0;
+		size_t wordCount = 0;
+		for (const auto& partition : partitions)
+		{
+			pairCount += partition.PairCounts[pair];
+			wordCount += partition.PairWordOffsets[pair + 1] - partition.PairWordOffsets[pair];
+		}
+
+		if (pairCount == 0)
+		{
+			continue;
+		}
+
+		const IdPair idPair(pair >> 8, pair & 0xFF);
+		heapItems.emplace_back(idPair, pairCount);
+
+		auto& whereToUpdate = mWhereToUpdate[idPair];
+		whereToUpdate.reserve(wordCount);
+		for (size_t p = 0; p < partitions.size(); ++p)
+		{
+			const auto& partition = partitions[p];
+			for (uint32_t i = partition.PairWordOffsets[pair]; i < partition.PairWordOffsets[pair + 1]; ++i)
+			{
+				whereToUpdate.insert(firstWordIndex[p] + partition.PairWords[i]);
+			}
+		}
+	}
+
+	mMaxHeap.Build(std::move(heapItems));
 }
 
 //-------------------------------------------------------------------------------------------------
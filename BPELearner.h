@@ -2,6 +2,8 @@
 
 #include "MaxHeap.h"
 #include "PairHasher.h"
+#include "FlatStringMap.h"
+#include "InputOptions.h"
 
 #include <string>
 #include <vector>
@@ -18,14 +20,38 @@ public:
 	BPELearner();
 
 	void Learn(const uint32_t vocabSize, const char* inputFileName);
+	void LearnFromFiles(const uint32_t vocabSize, const std::vector<std::string>& inputPaths); // files, directories or patterns like "shards/*.txt"
+	void LearnFromStream(const uint32_t vocabSize, const int fd); // pipe or any other file descriptor, e.g. 0 for stdin
 	void Learn(const uint32_t vocabSize, const std::vector<std::string>& textChunks); // chunks are words splited by regEx
 
 	void Save(const std::string& outputFileName) const;
 
+	// Split words and count pairs of each word-count partition on the reader's merge threads as soon
+	// as the partition is complete, instead of in one serial pass after reading. Same merges either way.
+	void SetPipelinedIngestion(const bool enabled) { mPipelinedIngestion = enabled; }
+
+	// Read files and streams as JSONL and learn from one field of every line, see InputOptions.h.
+	void SetInputOptions(const InputOptions& inputOptions) { mInputOptions = inputOptions; }
+	const InputOptions& GetInputOptions() const { return mInputOptions; }
+
 private:
 
 	using IdPair = std::pair<uint32_t, uint32_t>;
-	using MapType = std::unordered_map<std::string_view, uint32_t>;
+	using MapType = FlatStringCountMap;
+
+	// Words start as bytes, so a pair of the initial vocabulary is indexed by (first << 8) | second.
+	static constexpr uint32_t BytePairCount = InitialVocabSize * InitialVocabSize;
+
+	// Words of one partition with local indices, and the pairs they contain in CSR form:
+	// words that contain pair p are PairWords[PairWordOffsets[p] .. PairWordOffsets[p + 1]).
+	struct PreparedPartition
+	{
+		std::vector<std::vector<uint32_t>> SplitedWords;
+		std::vector<int32_t> WordCounts;
+		std::vector<uint32_t> PairCounts;
+		std::vector<uint32_t> PairWordOffsets;
+		std::vector<uint32_t> PairWords;
+	};
 
 	std::vector<std::vector<uint32_t>> mSplitedWords;
 	std::vector<int32_t> mWordCounts;
@@ -39,12 +65,22 @@ private:
 	MaxHeap mMaxHeap;
 
 	bool mVerbose = false;
+	bool mPipelinedIngestion = false;
+	InputOptions mInputOptions;
 
 	void internalLearn(const uint32_t vocabSize);
 
 	void countWords(const std::vector<std::string>& textChunks, MapType& wordCount);
 
-	void prepare(const MapType& wordCount);
+	// read(reader, wordCounts, onPartitionReady) fills the word counts using the reader.
+	template<typename ReadFunction>
+	void readAndPrepare(ReadFunction&& read);
+
+	void prepare(const std::vector<MapType>& wordCounts);
+
+	static void preparePartition(const MapType& wordCount, PreparedPartition& outPartition);
+
+	void foldPartitions(std::vector<PreparedPartition>& partitions);
 
 	void countPairsInWord(
 		const uint32_t wordIndex, 
@@ -1,10 +1,19 @@
 #include "BPETokenizer.h"
+#include "BacktrackingEncoder.h"
 #include "MMFile.h"
+#include "WindowedFile.h"
+#include "PreTokenizer.h"
+#include "BufferedStreamReader.h"
+#include "DecompressingReader.h"
+#include "JsonlExtractor.h"
+#include "FlatStringMap.h"
 
 #define USE_PCRE 1 // [USE_PCRE, STD_REGEX, NO_REGEX]
-#define PCRE2_CODE_UNIT_WIDTH 8 // Match the library you linked (8, 16, or 32)
-#include <pcre2.h>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <functional>
 #include <limits>
 #include <thread>
 #include <regex>
@@ -16,6 +25,7 @@
 BPETokenizer::BPETokenizer()
     : FileReadThreadCount(4)
     , EncodeThreadCount(4)
+    , mPreTokenizer(std::make_unique<PreTokenizer>())
 {
     // Initial vocabulary
     std::string oneCharString(" ");
@@ -46,27 +56,140 @@ void BPETokenizer::ReadModel(const std::string& modelFileName)
     }
 
     fprintf(stderr, "Loading codes from %s ...\n", modelFileName.c_str());
+
+    // Nothing of a model loaded before may stay. The vocabulary views the strings of mIdToPair, it goes first.
+    std::erase_if(mVocabulary, [](const auto& entry) { return entry.second >= InitialVocabSize; });
+    std::erase_if(mIdToPair, [](const auto& entry) { return entry.first >= InitialVocabSize; });
+    if (mCache)
+    {
+        mCache = std::make_unique<PretokenCache>(mCache->GetCapacity());
+    }
     
     int rank = InitialVocabSize; // rank is the tokenId of merged ids
     int first, second;
+    std::vector<MergeRankTable::Rule> mergeRules;
     while (modelFile >> first >> second)
     {
-        mMergeRules[IdPair(first, second)] = rank;
+        mergeRules.push_back({ static_cast<uint32_t>(first), static_cast<uint32_t>(second), static_cast<uint32_t>(rank) });
         const std::string str = mIdToPair[first] + mIdToPair[second];
         mIdToPair[rank] = str;
         mVocabulary[mIdToPair[rank]] = rank;
         ++rank;
     }
 
+    // Looked up for every adjacent pair of every word, the table is built once all rules are known.
+    mMergeRules.Build(mergeRules);
+    chooseMergeRulesLayout();
+
+    mModelRules = std::move(mergeRules);
+    mBacktrackingEncoder.reset();
+    if (mEncoder == Encoder::Backtrack)
+    {
+        buildBacktrackingEncoder();
+    }
+
     fprintf(stderr, "Codes Loaded.\n");
 }
 
+//-------------------------------------------------------------------------------------------------
+// Both layouts of the merge rules give the same ranks. The indexed one never hashes, but its array of
+// byte pair ranks takes 256 KB whatever the model, which pays off once the rules no longer fit in the
+// caches either: in BenchMergeRanks it encoded faster from a few thousand rules on, below that the
+// difference was noise. Chosen from the model alone, so a model always encodes the same way.
+void BPETokenizer::chooseMergeRulesLayout()
+{
+    const bool indexed = mMergeRules.CanIndex() && mMergeRules.size() >= MinIndexedMergeRules;
+    mMergeRules.SetLayout(indexed ? MergeRankTable::Layout::Indexed : MergeRankTable::Layout::Hashed);
+
+    fprintf(stderr, "Merge rules: %s layout for %zu rules.\n", indexed ? "indexed" : "hashed", mMergeRules.size());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPETokenizer::SetEncoder(const Encoder encoder)
+{
+    mEncoder = encoder;
+    if (encoder != Encoder::Backtrack)
+    {
+        mBacktrackingEncoder.reset();
+    }
+    else if (!mBacktrackingEncoder)
+    {
+        buildBacktrackingEncoder();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Every token of the model is encoded once with the merge encoder, so the build grows with the number
+// and length of the tokens and is only done when Backtrack is selected. Tokens whose own bytes encode
+// to other tokens, e.g. a second rule for the same string, are never output by BPE and are left out
+// of its vocabulary.
+void BPETokenizer::buildBacktrackingEncoder()
+{
+    const uint32_t tokenCount = InitialVocabSize + static_cast<uint32_t>(mModelRules.size());
+
+    std::vector<std::string_view> tokens(tokenCount);
+    std::vector<std::pair<uint32_t, uint32_t>> splits(tokenCount);
+    std::vector<bool> selfEncoding(tokenCount, false);
+
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < tokenCount; ++id)
+    {
+        tokens[id] = mIdToPair[id];
+        if (id < InitialVocabSize)
+        {
+            continue;
+        }
+
+        const MergeRankTable::Rule& rule = mModelRules[id - InitialVocabSize];
+        splits[id] = { rule.First, rule.Second };
+
+        ids.assign(reinterpret_cast<const uint8_t*>(tokens[id].data()), reinterpret_cast<const uint8_t*>(tokens[id].data()) + tokens[id].size());
+        encodeWord(ids);
+        selfEncoding[id] = ids.size() == 1 && ids[0] == id;
+    }
+
+    mBacktrackingEncoder = std::make_unique<BacktrackingEncoder>();
+    mBacktrackingEncoder->Build(tokens, splits, selfEncoding, mMergeRules);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPETokenizer::SetCacheCapacity(const size_t capacity)
+{
+    mCache = capacity != 0 ? std::make_unique<PretokenCache>(capacity) : nullptr;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+PretokenCache::Stats BPETokenizer::GetCacheStats() const
+{
+    return mCache ? mCache->GetStats() : PretokenCache::Stats();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPETokenizer::printCacheStats() const
+{
+    if (!mCache)
+    {
+        return;
+    }
+
+    const PretokenCache::Stats stats = GetCacheStats();
+    const uint64_t lookups = stats.Hits + stats.Misses;
+    fprintf(stderr, "Pretoken cache: %.1f%% hits (%llu of %llu), %zu words, %llu evicted.\n",
+        lookups != 0 ? 100.0 * stats.Hits / lookups : 0.0, static_cast<unsigned long long>(stats.Hits),
+        static_cast<unsigned long long>(lookups), stats.Size, static_cast<unsigned long long>(stats.Evictions));
+}
+
 //-------------------------------------------------------------------------------------------------
 // Public API to encode a single word.
 void BPETokenizer::Encode(const std::string& text)
 {
     // split text to chunks(words)
-    auto ret = encodeWord(text);
+    std::vector<uint32_t> ret;
+    encodeWord(text, ret);
 
     for (const auto id : ret)
     {
@@ -78,31 +201,268 @@ void BPETokenizer::Encode(const std::string& text)
 // Read entire file and encode each word. Reading and Encoding are multi-threaded.
 void BPETokenizer::EncodeFile(const std::string& inputFileName, const std::string& outputFileName)
 {
+    if (mInputOptions.ReadBackend != WindowedFile::Backend::Mmap && encodeFileWindows(inputFileName, outputFileName))
+    {
+        return;
+    }
+
+    mMappedFile = std::make_unique<MemoryMappedFile>(inputFileName, mInputOptions.PrefaultPages, mInputOptions.HugePages);
+
+    const void* data = mMappedFile->getData();
+    const size_t fileSize = mMappedFile->getSize();
+    if (mMappedFile->isValid() && DecompressingReader::Detect(data, fileSize) != DecompressingReader::Format::None)
+    {
+        // Compressed text does not fit in memory at once, it is encoded block by block like a stream.
+        DecompressingReader decompressor(data, fileSize, FileReadThreadCount);
+        BufferedStreamReader streamReader([&decompressor](char* buffer, const size_t size)
+        {
+            return decompressor.Read(buffer, size);
+        });
+
+        streamReader.SetCutAtLineEnds(mInputOptions.IsJsonl());
+
+        std::ofstream outFile(outputFileName);
+        encodeBlocks(streamReader, outFile);
+
+        fprintf(stderr, "Encoded %zu bytes decompressed from '%s'.\n", streamReader.GetTotalBytes(), inputFileName.c_str());
+        return;
+    }
+
+    if (mFusedFileEncode)
+    {
+        encodeMappedFile(inputFileName, outputFileName);
+        printCacheStats();
+        return;
+    }
+
     std::vector<std::string_view> words;
     readFile(inputFileName, words);
     
-    std::vector<std::vector<uint32_t>> result;
+    EncodedWords result;
     Encode(words, result);
 
     std::ofstream outFile(outputFileName);
-    for (const auto& tokens : result)
+    writeTokens(outFile, result, mDocumentEnds);
+
+    printCacheStats();
+}
+
+//-------------------------------------------------------------------------------------------------
+// Fused EncodeFile of mMappedFile: every read thread encodes the words of its section as they are
+// pretokenized, no list of all words is built and no encoding threads are started. The tokens of the
+// sections are written in order once all are done.
+void BPETokenizer::encodeMappedFile(const std::string& inputFileName, const std::string& outputFileName)
+{
+    std::ofstream outFile(outputFileName);
+    if (!mMappedFile->isValid())
+    {
+        std::cout << "Mapped file is not valid (likely zero size)." << std::endl;
+        return;
+    }
+
+    const char* data = static_cast<const char*>(mMappedFile->getData());
+    const size_t fileSize = mMappedFile->getSize();
+
+    if (mInputOptions.AdviseSections)
+    {
+        MemoryMappedFile::advise(data, data + fileSize, MemoryMappedFile::Advice::Sequential);
+        MemoryMappedFile::advise(data, data + fileSize, MemoryMappedFile::Advice::WillNeed);
+    }
+
+    const uint8_t ThreadCount = FileReadThreadCount;
+    const std::vector<FileSection> fileSections = cutFileSections(data, fileSize);
+    auto sectionResults = std::vector<EncodedWords>(ThreadCount);
+    auto sectionDocumentEnds = std::vector<std::vector<size_t>>(ThreadCount);
+    std::string sectionDocuments; // Unused for plain text
+    if (mInputOptions.IsJsonl())
+    {
+        mDocumentBuffers.resize(ThreadCount);
+    }
+
+    const MemoryMappedFile::PageFaults startFaults = MemoryMappedFile::pageFaults();
+
+    std::vector<std::thread> workers;
+    workers.reserve(ThreadCount);
+
+    for (int i = 0; i < ThreadCount; ++i)
+    {
+        workers.emplace_back(
+            &BPETokenizer::encodeFileSection,
+            this,
+            data,
+            std::cref(fileSections[i]),
+            std::ref(mInputOptions.IsJsonl() ? mDocumentBuffers[i] : sectionDocuments),
+            std::ref(sectionResults[i]),
+            std::ref(sectionDocumentEnds[i])
+        );
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    const MemoryMappedFile::PageFaults endFaults = MemoryMappedFile::pageFaults();
+
+    size_t totalWords = 0;
+    for (int i = 0; i < ThreadCount; ++i)
+    {
+        totalWords += sectionResults[i].size();
+        writeTokens(outFile, sectionResults[i], sectionDocumentEnds[i]);
+    }
+
+    fprintf(stderr, "Encoded %zu words of '%s' in %d sections.\n", totalWords, inputFileName.c_str(), static_cast<int>(ThreadCount));
+    fprintf(stderr, "Page faults: %ld minor, %ld major.\n", endFaults.minor - startFaults.minor, endFaults.major - startFaults.major);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Pretokenizes and encodes one section of a file, outDocumentEnds index the words of the section.
+void BPETokenizer::encodeFileSection(
+    const char* data,
+    const FileSection& fileSection,
+    std::string& outDocuments,
+    EncodedWords& outResult,
+    std::vector<size_t>& outDocumentEnds
+)
+{
+#if USE_PCRE
+    if (!mInputOptions.IsJsonl())
+    {
+        const std::string_view text(data + fileSection.first, fileSection.second - fileSection.first);
+        mPreTokenizer->PCRETokenize(text, [&](const std::string_view word)
+        {
+            encodeWord(word, outResult.Ids);
+            outResult.EndWord();
+        });
+        return;
+    }
+#endif
+
+    // JSONL documents are unescaped before they are pretokenized, the words of the section are
+    // listed as in readFile. Builds without PCRE list them too.
+    std::vector<std::string_view> words;
+    if (mInputOptions.IsJsonl())
+    {
+        readJsonlSection(data, fileSection, outDocuments, words, outDocumentEnds);
+    }
+    else
+    {
+        size_t totalWords = 0;
+        readFileSection(data, fileSection, words, totalWords);
+    }
+
+    outResult.Offsets.reserve(words.size() + 1);
+    for (const std::string_view word : words)
+    {
+        encodeWord(word, outResult.Ids);
+        outResult.EndWord();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Reads the file in order through windows of the chosen backend and encodes it block by block like a
+// stream. Returns false for compressed files, which are mapped and decompressed as usual.
+bool BPETokenizer::encodeFileWindows(const std::string& inputFileName, const std::string& outputFileName)
+{
+    const WindowedFile file(inputFileName, mInputOptions.ReadBackend);
+
+    const WindowedFile::Window header = file.Read(0, 16);
+    if (DecompressingReader::Detect(header.GetData(), header.GetSize()) != DecompressingReader::Format::None)
+    {
+        return false;
+    }
+
+    uint64_t offset = 0;
+    BufferedStreamReader streamReader([&file, &offset](char* buffer, const size_t size)
+    {
+        const WindowedFile::Window window = file.Read(offset, size);
+        std::memcpy(buffer, window.GetData(), window.GetSize());
+        offset += window.GetSize();
+        return window.GetSize();
+    });
+
+    streamReader.SetCutAtLineEnds(mInputOptions.IsJsonl());
+
+    std::ofstream outFile(outputFileName);
+    encodeBlocks(streamReader, outFile);
+
+    fprintf(stderr, "Encoded %zu bytes read from '%s'.\n", streamReader.GetTotalBytes(), inputFileName.c_str());
+    return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Encode text read from a pipe or any file descriptor block by block, memory does not grow with the input.
+void BPETokenizer::EncodeStream(const int fd, const std::string& outputFileName)
+{
+    std::ofstream outFile(outputFileName);
+
+    BufferedStreamReader streamReader(fd);
+    streamReader.SetCutAtLineEnds(mInputOptions.IsJsonl());
+    encodeBlocks(streamReader, outFile);
+
+    fprintf(stderr, "Encoded %zu bytes of stream.\n", streamReader.GetTotalBytes());
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPETokenizer::encodeBlocks(BufferedStreamReader& streamReader, std::ostream& output)
+{
+    std::vector<std::string_view> words;
+    EncodedWords result;
+
+    // The next block is read while the current one is pretokenized and encoded.
+    for (std::string_view block = streamReader.Next(); !block.empty(); block = streamReader.Next())
+    {
+        words.clear();
+        pretokenize(block.data(), block.size(), words);
+
+        Encode(words, result);
+        writeTokens(output, result, mDocumentEnds);
+    }
+
+    printCacheStats();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPETokenizer::writeTokens(std::ostream& output, const EncodedWords& result, const std::vector<size_t>& documentEnds)
+{
+    size_t document = 0;
+    for (size_t word = 0; word < result.size(); ++word)
     {
-        for (const auto id : tokens)
+        // Empty line after each document
+        for (; document < documentEnds.size() && documentEnds[document] == word; ++document)
         {
-            outFile << mIdToPair[id] << ' ' << id << '\n';
+            output << '\n';
+        }
+
+        for (const auto id : result[word])
+        {
+            output << mIdToPair[id] << ' ' << id << '\n';
         }
     }
+
+    for (; document < documentEnds.size(); ++document)
+    {
+        output << '\n';
+    }
 }
 
 //-------------------------------------------------------------------------------------------------
 // Encode list of word in multi-threaded manner.
-void BPETokenizer::Encode(const std::vector<std::string_view>& inputWords, std::vector<std::vector<uint32_t>>& outResult)
+void BPETokenizer::Encode(const std::vector<std::string_view>& inputWords, EncodedWords& outResult)
 {
-    uint8_t ThreadCount = EncodeThreadCount;
+    const uint8_t ThreadCount = encodeThreadCount(inputWords);
+    if (ThreadCount == 1)
+    {
+        outResult.clear();
+        encodeAllWords(inputWords, { 0, static_cast<uint32_t>(inputWords.size()) }, outResult);
+        return;
+    }
+
     const uint32_t inputSize = inputWords.size();
     const uint32_t SectionLength = inputSize / ThreadCount;
 
-    outResult = std::vector<std::vector<uint32_t>>(inputSize);
     auto inputSections = std::vector<IdPair>(ThreadCount);
 
     inputSections[0].first = 0;
@@ -120,6 +480,11 @@ void BPETokenizer::Encode(const std::vector<std::string_view>& inputWords, std::
     // Ensure the last section covers all remaining elements
     inputSections[ThreadCount - 1].second = inputSize;
 
+    // The first section is encoded into outResult, the others are appended to it in order. Local to
+    // the call, so several threads can encode with the same tokenizer at once.
+    outResult.clear();
+    std::vector<EncodedWords> threadResults(ThreadCount - 1);
+
     std::vector<std::thread> workers;
     workers.reserve(ThreadCount);
 
@@ -130,7 +495,7 @@ void BPETokenizer::Encode(const std::vector<std::string_view>& inputWords, std::
             this,
             std::cref(inputWords),
             std::cref(inputSections[i]),
-            std::ref(outResult)
+            std::ref(i == 0 ? outResult : threadResults[i - 1])
         );
     }
 
@@ -140,100 +505,395 @@ void BPETokenizer::Encode(const std::vector<std::string_view>& inputWords, std::
         worker.join();
     }
 
+    for (const auto& threadResult : threadResults)
+    {
+        outResult.Append(threadResult);
+    }
+
     fprintf(stderr, "Finished encoding threads.\n");
 }
 
+//-------------------------------------------------------------------------------------------------
+// Starting and joining a thread costs as much as encoding a few thousand words, so small batches are
+// encoded on the caller's thread and each further thread needs mEncodeCostPerThread of work. The cost
+// of a batch is its bytes plus EncodeWordCost per word, for the lookups and bookkeeping of each word.
+uint8_t BPETokenizer::encodeThreadCount(const std::vector<std::string_view>& words) const
+{
+    const unsigned cores = std::thread::hardware_concurrency();
+    const uint8_t maxThreads = cores != 0 ? static_cast<uint8_t>(std::min<unsigned>(EncodeThreadCount, cores)) : EncodeThreadCount;
+    if (mEncodeCostPerThread == 0)
+    {
+        return EncodeThreadCount;
+    }
+
+    size_t cost = words.size() * EncodeWordCost;
+    for (const std::string_view word : words)
+    {
+        cost += word.size();
+    }
+
+    return static_cast<uint8_t>(std::clamp<size_t>(cost / mEncodeCostPerThread, 1, maxThreads));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BPETokenizer::Encode(const std::vector<std::string_view>& inputWords, std::vector<std::vector<uint32_t>>& outResult)
+{
+    EncodedWords encoded;
+    Encode(inputWords, encoded);
+
+    outResult.resize(encoded.size());
+    for (size_t i = 0; i < encoded.size(); ++i)
+    {
+        outResult[i].assign(encoded[i].begin(), encoded[i].end());
+    }
+}
+
 //-------------------------------------------------------------------------------------------------
 // Encode list of words to list of encoded result.
-void BPETokenizer::encodeAllWords(const std::vector<std::string_view>& words, const IdPair& inputSection, std::vector<std::vector<uint32_t>>& outResult)
+void BPETokenizer::encodeAllWords(const std::vector<std::string_view>& words, const IdPair& inputSection, EncodedWords& outResult)
 {
+    if (mDeduplicateWords)
+    {
+        encodeUniqueWords(words, inputSection, outResult);
+        return;
+    }
+
+    if (mInterleaveWords && mEncoder == Encoder::Merge)
+    {
+        encodeWordGroups(words, inputSection, outResult);
+        return;
+    }
+
+    outResult.Offsets.reserve(outResult.Offsets.size() + inputSection.second - inputSection.first);
     for (int i = inputSection.first; i < inputSection.second; ++i)
     {
-        outResult[i] = encodeWord(words[i]);
+        encodeWord(words[i], outResult.Ids);
+        outResult.EndWord();
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Same result as encodeAllWords with the merge encoder. Each word's scan in encodeWord waits for one
+// merge rule lookup after the other. Here WordGroupSize words advance together one merge at a time,
+// and the rules of all their pairs are prefetched before any is looked up, so the cache misses of
+// different words overlap.
+void BPETokenizer::encodeWordGroups(const std::vector<std::string_view>& words, const IdPair& inputSection, EncodedWords& outResult)
+{
+    // Ids of each word of the group, kept by the thread
+    thread_local std::array<std::vector<uint32_t>, WordGroupSize> threadGroupIds;
+    std::array<std::vector<uint32_t>, WordGroupSize>& groupIds = threadGroupIds;
+
+    outResult.Offsets.reserve(outResult.Offsets.size() + inputSection.second - inputSection.first);
+    for (uint32_t groupStart = inputSection.first; groupStart < inputSection.second; groupStart += WordGroupSize)
+    {
+        const uint32_t groupSize = std::min<uint32_t>(WordGroupSize, inputSection.second - groupStart);
+
+        // Words that are tokens, cached or long are done at once, the others take part in the rounds
+        std::array<uint32_t, WordGroupSize> wordTokens; // The token of a word that is one, else NoRank
+        std::array<uint32_t, WordGroupSize> active;
+        uint32_t activeCount = 0;
+        for (uint32_t member = 0; member < groupSize; ++member)
+        {
+            const std::string_view word = words[groupStart + member];
+            const auto vocabIter = mVocabulary.find(word);
+            wordTokens[member] = vocabIter != mVocabulary.end() ? vocabIter->second : MergeRankTable::NoRank;
+            if (wordTokens[member] != MergeRankTable::NoRank)
+            {
+                continue;
+            }
+
+            std::vector<uint32_t>& ids = groupIds[member];
+            ids.clear();
+            if (word.size() >= LongWordLength || (mCache && PretokenCache::IsCacheable(word) && mCache->Find(word, ids)))
+            {
+                if (ids.empty())
+                {
+                    encodeWord(word, ids);
+                }
+            }
+            else
+            {
+                for (const auto& ch : word)
+                {
+                    ids.push_back(static_cast<uint8_t>(ch));
+                }
+                active[activeCount++] = member;
+            }
+        }
+
+        while (activeCount != 0)
+        {
+            for (uint32_t a = 0; a < activeCount; ++a)
+            {
+                const std::vector<uint32_t>& ids = groupIds[active[a]];
+                for (size_t i = 0; i + 1 < ids.size(); ++i)
+                {
+                    mMergeRules.Prefetch(ids[i], ids[i + 1]);
+                }
+            }
+
+            // Words without a merge left drop out, the order of the others does not matter
+            for (uint32_t a = 0; a < activeCount; )
+            {
+                std::vector<uint32_t>& ids = groupIds[active[a]];
+                if (ids.size() > 1 && mergeLowestPair(ids))
+                {
+                    ++a;
+                    continue;
+                }
+
+                const std::string_view word = words[groupStart + active[a]];
+                if (mCache && PretokenCache::IsCacheable(word))
+                {
+                    mCache->Insert(word, ids);
+                }
+                active[a] = active[--activeCount];
+            }
+        }
+
+        for (uint32_t member = 0; member < groupSize; ++member)
+        {
+            if (wordTokens[member] != MergeRankTable::NoRank)
+            {
+                outResult.Ids.push_back(wordTokens[member]);
+            }
+            else
+            {
+                outResult.Ids.insert(outResult.Ids.end(), groupIds[member].begin(), groupIds[member].end());
+            }
+            outResult.EndWord();
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Same result as encodeAllWords, a word seen before in the section takes the tokens of its first
+// occurrence. Sections are deduplicated on their own, so threads share nothing.
+void BPETokenizer::encodeUniqueWords(const std::vector<std::string_view>& words, const IdPair& inputSection, EncodedWords& outResult)
+{
+    // 1 + index in outResult of the first occurrence of each word, 0 for new words. Words that are a
+    // token cost one lookup anyway and are left out, the map stays small.
+    FlatStringMap<uint32_t> firstOccurrences;
+    outResult.Offsets.reserve(outResult.Offsets.size() + inputSection.second - inputSection.first);
+    for (uint32_t i = inputSection.first; i < inputSection.second; ++i)
+    {
+        const auto vocabIter = mVocabulary.find(words[i]);
+        if (vocabIter != mVocabulary.end())
+        {
+            outResult.Ids.push_back(vocabIter->second);
+            outResult.EndWord();
+            continue;
+        }
+
+        uint32_t& first = firstOccurrences[words[i]];
+        if (first == 0)
+        {
+            first = static_cast<uint32_t>(outResult.size()) + 1;
+            encodeWord(words[i], outResult.Ids);
+        }
+        else
+        {
+            // By index, the ids may move while growing
+            for (size_t id = outResult.Offsets[first - 1]; id < outResult.Offsets[first]; ++id)
+            {
+                outResult.Ids.push_back(outResult.Ids[id]);
+            }
+        }
+        outResult.EndWord();
     }
 }
 
 //-------------------------------------------------------------------------------------------------
 // First convert string to a list of integer and then encode it.
-std::vector<uint32_t> BPETokenizer::encodeWord(const std::string_view& word)
+void BPETokenizer::encodeWord(const std::string_view& word, std::vector<uint32_t>& outIds)
 {
     auto vocabIter = mVocabulary.find(word);
     if (vocabIter != mVocabulary.end())
     {
-        return { vocabIter->second };
+        outIds.push_back(vocabIter->second);
+        return;
     }
 
-    std::vector<uint32_t> splitedWord;
-    for (const auto& ch : word)
+    // Reused by every word of the thread, grows to the longest word and stays
+    thread_local std::vector<uint32_t> splitedWord;
+    splitedWord.clear();
+
+    const bool cached = mCache && PretokenCache::IsCacheable(word);
+    if (!cached || !mCache->Find(word, splitedWord))
     {
-        // We should cast to unsigned char first then uint
-        splitedWord.push_back(static_cast<uint8_t>(ch));
+        if (mEncoder == Encoder::Backtrack && mBacktrackingEncoder)
+        {
+            mBacktrackingEncoder->Encode(word, splitedWord);
+        }
+        else
+        {
+            for (const auto& ch : word)
+            {
+                // We should cast to unsigned char first then uint
+                splitedWord.push_back(static_cast<uint8_t>(ch));
+            }
+
+            encodeWord(splitedWord);
+        }
+
+        if (cached)
+        {
+            mCache->Insert(word, splitedWord);
+        }
     }
 
-    encodeWord(splitedWord);
+    outIds.insert(outIds.end(), splitedWord.begin(), splitedWord.end());
+}
+
+//-------------------------------------------------------------------------------------------------
+// Same merges as the scan of encodeWord in O(n log n), for long words such as whitespace runs,
+// minified code or base64. Symbols form a linked list over splitedWord and a min-heap holds the rank
+// of each adjacent pair with the position of its left symbol. Popping by (rank, position) replays the
+// scan: all pairs of the lowest rank from left to right, and a merge only creates pairs with the
+// merged id, whose rules and ranks come later.
+void BPETokenizer::encodeLongWord(std::vector<uint32_t>& splitedWord)
+{
+    constexpr uint32_t None = std::numeric_limits<uint32_t>::max();
+    const uint32_t size = static_cast<uint32_t>(splitedWord.size());
+
+    // Kept by the thread for the next long word
+    thread_local std::vector<uint32_t> previous, next;
+    previous.resize(size);
+    next.resize(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        previous[i] = i - 1; // None for the first
+        next[i] = i + 1 < size ? i + 1 : None;
+    }
+
+    // rank << 32 | left position
+    thread_local std::vector<uint64_t> heap;
+    heap.clear();
+    const auto pushPair = [&](const uint32_t left)
+    {
+        const uint32_t right = next[left];
+        const uint32_t rank = right != None ? mMergeRules.Find(splitedWord[left], splitedWord[right]) : MergeRankTable::NoRank;
+        if (rank != MergeRankTable::NoRank)
+        {
+            heap.push_back((static_cast<uint64_t>(rank) << 32) | left);
+            std::push_heap(heap.begin(), heap.end(), std::greater<uint64_t>());
+        }
+    };
+
+    for (uint32_t left = 0; left + 1 < size; ++left)
+    {
+        pushPair(left);
+    }
+
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), std::greater<uint64_t>());
+        const uint32_t rank = static_cast<uint32_t>(heap.back() >> 32);
+        const uint32_t left = static_cast<uint32_t>(heap.back());
+        heap.pop_back();
+
+        // Stale if the left symbol was merged away or either symbol changed since the pair was pushed
+        const uint32_t right = next[left];
+        if (splitedWord[left] == None || right == None || mMergeRules.Find(splitedWord[left], splitedWord[right]) != rank)
+        {
+            continue;
+        }
+
+        splitedWord[left] = rank;
+        splitedWord[right] = None;
+        next[left] = next[right];
+        if (next[right] != None)
+        {
+            previous[next[right]] = left;
+        }
+
+        if (previous[left] != None)
+        {
+            pushPair(previous[left]);
+        }
+        pushPair(left);
+    }
 
-    return splitedWord;
+    // The first symbol is never merged away
+    size_t write = 0;
+    for (uint32_t i = 0; i != None; i = next[i])
+    {
+        splitedWord[write++] = splitedWord[i];
+    }
+    splitedWord.resize(write);
 }
 
 //-------------------------------------------------------------------------------------------------
 // Real encode algorithm for each word converted to a list of ids.
-// I can use a minHeap and do same as learn algorithm but seems it is overkill and has no gain.
+// Rescans all pairs after each merge, long words go to the heap of encodeLongWord instead.
 void BPETokenizer::encodeWord(std::vector<uint32_t>& splitedWord)
 {
-    static const auto mergeRulesEnd = mMergeRules.end();
+    if (splitedWord.size() >= LongWordLength)
+    {
+        encodeLongWord(splitedWord);
+        return;
+    }
 
-    while (splitedWord.size() > 1)
+    while (splitedWord.size() > 1 && mergeLowestPair(splitedWord))
     {
-        // Min rank is the most frequent pair in the training phase.
-        // rank is token id or the order by frequency of pairs in training phase.
-        bool minPairFound = false;
-        IdPair minRankPair;
-        uint32_t minRank = std::numeric_limits< uint32_t>::max();
-        for (size_t i = 0; i < splitedWord.size() - 1; ++i)
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// One step of encodeWord: merges every occurrence of the pair of the lowest rank, false if no pair
+// of splitedWord is merged.
+bool BPETokenizer::mergeLowestPair(std::vector<uint32_t>& splitedWord) const
+{
+    // Min rank is the most frequent pair in the training phase.
+    // rank is token id or the order by frequency of pairs in training phase.
+    bool minPairFound = false;
+    IdPair minRankPair;
+    uint32_t minRank = std::numeric_limits< uint32_t>::max();
+    for (size_t i = 0; i < splitedWord.size() - 1; ++i)
+    {
+        const IdPair currentPair(splitedWord[i], splitedWord[i + 1]);
+        const uint32_t rank = mMergeRules.Find(currentPair.first, currentPair.second);
+        if (rank != MergeRankTable::NoRank)
         {
-            const IdPair currentPair(splitedWord[i], splitedWord[i + 1]);
-            auto mergeIter = mMergeRules.find(currentPair);
-            if (mergeIter != mergeRulesEnd)
+            minPairFound = true;
+            if (rank < minRank)
             {
-                minPairFound = true;
-                const uint32_t rank = mergeIter->second;
-                if (rank < minRank)
+                minRank = rank;
+                minRankPair = currentPair;
+                // Early exit if the minimal possible rank is found
+                if (minRank == 0)
                 {
-                    minRank = rank;
-                    minRankPair = currentPair;
-                    // Early exit if the minimal possible rank is found
-                    if (minRank == 0)
-                    {
-                        break;
-                    }
+                    break;
                 }
             }
         }
+    }
 
-        // If no mergeable pairs found, exit
-        if (!minPairFound)
+    // If no mergeable pairs found, exit
+    if (!minPairFound)
+    {
+        return false;
+    }
+
+    // Step 2: Replace all occurrences of minPair with its token ID in-place
+    size_t write = 0, read = 0;
+    while (read < splitedWord.size())
+    {
+        if (read < splitedWord.size() - 1 &&
+            splitedWord[read] == minRankPair.first &&
+            splitedWord[read + 1] == minRankPair.second)
         {
-            break;
+            splitedWord[write++] = minRank;
+            read += 2;
         }
-
-        // Step 2: Replace all occurrences of minPair with its token ID in-place
-        size_t write = 0, read = 0;
-        while (read < splitedWord.size())
+        else
         {
-            if (read < splitedWord.size() - 1 &&
-                splitedWord[read] == minRankPair.first &&
-                splitedWord[read + 1] == minRankPair.second)
-            {
-                splitedWord[write++] = minRank;
-                read += 2;
-            }
-            else
-            {
-                splitedWord[write++] = splitedWord[read++];
-            }
+            splitedWord[write++] = splitedWord[read++];
         }
-        splitedWord.resize(write);
     }
+    splitedWord.resize(write);
+    return true;
 }
 
 //-------------------------------------------------------------------------------------------------
@@ -241,7 +901,8 @@ void BPETokenizer::encodeWord(std::vector<uint32_t>& splitedWord)
 // Multi-threaded read file, pre-tokenize using regex.
 void BPETokenizer::readFile(const std::string& fileName, std::vector<std::string_view>& outAllWords)
 {
-    mMappedFile = std::make_unique<MemoryMappedFile>(fileName);
+    // The document ends of a file read before must not be written with the words of this one
+    mDocumentEnds.clear();
 
     if (!mMappedFile->isValid())
     {
@@ -254,33 +915,60 @@ void BPETokenizer::readFile(const std::string& fileName, std::vector<std::string
     std::cout << "Size: " << mMappedFile->getSize() << " bytes" << std::endl;
 
     // Treat the mapped data as a char array
-    char* data = static_cast<char*>(mMappedFile->getData());
-    const uint32_t fileSize = mMappedFile->getSize();
+    const char* data = static_cast<const char*>(mMappedFile->getData());
+    const size_t fileSize = mMappedFile->getSize();
+
+    // Every thread reads one section, so the whole file is read ahead at once. Words point into the
+    // mapping until they are encoded, nothing is released.
+    if (mInputOptions.AdviseSections)
+    {
+        MemoryMappedFile::advise(data, data + fileSize, MemoryMappedFile::Advice::Sequential);
+        MemoryMappedFile::advise(data, data + fileSize, MemoryMappedFile::Advice::WillNeed);
+    }
 
+    const MemoryMappedFile::PageFaults startFaults = MemoryMappedFile::pageFaults();
+    pretokenize(data, fileSize, outAllWords);
+    const MemoryMappedFile::PageFaults endFaults = MemoryMappedFile::pageFaults();
+
+    fprintf(stderr, "Read %zu words from text file.\n", outAllWords.size());
+    fprintf(stderr, "Page faults: %ld minor, %ld major.\n", endFaults.minor - startFaults.minor, endFaults.major - startFaults.major);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Pretokenize text in FileReadThreadCount sections cut at line ends, words are appended to outAllWords in order.
+void BPETokenizer::pretokenize(const char* data, const size_t fileSize, std::vector<std::string_view>& outAllWords)
+{
     const uint8_t ThreadCount = FileReadThreadCount;
-    const uint32_t SectionLength = fileSize / ThreadCount;
 
-    auto fileSections = std::vector<IdPair>(ThreadCount);
+    const std::vector<FileSection> fileSections = cutFileSections(data, fileSize);
     auto threadOutWords = std::vector<std::vector<std::string_view>>(ThreadCount);
     auto numProcessedWords = std::vector<size_t>(ThreadCount);
 
-    fileSections[0].first = 0;
-    fileSections[0].second = goToLineEnd(data, fileSize, SectionLength);
+    std::vector<std::thread> workers;
+    workers.reserve(ThreadCount);
 
-    for (int i = 1; i < ThreadCount; ++i)
+    auto threadDocumentEnds = std::vector<std::vector<size_t>>(ThreadCount);
+    if (mInputOptions.IsJsonl())
     {
-        const uint32_t sectionStart = fileSections[i - 1].second;
-        const uint32_t sectionEnd = sectionStart + SectionLength;
-
-        fileSections[i].first = sectionStart;
-        fileSections[i].second = goToLineEnd(data, fileSize, sectionEnd);
+        mDocumentBuffers.resize(ThreadCount);
     }
 
-    std::vector<std::thread> workers;
-    workers.reserve(ThreadCount);
-
     for (int i = 0; i < ThreadCount; ++i)
     {
+        if (mInputOptions.IsJsonl())
+        {
+            workers.emplace_back(
+                &BPETokenizer::readJsonlSection,
+                this,
+                data,
+                std::cref(fileSections[i]),
+                std::ref(mDocumentBuffers[i]),
+                std::ref(threadOutWords[i]),
+                std::ref(threadDocumentEnds[i])
+            );
+            continue;
+        }
+
         workers.emplace_back(
             &BPETokenizer::readFileSection,
             this,
@@ -304,43 +992,71 @@ void BPETokenizer::readFile(const std::string& fileName, std::vector<std::string
         totalWords += threadOutWords[i].size();
     }
 
-    outAllWords.reserve(totalWords);
+    outAllWords.reserve(outAllWords.size() + totalWords);
+    mDocumentEnds.clear();
     
     for (int i = 0; i < ThreadCount; ++i)
     {
+        for (const size_t documentEnd : threadDocumentEnds[i])
+        {
+            mDocumentEnds.push_back(outAllWords.size() + documentEnd);
+        }
+
         outAllWords.insert(
             outAllWords.end(),
             std::make_move_iterator(threadOutWords[i].begin()),
             std::make_move_iterator(threadOutWords[i].end())
         );
     }
-
-    fprintf(stderr, "Read %llu words from text file.\n", totalWords);
 }
 
 //-------------------------------------------------------------------------------------------------
-
-size_t BPETokenizer::goToLineEnd(char* data, size_t fileSize, size_t startFrom)
+// One section per read thread, cut where pretokens do not change (at line ends for JSONL).
+std::vector<BPETokenizer::FileSection> BPETokenizer::cutFileSections(const char* data, const size_t fileSize)
 {
-    if (startFrom >= fileSize)
+    const uint8_t ThreadCount = FileReadThreadCount;
+    const size_t SectionLength = fileSize / ThreadCount;
+
+    auto fileSections = std::vector<FileSection>(ThreadCount);
+
+    fileSections[0].first = 0;
+    fileSections[0].second = goToLineEnd(data, fileSize, SectionLength);
+
+    for (int i = 1; i < ThreadCount; ++i)
     {
-        return fileSize;
+        const size_t sectionStart = fileSections[i - 1].second;
+        const size_t sectionEnd = sectionStart + SectionLength;
+
+        fileSections[i].first = sectionStart;
+        fileSections[i].second = goToLineEnd(data, fileSize, sectionEnd);
     }
 
-    for (int i = startFrom; i < fileSize; ++i)
+    return fileSections;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t BPETokenizer::goToLineEnd(const char* data, size_t fileSize, size_t startFrom)
+{
+    if (mInputOptions.IsJsonl())
     {
-        if (data[i] == '\n' || data[i] == EOF)
+        // JSON strings can not hold a raw line end, a section ends after one.
+        if (startFrom >= fileSize)
         {
-            return i;
+            return fileSize;
         }
+
+        const void* lineEnd = std::memchr(data + startFrom, '\n', fileSize - startFrom);
+        return lineEnd ? static_cast<const char*>(lineEnd) - data + 1 : fileSize;
     }
 
-    return -1;
+    // Cutting right before a line end could split a run of whitespace, which changes pretokens.
+    return PreTokenizer::FindSplitPoint(data, fileSize, startFrom);
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void BPETokenizer::readFileSection(const char* data, const IdPair& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
+void BPETokenizer::readFileSection(const char* data, const FileSection& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
 {
 #if USE_PCRE
     PCRETokenize(data, fileSection, outWords, outTotalWords);
@@ -352,93 +1068,60 @@ void BPETokenizer::readFileSection(const char* data, const IdPair& fileSection,
 }
 
 //-------------------------------------------------------------------------------------------------
-// TODO: here we have duplicated code to MultiThreadFileReader::PCRETokenize
-void BPETokenizer::PCRETokenize(const char* data, const IdPair& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
+// Unescapes the documents of all lines first, words are views into outDocuments so it must not grow
+// while they are taken. Every document is pretokenized on its own.
+void BPETokenizer::readJsonlSection(
+    const char* data,
+    const FileSection& fileSection,
+    std::string& outDocuments,
+    std::vector<std::string_view>& outWords,
+    std::vector<size_t>& outDocumentEnds
+)
 {
-    // This is equivalent to original GPT-2 pattern but executes faster (r50k)
-    const char* pattern =
-        R"('(?:[sdmt]|ll|ve|re)| ?\p{L}++| ?\p{N}++| ?[^\s\p{L}\p{N}]++|\s++$|\s+(?!\S)|\s)";
-
-    int errornumber;
-    PCRE2_SIZE erroroffset;
-    uint32_t compile_options = PCRE2_UCP;
-    pcre2_code* re = pcre2_compile(
-        (PCRE2_SPTR)pattern,
-        PCRE2_ZERO_TERMINATED,
-        compile_options,
-        &errornumber,
-        &erroroffset,
-        nullptr
-    );
-
-    if (!re)
-    {
-        PCRE2_UCHAR buffer[256];
-        pcre2_get_error_message(errornumber, buffer, sizeof(buffer));
-        throw std::runtime_error("Failed to compile pattern: " + std::string((char*)buffer));
-    }
-
-    // Compile to native machine code
-    int jit_ret = pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-    if (jit_ret != 0)
-    {
-        pcre2_code_free(re);
-        throw std::runtime_error("JIT compilation failed");
-    }
-
-    const char* dataStart = data + fileSection.first;
-    const PCRE2_SIZE length = fileSection.second - fileSection.first;
-    PCRE2_SIZE start_offset = 0;
-
-    pcre2_match_data* match_data = pcre2_match_data_create_from_pattern(re, nullptr);
+    outDocuments.clear();
+    std::vector<size_t> documentBegins;
 
-    while (start_offset < length)
+    const char* pos = data + fileSection.first;
+    const char* end = data + fileSection.second;
+    while (pos < end)
     {
-        int rc = pcre2_match(
-            re,
-            (PCRE2_SPTR)dataStart,
-            length,
-            start_offset,
-            0,
-            match_data,
-            nullptr
-        );
-
-        if (rc < 0)
+        const char* lineEnd = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if (lineEnd == nullptr)
         {
-            if (rc != PCRE2_ERROR_NOMATCH)
-            {
-                throw std::runtime_error("PCRE match error!");
-            }
-            break;
+            lineEnd = end;
         }
 
-        PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(match_data);
-        // Validate match bounds
-        if (ovector[0] > ovector[1] || ovector[1] > length || ovector[0] > length)
+        const size_t documentBegin = outDocuments.size();
+        if (Jsonl::ExtractField(std::string_view(pos, lineEnd - pos), mInputOptions.JsonField, outDocuments))
         {
-            throw std::runtime_error("Invalid match bounds!");
+            documentBegins.push_back(documentBegin);
         }
+        pos = lineEnd + 1;
+    }
+    documentBegins.push_back(outDocuments.size());
 
-        const size_t token_len = static_cast<size_t>(ovector[1] - ovector[0]);
-        outWords.emplace_back(dataStart + ovector[0], token_len);
-        outTotalWords++;
-
-        // Prevent infinite loop if no progress
-        if (ovector[1] <= start_offset)
-        {
-            break;
-        }
-        start_offset = ovector[1];
+    size_t totalWords = 0;
+    for (size_t i = 0; i + 1 < documentBegins.size(); ++i)
+    {
+        readFileSection(outDocuments.data(), { documentBegins[i], documentBegins[i + 1] }, outWords, totalWords);
+        outDocumentEnds.push_back(outWords.size());
     }
+}
 
-    pcre2_match_data_free(match_data);
-    pcre2_code_free(re);
+//-------------------------------------------------------------------------------------------------
+void BPETokenizer::PCRETokenize(const char* data, const FileSection& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
+{
+    const std::string_view text(data + fileSection.first, fileSection.second - fileSection.first);
+    mPreTokenizer->PCRETokenize(text, [&](const std::string_view word)
+    {
+        outWords.push_back(word);
+        outTotalWords++;
+    });
 }
 
 //-------------------------------------------------------------------------------------------------
 // TODO: here we have duplicated code to MultiThreadFileReader::STDRegexTokenize
-void BPETokenizer::STDRegexTokenize(const char* data, const IdPair& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
+void BPETokenizer::STDRegexTokenize(const char* data, const FileSection& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
 {
     // Portable alternative without Unicode properties
     const std::regex token_pattern(
@@ -460,34 +1143,15 @@ void BPETokenizer::STDRegexTokenize(const char* data, const IdPair& fileSection,
 }
 
 //-------------------------------------------------------------------------------------------------
-// TODO: here we have duplicated code to MultiThreadFileReader::SimpleTokenize
-void BPETokenizer::SimpleTokenize(const char* data, const IdPair& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
+// Regex-free pretokenizer, gives the same splits as the PCRE pattern in UTF mode.
+void BPETokenizer::SimpleTokenize(const char* data, const FileSection& fileSection, std::vector<std::string_view>& outWords, size_t& outTotalWords)
 {
-    size_t word_start = fileSection.first;
-    for (size_t i = fileSection.first; i < fileSection.second; ++i)
-    {
-        const char cur_char = data[i];
-        if (cur_char == ' ' || cur_char == '\n')
-        {
-            if (i == word_start)
-            {
-                word_start = i + 1;
-                continue;
-            }
-
-            // end of word
-            outWords.emplace_back(data + word_start, i - word_start);
-            outTotalWords++;
-            word_start = i + 1;
-        }
-    }
-
-    // Add the last word if there's one
-    if (word_start < fileSection.second)
+    const std::string_view text(data + fileSection.first, fileSection.second - fileSection.first);
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
     {
-        outWords.emplace_back(data + word_start, fileSection.second - word_start);
+        outWords.push_back(word);
         outTotalWords++;
-    }
+    });
 }
 
 //-------------------------------------------------------------------------------------------------
\ No newline at end of file
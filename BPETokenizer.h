@@ -1,6 +1,9 @@
 #pragma once
 
-#include "PairHasher.h"
+#include "EncodedWords.h"
+#include "MergeRankTable.h"
+#include "PretokenCache.h"
+#include "InputOptions.h"
 
 #include <string>
 #include <vector>
@@ -8,6 +11,7 @@
 #include <utility>  // For std::pair
 #include <list>
 #include <memory>
+#include <iosfwd>
 
 class BPETokenizer
 {
@@ -15,6 +19,13 @@ public:
 
 	static constexpr uint32_t InitialVocabSize = 256;
 
+	// Both give the same tokens.
+	enum class Encoder
+	{
+		Merge,    // Replays the merges by rank, fastest on natural text
+		Backtrack // Linear in the word length, for untrusted input, see BacktrackingEncoder.h
+	};
+
 	BPETokenizer();
 	~BPETokenizer();
 
@@ -22,63 +33,184 @@ public:
 
 	void Encode(const std::string& text);
 
+	// gzip and zstd input files are decompressed on the fly. With JSONL input an empty line follows
+	// the tokens of every document. The Pread and DirectIO backends of InputOptions::ReadBackend read
+	// the file block by block instead of mapping it.
 	void EncodeFile(const std::string& inputFileName, const std::string& outputFileName);
 
+	// Same as EncodeFile for a pipe or any other file descriptor (e.g. 0 for stdin).
+	void EncodeStream(const int fd, const std::string& outputFileName);
+
+	// Encodes without allocating per word, outResult keeps its memory from the last batch.
+	void Encode(const std::vector<std::string_view>& inputWords, EncodedWords& outResult);
+
+	// Same tokens, one vector per word.
 	void Encode(const std::vector<std::string_view>& inputWords, std::vector<std::vector<uint32_t>>& outResult);
+
+	// JSONL input extracts one field of every line, see InputOptions.h.
+	void SetInputOptions(const InputOptions& inputOptions) { mInputOptions = inputOptions; }
+	const InputOptions& GetInputOptions() const { return mInputOptions; }
+
+	// Backtrack builds its tables from the model when it is selected, and ReadModel rebuilds them while
+	// it stays selected. Merge drops them.
+	void SetEncoder(const Encoder encoder);
+	Encoder GetEncoder() const { return mEncoder; }
+
+	// Caches the tokens of up to capacity words shared by all encoding threads, see PretokenCache.h.
+	// 0 turns the cache off and drops it, setting it again starts empty.
+	void SetCacheCapacity(const size_t capacity);
+	PretokenCache::Stats GetCacheStats() const;
+
+	// Encode encodes each distinct word of an encoding thread's share of the batch once and copies
+	// its tokens to the repeats.
+	void SetDeduplicateWords(const bool deduplicate) { mDeduplicateWords = deduplicate; }
+
+	// The merge encoder advances groups of words together and prefetches their merge rules, see
+	// encodeWordGroups. Off by default, it did not beat word by word encoding on models of up to
+	// 400k merges, where the lookups of one word's pairs already overlap.
+	void SetInterleaveWords(const bool interleave) { mInterleaveWords = interleave; }
+
+	// EncodeFile of a mapped, uncompressed file encodes each word as soon as it is pretokenized, on the
+	// read threads. Only the tokens are kept, not the words of the file. Batch modes of Encode, such
+	// as SetDeduplicateWords, do not apply.
+	void SetFusedFileEncode(const bool fused) { mFusedFileEncode = fused; }
+
+	// Encode starts one thread per costPerThread of work, about bytes of input, up to EncodeThreadCount
+	// and the number of cores. Smaller batches run on the caller's thread. 0 always starts all
+	// EncodeThreadCount threads. The default is about a millisecond of work per thread.
+	static constexpr size_t DefaultEncodeCostPerThread = 256 * 1024;
+	void SetEncodeCostPerThread(const size_t costPerThread) { mEncodeCostPerThread = costPerThread; }
 	
 private:
 
 	using IdPair = std::pair<uint32_t, uint32_t>;
+	// Byte offsets into a file, which can be larger than 4 GB.
+	using FileSection = std::pair<size_t, size_t>;
 
 	std::unordered_map<uint32_t, std::string> mIdToPair; // Vocabulary, Used for debugging
 	std::unordered_map<std::string_view, uint32_t> mVocabulary;
-	std::unordered_map<IdPair, uint32_t, PairHasher> mMergeRules;
+	MergeRankTable mMergeRules;
+	std::vector<MergeRankTable::Rule> mModelRules; // In model order, the backtracking encoder is built from them
 
 	const uint8_t FileReadThreadCount;
 	const uint8_t EncodeThreadCount;
 
 	std::unique_ptr<class MemoryMappedFile> mMappedFile;
+	std::unique_ptr<class PreTokenizer> mPreTokenizer;
+	std::unique_ptr<class BacktrackingEncoder> mBacktrackingEncoder;
+
+	Encoder mEncoder = Encoder::Merge;
+
+	std::unique_ptr<PretokenCache> mCache;
+	bool mDeduplicateWords = false;
+	bool mInterleaveWords = false;
+	bool mFusedFileEncode = false;
+
+	static constexpr size_t EncodeWordCost = 16;
+	size_t mEncodeCostPerThread = DefaultEncodeCostPerThread;
+
+	InputOptions mInputOptions;
+
+	// JSONL: unescaped documents of each read thread, words point into them.
+	std::vector<std::string> mDocumentBuffers;
+	// JSONL: index of the first word after each document in the last pretokenized words.
+	std::vector<size_t> mDocumentEnds;
 
-	std::vector<uint32_t> encodeWord(const std::string_view& word);
+	// Fewer rules use the hashed layout.
+	static constexpr size_t MinIndexedMergeRules = 2048;
+	void chooseMergeRulesLayout();
+	void printCacheStats() const;
+	void buildBacktrackingEncoder();
+
+	// Appends the tokens of word to outIds.
+	void encodeWord(const std::string_view& word, std::vector<uint32_t>& outIds);
+
+	uint8_t encodeThreadCount(const std::vector<std::string_view>& words) const;
 
 	void encodeAllWords(
 		const std::vector<std::string_view>& words,
 		const IdPair& fileSection, 
-		std::vector<std::vector<uint32_t>>& outResult
+		EncodedWords& outResult
+	);
+
+	void encodeUniqueWords(
+		const std::vector<std::string_view>& words,
+		const IdPair& fileSection,
+		EncodedWords& outResult
+	);
+
+	static constexpr uint32_t WordGroupSize = 8;
+	void encodeWordGroups(
+		const std::vector<std::string_view>& words,
+		const IdPair& fileSection,
+		EncodedWords& outResult
 	);
 
 	void encodeWord(std::vector<uint32_t>& splitedWord);
+	bool mergeLowestPair(std::vector<uint32_t>& splitedWord) const;
+
+	// Words of at least this many bytes are encoded by encodeLongWord, the scan of encodeWord is
+	// quadratic in the word length but faster on short words.
+	static constexpr size_t LongWordLength = 40;
+	void encodeLongWord(std::vector<uint32_t>& splitedWord);
+
+	// documentEnds index the words of result, an empty line is written after each document.
+	void writeTokens(std::ostream& output, const EncodedWords& result, const std::vector<size_t>& documentEnds);
+
+	void encodeBlocks(class BufferedStreamReader& streamReader, std::ostream& output);
+	bool encodeFileWindows(const std::string& inputFileName, const std::string& outputFileName);
+
+	void encodeMappedFile(const std::string& inputFileName, const std::string& outputFileName);
+	void encodeFileSection(
+		const char* data,
+		const FileSection& fileSection,
+		std::string& outDocuments,
+		EncodedWords& outResult,
+		std::vector<size_t>& outDocumentEnds
+	);
 
 	// --- Read file methods ---
 
+	// Pretokenizes mMappedFile, mapped by EncodeFile.
 	void readFile(const std::string& fileName, std::vector<std::string_view>& outAllWords);
 
-	size_t goToLineEnd(char* data, size_t fileSize, size_t startFrom);
+	void pretokenize(const char* data, const size_t fileSize, std::vector<std::string_view>& outAllWords);
+
+	std::vector<FileSection> cutFileSections(const char* data, const size_t fileSize);
+	size_t goToLineEnd(const char* data, size_t fileSize, size_t startFrom);
 
 	void readFileSection(
 		const char* data,
-		const IdPair& fileSection,
+		const FileSection& fileSection,
 		std::vector<std::string_view>& outWords,
 		size_t& outTotalWords
 	);
 
+	void readJsonlSection(
+		const char* data,
+		const FileSection& fileSection,
+		std::string& outDocuments,
+		std::vector<std::string_view>& outWords,
+		std::vector<size_t>& outDocumentEnds
+	);
+
 	void PCRETokenize(
 		const char* data,
-		const IdPair& fileSection,
+		const FileSection& fileSection,
 		std::vector<std::string_view>& outWords,
 		size_t& outTotalWords
 	);
 
 	void STDRegexTokenize(
 		const char* data,
-		const IdPair& fileSection,
+		const FileSection& fileSection,
 		std::vector<std::string_view>& outWords,
 		size_t& outTotalWords
 	);
 
 	void SimpleTokenize(
 		const char* data,
-		const IdPair& fileSection,
+		const FileSection& fileSection,
 		std::vector<std::string_view>& outWords,
 		size_t& outTotalWords
 	);
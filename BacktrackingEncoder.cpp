@@ -0,0 +1,188 @@
+#include "BacktrackingEncoder.h"
+
+#include <unordered_map>
+
+//-------------------------------------------------------------------------------------------------
+
+void BacktrackingEncoder::Build(
+	const std::vector<std::string_view>& tokens,
+	const std::vector<std::pair<uint32_t, uint32_t>>& splits,
+	const std::vector<bool>& selfEncoding,
+	const MergeRankTable& mergeRules
+)
+{
+	mMergeRules = &mergeRules;
+
+	const uint32_t tokenCount = static_cast<uint32_t>(tokens.size());
+	mTokenLengths.resize(tokenCount);
+	mSplits.resize(tokenCount);
+	mShorterPrefix.assign(tokenCount, NoToken);
+
+	for (uint32_t id = 0; id < tokenCount; ++id)
+	{
+		mTokenLengths[id] = static_cast<uint32_t>(tokens[id].size());
+		mSplits[id] = id < ByteTokens ? std::make_pair(id, id) : splits[id];
+	}
+
+	const auto isUsed = [&](const uint32_t id)
+	{
+		return id < ByteTokens || selfEncoding[id];
+	};
+
+	// Trie nodes are numbered as they are created, the root is 0.
+	std::unordered_map<uint64_t, uint32_t> edges;
+	mNodeTokens.assign(1, NoToken);
+	for (uint32_t id = 0; id < tokenCount; ++id)
+	{
+		if (!isUsed(id))
+		{
+			continue;
+		}
+
+		uint32_t node = 0;
+		for (const char ch : tokens[id])
+		{
+			const auto [edge, inserted] = edges.try_emplace((static_cast<uint64_t>(node) << 8) | static_cast<uint8_t>(ch), static_cast<uint32_t>(mNodeTokens.size()));
+			if (inserted)
+			{
+				mNodeTokens.push_back(NoToken);
+			}
+			node = edge->second;
+		}
+		mNodeTokens[node] = id;
+	}
+
+	std::vector<MergeRankTable::Rule> edgeRules;
+	edgeRules.reserve(edges.size());
+	for (const auto& [key, child] : edges)
+	{
+		edgeRules.push_back({ static_cast<uint32_t>(key >> 8), static_cast<uint32_t>(key & 0xFF), child });
+	}
+	mTrieEdges.Build(edgeRules);
+	mTrieEdges.SetLayout(MergeRankTable::Layout::Indexed);
+
+	// The prefixes of a token are the tokens on its path through the trie
+	for (uint32_t id = 0; id < tokenCount; ++id)
+	{
+		if (isUsed(id) && tokens[id].size() > 1)
+		{
+			mShorterPrefix[id] = longestPrefix(tokens[id].data(), tokens[id].data() + tokens[id].size() - 1);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void BacktrackingEncoder::Encode(const std::string_view word, std::vector<uint32_t>& outTokens) const
+{
+	outTokens.clear();
+
+	// Bit i is cleared once no encoding of the word is found with a token boundary at byte i.
+	thread_local std::vector<uint64_t> reachable;
+	reachable.assign(word.size() / 64 + 1, ~0ull);
+	const auto isReachable = [](const size_t position)
+	{
+		return (reachable[position / 64] >> (position % 64)) & 1;
+	};
+
+	const char* wordEnd = word.data() + word.size();
+	size_t position = 0;
+	uint32_t nextToken = word.empty() ? NoToken : longestPrefix(word.data(), wordEnd);
+
+	while (nextToken != NoToken)
+	{
+		const uint32_t lastToken = outTokens.empty() ? NoToken : outTokens.back();
+		for (uint32_t token = nextToken; ; )
+		{
+			const size_t end = position + mTokenLengths[token];
+			if (isReachable(end) && (lastToken == NoToken || isValidPair(lastToken, token)))
+			{
+				outTokens.push_back(token);
+				position = end;
+				nextToken = position < word.size() ? longestPrefix(word.data() + position, wordEnd) : NoToken;
+				break;
+			}
+
+			if (mShorterPrefix[token] != NoToken)
+			{
+				token = mShorterPrefix[token];
+				continue;
+			}
+
+			// No token fits here after the last one, try the last one shorter. Single bytes always
+			// follow each other, so the first token is never dropped.
+			reachable[position / 64] &= ~(1ull << (position % 64));
+			outTokens.pop_back();
+			position -= mTokenLengths[lastToken];
+			nextToken = lastToken;
+			break;
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Longest used token that is a prefix of [begin, end), NoToken if empty.
+uint32_t BacktrackingEncoder::longestPrefix(const char* begin, const char* end) const
+{
+	uint32_t longest = NoToken;
+	uint32_t node = 0;
+	for (const char* ch = begin; ch != end; ++ch)
+	{
+		node = mTrieEdges.Find(node, static_cast<uint8_t>(*ch));
+		if (node == MergeRankTable::NoRank)
+		{
+			break;
+		}
+		if (mNodeTokens[node] != NoToken)
+		{
+			longest = mNodeTokens[node];
+		}
+	}
+	return longest;
+}
+
+//-------------------------------------------------------------------------------------------------
+// True if BPE puts a token boundary between first and second when they are next to each other: no
+// merge across the boundary, of the two tokens or of the parts they were merged from, has a lower
+// rank than the merges that built them. Splits the later of the two tokens until both are bytes.
+bool BacktrackingEncoder::isValidPair(uint32_t first, uint32_t second) const
+{
+	uint32_t limit = NoToken;
+	for (;;)
+	{
+		const uint32_t merged = mMergeRules->Find(first, second);
+		if (merged != MergeRankTable::NoRank && merged < limit)
+		{
+			return false;
+		}
+
+		if (first > second)
+		{
+			limit = first;
+			first = mSplits[first].second;
+			if (first == limit)
+			{
+				limit = second + 1;
+				second = mSplits[second].first;
+				if (second + 1 == limit)
+				{
+					return true;
+				}
+			}
+		}
+		else
+		{
+			limit = second + 1;
+			second = mSplits[second].first;
+			if (second + 1 == limit)
+			{
+				limit = first;
+				first = mSplits[first].second;
+				if (first == limit)
+				{
+					return true;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "MergeRankTable.h"
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// BPE encoding without replaying merges, following the backtracking encoder of GitHub's bpe crate.
+// Gives the same tokens as merging by rank, in time linear in the word length for real vocabularies
+// instead of the quadratic worst case of the merge loop, so no input can stall an encoder.
+//
+// From the current position the longest token of the vocabulary that prefixes the rest of the word is
+// tried first, found by walking a trie of all token strings. A token is kept if BPE would put a token
+// boundary between it and the previous one, which the merge ranks of the two tokens and of their
+// splits decide (see isValidPair). Otherwise the next shorter token that is a prefix of it is tried,
+// and if none is left the previous token is dropped. Positions that lead nowhere are remembered, each
+// is given up at most once.
+class BacktrackingEncoder
+{
+public:
+
+	static constexpr uint32_t NoToken = MergeRankTable::NoRank;
+
+	// tokens[id] is the string of token id, splits[id] the two tokens merged into it (unused for the
+	// single bytes below 256). Only tokens whose own encoding is that token, listed in selfEncoding, are
+	// ever output by BPE, the others are left out. mergeRules must outlive the encoder.
+	void Build(
+		const std::vector<std::string_view>& tokens,
+		const std::vector<std::pair<uint32_t, uint32_t>>& splits,
+		const std::vector<bool>& selfEncoding,
+		const MergeRankTable& mergeRules
+	);
+
+	void Encode(const std::string_view word, std::vector<uint32_t>& outTokens) const;
+
+private:
+
+	static constexpr uint32_t ByteTokens = 256;
+
+	const MergeRankTable* mMergeRules = nullptr;
+
+	std::vector<uint32_t> mTokenLengths;
+	std::vector<std::pair<uint32_t, uint32_t>> mSplits; // Single bytes split into themselves
+	std::vector<uint32_t> mShorterPrefix;               // Longest token that is a proper prefix, or NoToken
+
+	// Trie of the token strings: (node, byte) -> child node, and the token ending at each node.
+	MergeRankTable mTrieEdges;
+	std::vector<uint32_t> mNodeTokens;
+
+	uint32_t longestPrefix(const char* begin, const char* end) const;
+	bool isValidPair(uint32_t first, uint32_t second) const;
+};
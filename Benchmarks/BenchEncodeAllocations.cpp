@@ -0,0 +1,133 @@
+// Counts heap allocations and time of BPETokenizer::Encode with one vector per word and with
+// EncodedWords, on the pretokens of a text file.
+// Usage: BenchEncodeAllocations <model file> <text file> [repeats]
+
+#include "BPETokenizer.h"
+#include "PreTokenizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+
+static std::atomic<uint64_t> allocationCount{ 0 };
+
+void* operator new(const size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size != 0 ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+struct Measurement
+{
+    double Seconds = 1e30;
+    uint64_t Allocations = 0;
+};
+
+// Best time of repeats, allocations of the last run: buffers kept across batches are warm by then.
+template<typename Function>
+static Measurement measure(const int repeats, Function&& function)
+{
+    Measurement measurement;
+    for (int r = 0; r < repeats; ++r)
+    {
+        const uint64_t allocations = allocationCount.load();
+        const auto t1 = std::chrono::steady_clock::now();
+        function();
+        const auto t2 = std::chrono::steady_clock::now();
+        measurement.Seconds = std::min(measurement.Seconds, std::chrono::duration<double>(t2 - t1).count());
+        measurement.Allocations = allocationCount.load() - allocations;
+    }
+    return measurement;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <model file> <text file> [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    const int repeats = argc > 3 ? std::atoi(argv[3]) : 3;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(argv[1]);
+
+    std::ifstream inputFile(argv[2], std::ios::binary);
+    std::stringstream buffer;
+    buffer << inputFile.rdbuf();
+    const std::string text = buffer.str();
+
+    std::vector<std::string_view> words;
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+    {
+        words.push_back(word);
+    });
+
+    std::vector<std::vector<uint32_t>> vectors;
+    const Measurement vectorsRun = measure(repeats, [&]()
+    {
+        vectors.clear();
+        tokenizer.Encode(words, vectors);
+    });
+
+    EncodedWords encoded;
+    const Measurement encodedRun = measure(repeats, [&]()
+    {
+        tokenizer.Encode(words, encoded);
+    });
+
+    size_t vectorTokens = 0;
+    bool sameTokens = vectors.size() == encoded.size();
+    for (size_t i = 0; sameTokens && i < vectors.size(); ++i)
+    {
+        vectorTokens += vectors[i].size();
+        sameTokens = std::equal(vectors[i].begin(), vectors[i].end(), encoded[i].begin(), encoded[i].end());
+    }
+    if (!sameTokens)
+    {
+        fprintf(stderr, "Tokens differ\n");
+        return 1;
+    }
+
+    const double megabytes = text.size() / 1e6;
+    printf("%.1f MB, %zu words, %zu tokens\n", megabytes, words.size(), vectorTokens);
+
+    auto report = [&](const char* name, const Measurement& measurement)
+    {
+        printf("%-34s %8.3f s %7.1f ns/word %12.1f allocations/MB\n", name, measurement.Seconds,
+            measurement.Seconds * 1e9 / words.size(), measurement.Allocations / megabytes);
+    };
+
+    report("one vector per word", vectorsRun);
+    report("EncodedWords, reused", encodedRun);
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Latency of BPETokenizer::Encode for batches from 10 bytes to 100 MB of a text file, always with
+// all encoding threads and with the cost model choosing between the caller's thread and more.
+// Usage: BenchEncodeLatency <model file> <text file> [max bytes] 2>/dev/null
+
+#include "BPETokenizer.h"
+#include "PreTokenizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+
+// Median seconds of runs repeated for about a quarter of a second, at least 3 and at most 10000 times.
+static double medianLatency(BPETokenizer& tokenizer, const std::vector<std::string_view>& words, EncodedWords& result)
+{
+    std::vector<double> latencies;
+    double total = 0;
+    while (latencies.size() < 3 || (total < 0.25 && latencies.size() < 10000))
+    {
+        const auto t1 = std::chrono::steady_clock::now();
+        tokenizer.Encode(words, result);
+        const auto t2 = std::chrono::steady_clock::now();
+        latencies.push_back(std::chrono::duration<double>(t2 - t1).count());
+        total += latencies.back();
+    }
+
+    std::nth_element(latencies.begin(), latencies.begin() + latencies.size() / 2, latencies.end());
+    return latencies[latencies.size() / 2];
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <model file> <text file> [max bytes]\n", argv[0]);
+        return 1;
+    }
+
+    const size_t maxBytes = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100000000;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(argv[1]);
+
+    std::ifstream inputFile(argv[2], std::ios::binary);
+    std::stringstream buffer;
+    buffer << inputFile.rdbuf();
+    const std::string fileText = buffer.str();
+    if (fileText.empty())
+    {
+        fprintf(stderr, "Empty text file %s\n", argv[2]);
+        return 1;
+    }
+
+    // The file repeated up to the largest batch
+    std::string text;
+    while (text.size() < maxBytes)
+    {
+        text += fileText;
+    }
+
+    printf("%12s %10s %16s %16s\n", "bytes", "words", "all threads", "cost model");
+
+    EncodedWords result;
+    for (size_t bytes = 10; bytes <= maxBytes; bytes *= 10)
+    {
+        std::vector<std::string_view> words;
+        PreTokenizer::SimpleTokenize(std::string_view(text.data(), bytes), [&](const std::string_view word)
+        {
+            words.push_back(word);
+        });
+
+        tokenizer.SetEncodeCostPerThread(0);
+        const double allThreads = medianLatency(tokenizer, words, result);
+
+        tokenizer.SetEncodeCostPerThread(BPETokenizer::DefaultEncodeCostPerThread);
+        const double costModel = medianLatency(tokenizer, words, result);
+
+        printf("%12zu %10zu %13.1f us %13.1f us\n", bytes, words.size(), allThreads * 1e6, costModel * 1e6);
+    }
+
+    return 0;
+}
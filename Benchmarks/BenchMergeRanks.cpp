@@ -0,0 +1,174 @@
+// Compares merge rank containers on the pair lookups of encoding the pretokens of a text file.
+// Usage: BenchMergeRanks <model file> <text file> [repeats]
+
+#include "MergeRankTable.h"
+#include "PairHasher.h"
+#include "PreTokenizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+
+template<typename Function>
+static double bestOf(const int repeats, Function&& function)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r)
+    {
+        const auto t1 = std::chrono::steady_clock::now();
+        function();
+        const auto t2 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t2 - t1).count());
+    }
+    return best;
+}
+
+// Same merge loop as BPETokenizer::encodeWord, findRank(first, second) returns NoRank for no merge.
+template<typename FindRank>
+static size_t encodeWords(const std::vector<std::string_view>& words, FindRank&& findRank)
+{
+    size_t tokenCount = 0;
+    std::vector<uint32_t> ids;
+    for (const auto& word : words)
+    {
+        ids.assign(reinterpret_cast<const uint8_t*>(word.data()), reinterpret_cast<const uint8_t*>(word.data()) + word.size());
+        while (ids.size() > 1)
+        {
+            uint32_t minRank = MergeRankTable::NoRank;
+            size_t minIndex = 0;
+            for (size_t i = 0; i + 1 < ids.size(); ++i)
+            {
+                const uint32_t rank = findRank(ids[i], ids[i + 1]);
+                if (rank < minRank)
+                {
+                    minRank = rank;
+                    minIndex = i;
+                }
+            }
+
+            if (minRank == MergeRankTable::NoRank)
+            {
+                break;
+            }
+
+            const uint32_t first = ids[minIndex], second = ids[minIndex + 1];
+            size_t write = 0;
+            for (size_t read = 0; read < ids.size(); )
+            {
+                if (read + 1 < ids.size() && ids[read] == first && ids[read + 1] == second)
+                {
+                    ids[write++] = minRank;
+                    read += 2;
+                }
+                else
+                {
+                    ids[write++] = ids[read++];
+                }
+            }
+            ids.resize(write);
+        }
+        tokenCount += ids.size();
+    }
+    return tokenCount;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <model file> <text file> [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    const int repeats = argc > 3 ? std::atoi(argv[3]) : 3;
+
+    std::vector<MergeRankTable::Rule> rules;
+    std::ifstream modelFile(argv[1]);
+    uint32_t first, second;
+    while (modelFile >> first >> second)
+    {
+        rules.push_back({ first, second, static_cast<uint32_t>(256 + rules.size()) });
+    }
+
+    std::ifstream inputFile(argv[2], std::ios::binary);
+    std::stringstream buffer;
+    buffer << inputFile.rdbuf();
+    const std::string text = buffer.str();
+
+    std::vector<std::string_view> words;
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+    {
+        words.push_back(word);
+    });
+
+    std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t, PairHasher> mergeMap;
+    for (const auto& rule : rules)
+    {
+        mergeMap[{ rule.First, rule.Second }] = rule.Rank;
+    }
+
+    MergeRankTable mergeTable;
+    mergeTable.Build(rules);
+
+    MergeRankTable indexedTable;
+    indexedTable.Build(rules);
+    indexedTable.SetLayout(MergeRankTable::Layout::Indexed);
+
+    size_t mapTokens = 0, tableTokens = 0, indexedTokens = 0;
+
+    const double mapTime = bestOf(repeats, [&]()
+    {
+        mapTokens = encodeWords(words, [&](const uint32_t first, const uint32_t second)
+        {
+            const auto it = mergeMap.find({ first, second });
+            return it != mergeMap.end() ? it->second : MergeRankTable::NoRank;
+        });
+    });
+
+    const double tableTime = bestOf(repeats, [&]()
+    {
+        tableTokens = encodeWords(words, [&](const uint32_t first, const uint32_t second)
+        {
+            return mergeTable.Find(first, second);
+        });
+    });
+
+    const double indexedTime = bestOf(repeats, [&]()
+    {
+        indexedTokens = encodeWords(words, [&](const uint32_t first, const uint32_t second)
+        {
+            return indexedTable.Find(first, second);
+        });
+    });
+
+    if (mapTokens != tableTokens || mapTokens != indexedTokens)
+    {
+        fprintf(stderr, "Token counts differ: %zu, %zu and %zu\n", mapTokens, tableTokens, indexedTokens);
+        return 1;
+    }
+
+    const double megabytes = text.size() / 1e6;
+    printf("%.1f MB, %zu words, %zu rules, %zu tokens\n", megabytes, words.size(), rules.size(), tableTokens);
+
+    auto report = [&](const char* name, const double seconds)
+    {
+        printf("%-34s %8.3f s %8.1f MB/s %7.1f ns/word\n", name, seconds, megabytes / seconds, seconds * 1e9 / words.size());
+    };
+
+    report("unordered_map, PairHasher", mapTime);
+    report("MergeRankTable, hashed", tableTime);
+    report(indexedTable.CanIndex() ? "MergeRankTable, indexed" : "MergeRankTable, indexed (sparse ids, hashed)", indexedTime);
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+// Compares word counting containers on the pretokens of a text file.
+// Usage: BenchWordCount <text file> [repeats]
+
+#include "FlatStringMap.h"
+#include "PreTokenizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-------------------------------------------------------------------------------------------------
+
+static constexpr uint32_t PartitionBits = 6;
+
+template<typename Function>
+static double bestOf(const int repeats, Function&& function)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r)
+    {
+        const auto t1 = std::chrono::steady_clock::now();
+        function();
+        const auto t2 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(t2 - t1).count());
+    }
+    return best;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <text file> [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    const int repeats = argc > 2 ? std::atoi(argv[2]) : 3;
+
+    std::ifstream inputFile(argv[1], std::ios::binary);
+    std::stringstream buffer;
+    buffer << inputFile.rdbuf();
+    const std::string text = buffer.str();
+
+    std::vector<std::string_view> words;
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+    {
+        words.push_back(word);
+    });
+
+    size_t uniqueWords = 0;
+
+    const double stdTime = bestOf(repeats, [&]()
+    {
+        std::unordered_map<std::string_view, uint32_t> wordCount;
+        for (const auto& word : words)
+        {
+            wordCount[word]++;
+        }
+        uniqueWords = wordCount.size();
+    });
+
+    const double stdPartitionedTime = bestOf(repeats, [&]()
+    {
+        std::vector<std::unordered_map<std::string_view, uint32_t>> wordCounts(1u << PartitionBits);
+        for (const auto& word : words)
+        {
+            const uint64_t hash = std::hash<std::string_view>{}(word);
+            wordCounts[(hash * 0x9E3779B97F4A7C15ull) >> (64 - PartitionBits)][word]++;
+        }
+    });
+
+    const double flatTime = bestOf(repeats, [&]()
+    {
+        FlatStringCountMap wordCount;
+        for (const auto& word : words)
+        {
+            wordCount[word]++;
+        }
+    });
+
+    const double flatInternedTime = bestOf(repeats, [&]()
+    {
+        FlatStringCountMap wordCount(FlatStringCountMap::KeyStorage::Interned);
+        for (const auto& word : words)
+        {
+            wordCount[word]++;
+        }
+    });
+
+    const double flatPartitionedTime = bestOf(repeats, [&]()
+    {
+        std::vector<FlatStringCountMap> wordCounts(1u << PartitionBits);
+        for (const auto& word : words)
+        {
+            const uint64_t hash = FlatStringCountMap::Hash(word);
+            wordCounts[hash >> (64 - PartitionBits)].FindOrInsert(word, hash)++;
+        }
+    });
+
+    const double megabytes = text.size() / 1e6;
+    printf("%.1f MB, %zu words, %zu unique\n", megabytes, words.size(), uniqueWords);
+
+    auto report = [&](const char* name, const double seconds)
+    {
+        printf("%-34s %8.3f s %8.1f MB/s %7.1f ns/word\n", name, seconds, megabytes / seconds, seconds * 1e9 / words.size());
+    };
+
+    report("unordered_map", stdTime);
+    report("unordered_map, 64 partitions", stdPartitionedTime);
+    report("FlatStringCountMap", flatTime);
+    report("FlatStringCountMap, interned", flatInternedTime);
+    report("FlatStringCountMap, 64 partitions", flatPartitionedTime);
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "PreTokenizer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Reads text from any file descriptor (pipe, socket, terminal or regular file) or any other source,
+// e.g. a decompressor, in blocks of fixed size.
+// Two buffers are used, the next block is read in the background while the caller processes the
+// current one, so memory stays constant whatever the input size.
+// Blocks end on a pretoken boundary: the incomplete tail after the cut is carried to the next block.
+class BufferedStreamReader
+{
+public:
+
+	static constexpr size_t DefaultBufferSize = 16 << 20;
+
+	// Copies at most size bytes to buffer, returns the count, 0 only at the end of the source.
+	using ReadFunction = std::function<size_t(char* buffer, size_t size)>;
+
+	explicit BufferedStreamReader(const int fd, const size_t bufferSize = DefaultBufferSize)
+		: BufferedStreamReader([fd](char* buffer, const size_t size) { return readDescriptor(fd, buffer, size); }, bufferSize)
+	{
+	}
+
+	explicit BufferedStreamReader(ReadFunction read, const size_t bufferSize = DefaultBufferSize)
+		: mRead(std::move(read))
+		, mBufferSize(bufferSize)
+	{
+		for (auto& buffer : mBuffers)
+		{
+			buffer = std::make_unique<char[]>(mBufferSize);
+		}
+
+		startFill(0, 0);
+	}
+
+	~BufferedStreamReader()
+	{
+		if (mPendingFill.valid())
+		{
+			mPendingFill.wait();
+		}
+	}
+
+	BufferedStreamReader(const BufferedStreamReader&) = delete;
+	BufferedStreamReader& operator=(const BufferedStreamReader&) = delete;
+
+	// Returns the next block, empty at the end of the stream. The view is valid until the next call.
+	std::string_view Next()
+	{
+		if (!mPendingFill.valid())
+		{
+			return {};
+		}
+
+		size_t filled = mPendingFill.get();
+		bool endOfStream = filled < mBufferSize;
+
+		// A line may not be split, the buffers grow until one holds a whole line.
+		for (size_t searched = 0; mCutAtLineEnds && !endOfStream && std::memchr(mBuffers[mCurrent].get() + searched, '\n', filled - searched) == nullptr; )
+		{
+			searched = filled;
+			growBuffers();
+			filled = fill(mBuffers[mCurrent].get(), filled);
+			endOfStream = filled < mBufferSize;
+		}
+
+		char* const block = mBuffers[mCurrent].get();
+
+		const size_t cut = endOfStream ? filled : findCut(block, filled, mCutAtLineEnds);
+
+		// Carry the tail to the other buffer and start reading after it.
+		const size_t next = 1 - mCurrent;
+		const size_t carry = filled - cut;
+		std::memcpy(mBuffers[next].get(), block + cut, carry);
+
+		if (!endOfStream)
+		{
+			startFill(next, carry);
+		}
+
+		mCurrent = next;
+		mTotalBytes += cut;
+		return std::string_view(block, cut);
+	}
+
+	size_t GetTotalBytes() const { return mTotalBytes; }
+
+	// Cut blocks right after their last line end instead of at a pretoken boundary, for line based
+	// formats like JSONL. A line longer than the buffer doubles both buffers until it fits, so memory
+	// follows the longest line.
+	void SetCutAtLineEnds(const bool enabled) { mCutAtLineEnds = enabled; }
+
+private:
+
+	const ReadFunction mRead;
+	size_t mBufferSize;
+	std::unique_ptr<char[]> mBuffers[2];
+	size_t mCurrent = 0;
+	size_t mTotalBytes = 0;
+	bool mCutAtLineEnds = false;
+	std::future<size_t> mPendingFill;
+
+	void startFill(const size_t bufferIndex, const size_t offset)
+	{
+		mPendingFill = std::async(std::launch::async, [this, bufferIndex, offset]()
+		{
+			return fill(mBuffers[bufferIndex].get(), offset);
+		});
+	}
+
+	// Only while no fill is pending. The current buffer keeps its bytes.
+	void growBuffers()
+	{
+		const size_t bufferSize = mBufferSize * 2;
+		for (size_t i = 0; i < 2; ++i)
+		{
+			auto buffer = std::make_unique<char[]>(bufferSize);
+			if (i == mCurrent)
+			{
+				std::memcpy(buffer.get(), mBuffers[i].get(), mBufferSize);
+			}
+			mBuffers[i] = std::move(buffer);
+		}
+		mBufferSize = bufferSize;
+	}
+
+	// Reads until the buffer is full or the source ends, returns the bytes in the buffer.
+	size_t fill(char* buffer, size_t filled) const
+	{
+		while (filled < mBufferSize)
+		{
+			const size_t bytesRead = mRead(buffer + filled, mBufferSize - filled);
+			if (bytesRead == 0)
+			{
+				break;
+			}
+
+			filled += bytesRead;
+		}
+
+		return filled;
+	}
+
+	static size_t readDescriptor(const int fd, char* buffer, const size_t size)
+	{
+		for (;;)
+		{
+#ifdef _WIN32
+			const int bytesRead = _read(fd, buffer, static_cast<unsigned int>(std::min<size_t>(size, 1u << 30)));
+#else
+			const ssize_t bytesRead = ::read(fd, buffer, size);
+			if (bytesRead < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (bytesRead < 0)
+			{
+				throw std::runtime_error("Failed to read from stream: " + std::string(std::strerror(errno)));
+			}
+
+			return static_cast<size_t>(bytesRead);
+		}
+	}
+
+	// A full buffer is cut at its last split point (see PreTokenizer::IsSplitPoint), the text on both
+	// sides pretokenizes as it would in one piece. Only text without any split point in a whole buffer
+	// (e.g. long runs of CJK) is cut at a character boundary.
+	static size_t findCut(const char* block, const size_t size, const bool atLineEnd)
+	{
+		for (size_t i = size; i-- > 1; )
+		{
+			if (atLineEnd ? block[i - 1] == '\n' : PreTokenizer::IsSplitPoint(block, i))
+			{
+				return i;
+			}
+		}
+
+		// Step back over continuation bytes to the start of the last character.
+		size_t cut = size - 1;
+		while (cut > 0 && (static_cast<unsigned char>(block[cut]) & 0xC0) == 0x80)
+		{
+			--cut;
+		}
+		return cut > 0 ? cut : size;
+	}
+};
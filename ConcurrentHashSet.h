@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Set of 64-bit hashes shared by many threads, used to find repeated lines and documents.
+// The top bits of a hash pick one of ShardCount shards, each an open addressing table behind its own
+// lock, so threads rarely wait for each other. Only hashes are stored: 8 bytes per distinct entry,
+// and two different texts collide with a probability around n^2 / 2^65 for n entries.
+class ConcurrentHashSet
+{
+public:
+
+	static constexpr uint32_t ShardBits = 8;
+	static constexpr uint32_t ShardCount = 1u << ShardBits;
+
+	ConcurrentHashSet()
+		: mShards(ShardCount)
+	{
+	}
+
+	ConcurrentHashSet(const ConcurrentHashSet&) = delete;
+	ConcurrentHashSet& operator=(const ConcurrentHashSet&) = delete;
+
+	// Returns true if hash was not in the set yet.
+	bool Insert(uint64_t hash)
+	{
+		hash = hash != 0 ? hash : 1; // 0 marks empty slots
+
+		Shard& shard = mShards[hash >> (64 - ShardBits)];
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+
+		if (shard.Size >= shard.Slots.size() * MaxLoadNumerator / MaxLoadDenominator)
+		{
+			grow(shard);
+		}
+
+		const size_t mask = shard.Slots.size() - 1;
+		for (size_t index = hash & mask; ; index = (index + 1) & mask)
+		{
+			uint64_t& slot = shard.Slots[index];
+			if (slot == hash)
+			{
+				return false;
+			}
+
+			if (slot == 0)
+			{
+				slot = hash;
+				++shard.Size;
+				return true;
+			}
+		}
+	}
+
+	size_t size() const
+	{
+		size_t total = 0;
+		for (const Shard& shard : mShards)
+		{
+			total += shard.Size;
+		}
+		return total;
+	}
+
+private:
+
+	static constexpr size_t MinShardCapacity = 1024;
+	static constexpr size_t MaxLoadNumerator = 3;
+	static constexpr size_t MaxLoadDenominator = 4;
+
+	// Own cache lines, so threads locking neighbour shards do not share one.
+	struct alignas(64) Shard
+	{
+		std::mutex Mutex;
+		std::vector<uint64_t> Slots;
+		size_t Size = 0;
+	};
+
+	std::vector<Shard> mShards;
+
+	static void grow(Shard& shard)
+	{
+		std::vector<uint64_t> slots(shard.Slots.empty() ? MinShardCapacity : shard.Slots.size() * 2);
+		const size_t mask = slots.size() - 1;
+
+		for (const uint64_t hash : shard.Slots)
+		{
+			if (hash == 0)
+			{
+				continue;
+			}
+
+			size_t index = hash & mask;
+			while (slots[index] != 0)
+			{
+				index = (index + 1) & mask;
+			}
+			slots[index] = hash;
+		}
+
+		shard.Slots = std::move(slots);
+	}
+};
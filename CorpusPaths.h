@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Expands the inputs of a corpus to a list of files. An input is a file, a directory (all regular
+// files below it) or a file name pattern with '*' and '?' wildcards in its last component.
+// Files of a directory or pattern are sorted, so a corpus is always read in the same order.
+namespace CorpusPaths
+{
+	inline bool HasWildcard(const std::string_view path)
+	{
+		return path.find_first_of("*?") != std::string_view::npos;
+	}
+
+	// '*' matches any run of characters, '?' a single character.
+	inline bool MatchWildcard(const std::string_view pattern, const std::string_view name)
+	{
+		size_t p = 0, n = 0;
+		size_t starPattern = std::string_view::npos, starName = 0;
+
+		while (n < name.size())
+		{
+			if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+			{
+				++p;
+				++n;
+			}
+			else if (p < pattern.size() && pattern[p] == '*')
+			{
+				starPattern = p++;
+				starName = n;
+			}
+			else if (starPattern != std::string_view::npos)
+			{
+				// Let the last star take one more character
+				p = starPattern + 1;
+				n = ++starName;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		while (p < pattern.size() && pattern[p] == '*')
+		{
+			++p;
+		}
+
+		return p == pattern.size();
+	}
+
+	inline std::vector<std::string> Expand(const std::vector<std::string>& inputs)
+	{
+		namespace fs = std::filesystem;
+
+		std::vector<std::string> files;
+		for (const auto& input : inputs)
+		{
+			std::vector<std::string> expanded;
+
+			if (HasWildcard(input))
+			{
+				const fs::path pattern(input);
+				const fs::path directory = pattern.has_parent_path() ? pattern.parent_path() : fs::path(".");
+				if (HasWildcard(directory.string()))
+				{
+					throw std::runtime_error("Wildcards are supported in file names only: " + input);
+				}
+
+				const std::string namePattern = pattern.filename().string();
+				for (const auto& entry : fs::directory_iterator(directory))
+				{
+					if (entry.is_regular_file() && MatchWildcard(namePattern, entry.path().filename().string()))
+					{
+						expanded.push_back(entry.path().string());
+					}
+				}
+
+				if (expanded.empty())
+				{
+					throw std::runtime_error("No file matches '" + input + "'");
+				}
+			}
+			else if (fs::is_directory(input))
+			{
+				for (const auto& entry : fs::recursive_directory_iterator(input))
+				{
+					if (entry.is_regular_file())
+					{
+						expanded.push_back(entry.path().string());
+					}
+				}
+			}
+			else
+			{
+				files.push_back(input);
+				continue;
+			}
+
+			std::sort(expanded.begin(), expanded.end());
+			files.insert(files.end(), expanded.begin(), expanded.end());
+		}
+
+		return files;
+	}
+}
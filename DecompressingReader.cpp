@@ -0,0 +1,442 @@
+#include "DecompressingReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef SHARIF_BPE_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef SHARIF_BPE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Decodes a range of compressed bytes, concatenated members or frames give one stream of text.
+struct DecompressingReader::Decoder
+{
+	virtual ~Decoder() = default;
+
+	// Returns the bytes written to buffer, 0 at the end of the input.
+	virtual size_t Decode(char* buffer, size_t size) = 0;
+};
+
+namespace
+{
+	constexpr unsigned char GzipMagic[] = { 0x1F, 0x8B };
+	constexpr unsigned char ZstdMagic[] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+	bool hasMagic(const char* data, const size_t size, const unsigned char* magic, const size_t magicSize)
+	{
+		return size >= magicSize && std::memcmp(data, magic, magicSize) == 0;
+	}
+
+	// BGZF (bgzip, htslib) stores the size of each gzip member in a 'BC' extra field.
+	// Returns 0 when the member at data has no such field.
+	size_t bgzfMemberSize(const unsigned char* data, const size_t size)
+	{
+		constexpr size_t HeaderSize = 12;
+		constexpr unsigned char ExtraFieldFlag = 0x04;
+
+		if (size < HeaderSize + 6 || data[0] != 0x1F || data[1] != 0x8B || data[2] != 8 || !(data[3] & ExtraFieldFlag))
+		{
+			return 0;
+		}
+
+		const size_t extraLength = data[10] | (data[11] << 8);
+		if (size < HeaderSize + extraLength)
+		{
+			return 0;
+		}
+
+		for (size_t field = HeaderSize; field + 4 <= HeaderSize + extraLength; )
+		{
+			const size_t fieldLength = data[field + 2] | (data[field + 3] << 8);
+			if (data[field] == 'B' && data[field + 1] == 'C' && fieldLength == 2 && field + 6 <= HeaderSize + extraLength)
+			{
+				const size_t memberSize = (data[field + 4] | (data[field + 5] << 8)) + 1;
+				return memberSize <= size ? memberSize : 0;
+			}
+			field += 4 + fieldLength;
+		}
+
+		return 0;
+	}
+
+#ifdef SHARIF_BPE_WITH_ZLIB
+
+	class GzipDecoder : public DecompressingReader::Decoder
+	{
+	public:
+
+		GzipDecoder(const char* data, const size_t size)
+			: mInput(reinterpret_cast<const unsigned char*>(data))
+			, mRemaining(size)
+		{
+			// 16 + window bits: gzip header and trailer
+			if (inflateInit2(&mStream, 16 + MAX_WBITS) != Z_OK)
+			{
+				throw std::runtime_error("Failed to initialize zlib.");
+			}
+		}
+
+		~GzipDecoder() override
+		{
+			inflateEnd(&mStream);
+		}
+
+		size_t Decode(char* buffer, const size_t size) override
+		{
+			mStream.next_out = reinterpret_cast<unsigned char*>(buffer);
+			mStream.avail_out = static_cast<uInt>(std::min<size_t>(size, MaxStep));
+
+			while (mStream.avail_out > 0 && !mFinished)
+			{
+				if (mStream.avail_in == 0)
+				{
+					if (mRemaining == 0)
+					{
+						throw std::runtime_error("Truncated gzip data.");
+					}
+					feed();
+				}
+
+				const int result = inflate(&mStream, Z_NO_FLUSH);
+				if (result == Z_STREAM_END)
+				{
+					// Concatenated members (BGZF, pigz, cat a.gz b.gz) continue the text.
+					if (mStream.avail_in == 0 && mRemaining == 0)
+					{
+						mFinished = true;
+					}
+					else
+					{
+						if (mStream.avail_in == 0)
+						{
+							feed();
+						}
+
+						// Anything else than another member is trailing padding, as gzip ignores it.
+						if (mStream.avail_in < 2 || mStream.next_in[0] != GzipMagic[0] || mStream.next_in[1] != GzipMagic[1])
+						{
+							mFinished = true;
+						}
+						else
+						{
+							inflateReset(&mStream);
+						}
+					}
+				}
+				else if (result != Z_OK)
+				{
+					throw std::runtime_error("Corrupt gzip data: " + std::string(mStream.msg ? mStream.msg : zError(result)));
+				}
+			}
+
+			return reinterpret_cast<char*>(mStream.next_out) - buffer;
+		}
+
+	private:
+
+		// zlib counts bytes in 32 bits
+		static constexpr size_t MaxStep = 1u << 30;
+
+		z_stream mStream = {};
+		const unsigned char* mInput;
+		size_t mRemaining;
+		bool mFinished = false;
+
+		void feed()
+		{
+			const size_t step = std::min(mRemaining, MaxStep);
+			mStream.next_in = const_cast<unsigned char*>(mInput);
+			mStream.avail_in = static_cast<uInt>(step);
+			mInput += step;
+			mRemaining -= step;
+		}
+	};
+
+#endif
+
+#ifdef SHARIF_BPE_WITH_ZSTD
+
+	class ZstdDecoder : public DecompressingReader::Decoder
+	{
+	public:
+
+		ZstdDecoder(const char* data, const size_t size)
+			: mContext(ZSTD_createDCtx())
+			, mInput{ data, size, 0 }
+		{
+			if (mContext == nullptr)
+			{
+				throw std::runtime_error("Failed to initialize zstd.");
+			}
+		}
+
+		~ZstdDecoder() override
+		{
+			ZSTD_freeDCtx(mContext);
+		}
+
+		size_t Decode(char* buffer, const size_t size) override
+		{
+			ZSTD_outBuffer output = { buffer, size, 0 };
+
+			// Frames follow each other in the input, the context moves to the next one by itself.
+			while (output.pos < output.size && !(mInput.pos == mInput.size && mFrameEnded))
+			{
+				const size_t inputBefore = mInput.pos;
+				const size_t outputBefore = output.pos;
+
+				const size_t result = ZSTD_decompressStream(mContext, &output, &mInput);
+				if (ZSTD_isError(result))
+				{
+					throw std::runtime_error("Corrupt zstd data: " + std::string(ZSTD_getErrorName(result)));
+				}
+
+				mFrameEnded = result == 0;
+				if (!mFrameEnded && mInput.pos == inputBefore && output.pos == outputBefore)
+				{
+					throw std::runtime_error("Truncated zstd data.");
+				}
+			}
+
+			return output.pos;
+		}
+
+	private:
+
+		ZSTD_DCtx* mContext;
+		ZSTD_inBuffer mInput;
+		bool mFrameEnded = true;
+	};
+
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DecompressingReader::Format DecompressingReader::Detect(const void* data, const size_t size)
+{
+	const char* bytes = static_cast<const char*>(data);
+
+	if (hasMagic(bytes, size, GzipMagic, sizeof(GzipMagic)))
+	{
+		return Format::Gzip;
+	}
+
+	if (hasMagic(bytes, size, ZstdMagic, sizeof(ZstdMagic)))
+	{
+		return Format::Zstd;
+	}
+
+	return Format::None;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+bool DecompressingReader::IsSupported(const Format format)
+{
+	switch (format)
+	{
+	case Format::None:
+		return true;
+	case Format::Gzip:
+#ifdef SHARIF_BPE_WITH_ZLIB
+		return true;
+#else
+		return false;
+#endif
+	case Format::Zstd:
+#ifdef SHARIF_BPE_WITH_ZSTD
+		return true;
+#else
+		return false;
+#endif
+	}
+	return false;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DecompressingReader::DecompressingReader(const void* data, const size_t size, const uint32_t threadCount)
+	: mData(static_cast<const char*>(data))
+	, mSize(size)
+	, mFormat(Detect(data, size))
+	, mThreadCount(std::max<uint32_t>(threadCount, 1))
+{
+	if (mFormat == Format::None)
+	{
+		throw std::runtime_error("Data is neither gzip nor zstd compressed.");
+	}
+
+	if (!IsSupported(mFormat))
+	{
+		throw std::runtime_error(std::string("SharifBPE was built without ") + (mFormat == Format::Gzip ? "zlib" : "zstd") + " support.");
+	}
+
+	if (mThreadCount > 1)
+	{
+		mChunks = findChunks();
+	}
+
+	// A single chunk gains nothing from the worker threads.
+	if (mChunks.size() > 1)
+	{
+		scheduleChunks();
+	}
+	else
+	{
+		mChunks.clear();
+		mDecoder = makeDecoder(mFormat, mData, mSize);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+DecompressingReader::~DecompressingReader()
+{
+	for (auto& pendingChunk : mPendingChunks)
+	{
+		pendingChunk.wait();
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t DecompressingReader::Read(char* buffer, const size_t size)
+{
+	if (mDecoder)
+	{
+		return mDecoder->Decode(buffer, size);
+	}
+
+	size_t copied = 0;
+	while (copied < size)
+	{
+		if (mCurrentOffset == mCurrentChunk.size())
+		{
+			if (mPendingChunks.empty())
+			{
+				break;
+			}
+
+			mCurrentChunk = mPendingChunks.front().get();
+			mCurrentOffset = 0;
+			mPendingChunks.pop_front();
+			scheduleChunks();
+			continue;
+		}
+
+		const size_t length = std::min(size - copied, mCurrentChunk.size() - mCurrentOffset);
+		std::memcpy(buffer + copied, mCurrentChunk.data() + mCurrentOffset, length);
+		mCurrentOffset += length;
+		copied += length;
+	}
+
+	return copied;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Splits the file at frame boundaries, returns nothing when the frames can not be found without decoding.
+std::vector<DecompressingReader::Chunk> DecompressingReader::findChunks() const
+{
+	std::vector<Chunk> chunks;
+	size_t chunkBegin = 0;
+
+	for (size_t offset = 0; offset < mSize; )
+	{
+		size_t frameSize = 0;
+		if (mFormat == Format::Gzip)
+		{
+			frameSize = bgzfMemberSize(reinterpret_cast<const unsigned char*>(mData) + offset, mSize - offset);
+		}
+#ifdef SHARIF_BPE_WITH_ZSTD
+		else if (mFormat == Format::Zstd)
+		{
+			frameSize = ZSTD_findFrameCompressedSize(mData + offset, mSize - offset);
+			if (ZSTD_isError(frameSize))
+			{
+				frameSize = 0;
+			}
+		}
+#endif
+
+		if (frameSize == 0)
+		{
+			return {};
+		}
+
+		offset += frameSize;
+		if (offset - chunkBegin >= ChunkLength || offset == mSize)
+		{
+			chunks.push_back({ chunkBegin, offset });
+			chunkBegin = offset;
+		}
+	}
+
+	return chunks;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void DecompressingReader::scheduleChunks()
+{
+	while (mNextChunk < mChunks.size() && mPendingChunks.size() < mThreadCount * ChunksPerThread)
+	{
+		const Chunk chunk = mChunks[mNextChunk++];
+		mPendingChunks.push_back(std::async(std::launch::async, &DecompressingReader::decodeChunk, mFormat, mData + chunk.Begin, chunk.End - chunk.Begin));
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::unique_ptr<DecompressingReader::Decoder> DecompressingReader::makeDecoder(const Format format, const char* data, const size_t size)
+{
+#ifdef SHARIF_BPE_WITH_ZLIB
+	if (format == Format::Gzip)
+	{
+		return std::make_unique<GzipDecoder>(data, size);
+	}
+#endif
+
+#ifdef SHARIF_BPE_WITH_ZSTD
+	if (format == Format::Zstd)
+	{
+		return std::make_unique<ZstdDecoder>(data, size);
+	}
+#endif
+
+	throw std::runtime_error("Unsupported compression format.");
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::string DecompressingReader::decodeChunk(const Format format, const char* data, const size_t size)
+{
+	const auto decoder = makeDecoder(format, data, size);
+
+	// Text usually compresses 3 to 4 times, the buffer grows when it does better.
+	std::string text(size * 4, '\0');
+	size_t decoded = 0;
+
+	for (;;)
+	{
+		if (decoded == text.size())
+		{
+			text.resize(text.size() * 2);
+		}
+
+		const size_t length = decoder->Decode(text.data() + decoded, text.size() - decoded);
+		if (length == 0)
+		{
+			break;
+		}
+		decoded += length;
+	}
+
+	text.resize(decoded);
+	return text;
+}
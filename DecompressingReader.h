@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Decompresses a gzip or zstd file held in memory (e.g. mapped) to a stream of text, see Read.
+// Files made of independent frames (BGZF blocks, multi-frame zstd) are decompressed in parallel a few
+// chunks ahead of the reader. Other files are decompressed on the calling thread, which is the background
+// thread of BufferedStreamReader, so decompression still overlaps pretokenization.
+class DecompressingReader
+{
+public:
+
+	enum class Format
+	{
+		None,
+		Gzip,
+		Zstd
+	};
+
+	// Recognizes compressed data by its magic number.
+	static Format Detect(const void* data, const size_t size);
+
+	// zlib and zstd are optional dependencies, see CMakeLists.txt.
+	static bool IsSupported(const Format format);
+
+	DecompressingReader(const void* data, const size_t size, const uint32_t threadCount);
+	~DecompressingReader();
+
+	DecompressingReader(const DecompressingReader&) = delete;
+	DecompressingReader& operator=(const DecompressingReader&) = delete;
+
+	// Copies the next decompressed bytes to buffer, returns 0 at the end of the data.
+	size_t Read(char* buffer, const size_t size);
+
+	bool IsParallel() const { return !mChunks.empty(); }
+
+	// Streaming decompressor of one format, implemented in DecompressingReader.cpp.
+	struct Decoder;
+
+private:
+
+	// Consecutive frames are grouped until they hold this many compressed bytes.
+	static constexpr size_t ChunkLength = 1 << 20;
+	static constexpr uint32_t ChunksPerThread = 2;
+
+	struct Chunk
+	{
+		size_t Begin;
+		size_t End;
+	};
+
+	const char* mData;
+	const size_t mSize;
+	const Format mFormat;
+	const uint32_t mThreadCount;
+
+	// Parallel mode: chunks are decompressed in order of the file, at most mThreadCount * ChunksPerThread at a time.
+	std::vector<Chunk> mChunks;
+	size_t mNextChunk = 0;
+	std::deque<std::future<std::string>> mPendingChunks;
+	std::string mCurrentChunk;
+	size_t mCurrentOffset = 0;
+
+	// Serial mode
+	std::unique_ptr<Decoder> mDecoder;
+
+	std::vector<Chunk> findChunks() const;
+
+	void scheduleChunks();
+
+	static std::unique_ptr<Decoder> makeDecoder(const Format format, const char* data, const size_t size);
+
+	static std::string decodeChunk(const Format format, const char* data, const size_t size);
+};
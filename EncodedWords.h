@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Tokens of a batch of words in one buffer: the tokens of word i are Ids[Offsets[i], Offsets[i + 1]).
+// Encoding appends to Ids, so a batch costs a few reallocations of two vectors instead of one vector
+// per word, and reusing the object for the next batch costs none.
+struct EncodedWords
+{
+	std::vector<uint32_t> Ids;
+	std::vector<size_t> Offsets = { 0 };
+
+	size_t size() const { return Offsets.size() - 1; }
+	bool empty() const { return size() == 0; }
+
+	std::span<const uint32_t> operator[](const size_t word) const
+	{
+		return { Ids.data() + Offsets[word], Offsets[word + 1] - Offsets[word] };
+	}
+
+	// Keeps the memory for the next batch.
+	void clear()
+	{
+		Ids.clear();
+		Offsets.assign(1, 0);
+	}
+
+	// Ends the current word, its tokens are the ids appended since the last call.
+	void EndWord() { Offsets.push_back(Ids.size()); }
+
+	void Append(const EncodedWords& other)
+	{
+		const size_t shift = Ids.size();
+		Ids.insert(Ids.end(), other.Ids.begin(), other.Ids.end());
+		for (size_t word = 1; word < other.Offsets.size(); ++word)
+		{
+			Offsets.push_back(other.Offsets[word] + shift);
+		}
+	}
+};
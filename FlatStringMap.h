@@ -0,0 +1,293 @@
+#pragma once
+
+#include "StringHasher.h"
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Open addressing hash map from strings to small values, used for word counting.
+// Slots are stored in one flat array with the full 64-bit hash cached next to the key, probing is
+// linear and compares hashes before touching key bytes, growing never rehashes a key.
+// Keys are not owned by default (they point into a mapped file or caller strings), with
+// KeyStorage::Interned they are copied into a chunked arena owned by the map, so pointers stay
+// valid while the map grows or is moved.
+template<typename ValueType>
+class FlatStringMap
+{
+public:
+
+	enum class KeyStorage
+	{
+		External,
+		Interned
+	};
+
+	struct Slot
+	{
+		uint64_t Hash = 0; // Zero marks an empty slot
+		const char* Key = nullptr;
+		uint32_t KeySize = 0;
+		ValueType Value{};
+	};
+
+	class const_iterator
+	{
+	public:
+
+		using value_type = std::pair<std::string_view, const ValueType&>;
+
+		const_iterator(const Slot* slot, const Slot* end)
+			: mSlot(slot), mEnd(end)
+		{
+			skipEmpty();
+		}
+
+		value_type operator*() const
+		{
+			return { std::string_view(mSlot->Key, mSlot->KeySize), mSlot->Value };
+		}
+
+		uint64_t Hash() const { return mSlot->Hash; }
+
+		const_iterator& operator++()
+		{
+			++mSlot;
+			skipEmpty();
+			return *this;
+		}
+
+		bool operator==(const const_iterator& other) const { return mSlot == other.mSlot; }
+		bool operator!=(const const_iterator& other) const { return mSlot != other.mSlot; }
+
+	private:
+
+		const Slot* mSlot;
+		const Slot* mEnd;
+
+		void skipEmpty()
+		{
+			while (mSlot != mEnd && mSlot->Hash == 0)
+			{
+				++mSlot;
+			}
+		}
+	};
+
+	explicit FlatStringMap(const KeyStorage keyStorage = KeyStorage::External)
+		: mInternKeys(keyStorage == KeyStorage::Interned)
+	{
+	}
+
+	// Never returns zero, so the result can be passed to FindOrInsert.
+	static uint64_t Hash(const std::string_view key)
+	{
+		const uint64_t hash = StringHash::Hash(key.data(), key.size());
+		return hash != 0 ? hash : 1;
+	}
+
+	ValueType& operator[](const std::string_view key)
+	{
+		return FindOrInsert(key, Hash(key));
+	}
+
+	// Same as operator[] for callers that already computed Hash(key), e.g. to pick a partition.
+	ValueType& FindOrInsert(const std::string_view key, const uint64_t hash)
+	{
+		if (mSize >= mGrowAt)
+		{
+			grow();
+		}
+
+		Slot& slot = mSlots[probe(key.data(), key.size(), hash)];
+		if (slot.Hash == 0)
+		{
+			slot.Hash = hash;
+			slot.Key = mInternKeys ? intern(key) : key.data();
+			slot.KeySize = static_cast<uint32_t>(key.size());
+			++mSize;
+		}
+
+		return slot.Value;
+	}
+
+	const ValueType* Find(const std::string_view key) const
+	{
+		if (mSize == 0)
+		{
+			return nullptr;
+		}
+
+		const Slot& slot = mSlots[probe(key.data(), key.size(), Hash(key))];
+		return slot.Hash != 0 ? &slot.Value : nullptr;
+	}
+
+	// Adds the values of other to this map. Cached hashes are reused, key bytes are compared only
+	// on hash equality. Interned keys of other are taken over, so other can be destroyed afterwards.
+	void Merge(FlatStringMap&& other)
+	{
+		if (mSize == 0)
+		{
+			const bool internKeys = mInternKeys;
+			*this = std::move(other);
+			mInternKeys = internKeys;
+			other.clear();
+			return;
+		}
+
+		mArena.insert(mArena.end(),
+			std::make_move_iterator(other.mArena.begin()),
+			std::make_move_iterator(other.mArena.end()));
+
+		for (const Slot& otherSlot : other.mSlots)
+		{
+			if (otherSlot.Hash == 0)
+			{
+				continue;
+			}
+
+			if (mSize >= mGrowAt)
+			{
+				grow();
+			}
+
+			Slot& slot = mSlots[probe(otherSlot.Key, otherSlot.KeySize, otherSlot.Hash)];
+			if (slot.Hash == 0)
+			{
+				slot = otherSlot;
+				++mSize;
+			}
+			else
+			{
+				slot.Value += otherSlot.Value;
+			}
+		}
+
+		other.clear();
+	}
+
+	void reserve(const size_t count)
+	{
+		size_t capacity = MinCapacity;
+		while (capacity * MaxLoadNumerator / MaxLoadDenominator < count)
+		{
+			capacity *= 2;
+		}
+
+		if (capacity > mSlots.size())
+		{
+			rehash(capacity);
+		}
+	}
+
+	void clear()
+	{
+		std::vector<Slot>().swap(mSlots);
+		mArena.clear();
+		mArenaCursor = nullptr;
+		mArenaRemaining = 0;
+		mSize = 0;
+		mMask = 0;
+		mGrowAt = 0;
+	}
+
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+	size_t capacity() const { return mSlots.size(); }
+
+	const_iterator begin() const { return const_iterator(mSlots.data(), mSlots.data() + mSlots.size()); }
+	const_iterator end() const { return const_iterator(mSlots.data() + mSlots.size(), mSlots.data() + mSlots.size()); }
+
+private:
+
+	static constexpr size_t MinCapacity = 16;
+	static constexpr size_t MaxLoadNumerator = 3;
+	static constexpr size_t MaxLoadDenominator = 4;
+	static constexpr size_t ArenaBlockSize = 1 << 20;
+
+	std::vector<Slot> mSlots;
+	size_t mSize = 0;
+	size_t mMask = 0;
+	size_t mGrowAt = 0;
+
+	bool mInternKeys = false;
+	std::vector<std::unique_ptr<char[]>> mArena;
+	char* mArenaCursor = nullptr;
+	size_t mArenaRemaining = 0;
+
+	// Returns the index of the slot holding key, or of the empty slot where it should be inserted.
+	size_t probe(const char* key, const size_t keySize, const uint64_t hash) const
+	{
+		for (size_t index = hash & mMask; ; index = (index + 1) & mMask)
+		{
+			const Slot& slot = mSlots[index];
+			if (slot.Hash == 0)
+			{
+				return index;
+			}
+
+			if (slot.Hash == hash && slot.KeySize == keySize && std::memcmp(slot.Key, key, keySize) == 0)
+			{
+				return index;
+			}
+		}
+	}
+
+	void grow()
+	{
+		rehash(mSlots.empty() ? MinCapacity : mSlots.size() * 2);
+	}
+
+	void rehash(const size_t capacity)
+	{
+		std::vector<Slot> oldSlots(capacity);
+		oldSlots.swap(mSlots);
+		mMask = capacity - 1;
+		mGrowAt = capacity * MaxLoadNumerator / MaxLoadDenominator;
+
+		// Keys are unique, only an empty slot has to be found.
+		for (const Slot& slot : oldSlots)
+		{
+			if (slot.Hash == 0)
+			{
+				continue;
+			}
+
+			size_t index = slot.Hash & mMask;
+			while (mSlots[index].Hash != 0)
+			{
+				index = (index + 1) & mMask;
+			}
+			mSlots[index] = slot;
+		}
+	}
+
+	const char* intern(const std::string_view key)
+	{
+		if (key.size() > mArenaRemaining)
+		{
+			const size_t blockSize = key.size() > ArenaBlockSize / 4 ? key.size() : ArenaBlockSize;
+			auto& block = mArena.emplace_back(new char[blockSize]);
+			if (blockSize != ArenaBlockSize)
+			{
+				// Dedicated block for a huge key, keep filling the current one.
+				std::memcpy(block.get(), key.data(), key.size());
+				return block.get();
+			}
+
+			mArenaCursor = block.get();
+			mArenaRemaining = blockSize;
+		}
+
+		char* stored = mArenaCursor;
+		std::memcpy(stored, key.data(), key.size());
+		mArenaCursor += key.size();
+		mArenaRemaining -= key.size();
+		return stored;
+	}
+};
+
+using FlatStringCountMap = FlatStringMap<uint32_t>;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "WindowedFile.h"
+
+#include <cstdint>
+#include <string>
+
+// How the learner and the tokenizer read their input files and streams.
+struct InputOptions
+{
+	enum class Format
+	{
+		Text,  // Plain UTF-8 text
+		Jsonl  // One JSON object per line, the document is the string field JsonField
+	};
+
+	Format InputFormat = Format::Text;
+
+	// Lines without this field, or where it is not a string, are skipped.
+	std::string JsonField = "text";
+
+	enum class Deduplication
+	{
+		None,
+		Lines,     // Drop lines seen before (of the documents for JSONL), blank lines are always kept
+		Documents  // Drop JSONL documents seen before, same as Lines for plain text
+	};
+
+	// Exact repeats are dropped before pretokenization when words are counted for learning.
+	// The tokenizer ignores this, every document is encoded.
+	Deduplication Dedup = Deduplication::None;
+
+	// Sampling for quick learner iterations: only a seeded, deterministic subset of the line aligned
+	// sections is read, SampleFraction of the bytes and at most SampleBytes (0 for no limit).
+	// The tokenizer ignores this.
+	double SampleFraction = 1.0;
+	uint64_t SampleBytes = 0;
+	uint64_t SampleSeed = 0;
+
+	// Page cache hints for mapped input files, see MemoryMappedFile. All off by default.
+	bool PrefaultPages = false;   // Read whole files in when they are mapped (MAP_POPULATE)
+	bool AdviseSections = false;  // Sequential read ahead of each section as a thread takes it
+	bool HugePages = false;       // Transparent huge pages, where the filesystem allows them
+	bool ReleaseSections = false; // Drop the pages of each section once read. The learner copies its
+	                              // words then; the tokenizer ignores this, its words point into the file.
+
+	// How input files are read. Mmap maps whole files, unless WindowBytes is set. Pread and DirectIO read
+	// windows into buffers, for storage where page faults are slow or the page cache must be left alone.
+	WindowedFile::Backend ReadBackend = WindowedFile::Backend::Mmap;
+
+	// Learner only: read files in windows of at most this many bytes, a few per thread, instead of
+	// whole files. 0 maps whole files with Mmap and uses DefaultWindowBytes with the other backends.
+	uint64_t WindowBytes = 0;
+
+	static constexpr uint64_t DefaultWindowBytes = 16 << 20;
+
+	// Learner only: read small files in batches through io_uring first, see UringFileReader. Larger and
+	// compressed files are mapped as usual, as are all files where io_uring is not available. Ignored
+	// when sampling or reading in windows.
+	bool UseIoUring = false;
+
+	bool IsWindowed() const { return WindowBytes != 0 || ReadBackend != WindowedFile::Backend::Mmap; }
+
+	bool IsSampling() const { return SampleFraction < 1.0 || SampleBytes != 0; }
+
+	bool IsJsonl() const { return InputFormat == Format::Jsonl; }
+};
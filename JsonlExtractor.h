@@ -0,0 +1,331 @@
+#pragma once
+
+#include "UnicodeTables.h" // SHARIF_BPE_SSE2
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Extracts one string field from JSON Lines documents, e.g. {"id": 7, "text": "..."}.
+// Only what is needed to find a top-level field is parsed: other values are skipped without being
+// decoded, and runs of plain characters in strings are found 16 bytes at a time with SSE2.
+namespace Jsonl
+{
+	// Returns the first '"' or '\\' in [pos, end), end if there is none.
+	inline const char* FindQuoteOrEscape(const char* pos, const char* end)
+	{
+#if SHARIF_BPE_SSE2
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i backslash = _mm_set1_epi8('\\');
+
+		while (end - pos >= 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+			const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, backslash));
+			const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+			if (mask != 0)
+			{
+				return pos + std::countr_zero(mask);
+			}
+			pos += 16;
+		}
+#else
+		// Bytes equal to '"' or '\\' become zero, a zero byte sets its high bit in the test below.
+		constexpr uint64_t Ones = 0x0101010101010101ull;
+		constexpr uint64_t Highs = 0x8080808080808080ull;
+
+		while (end - pos >= 8)
+		{
+			uint64_t bytes;
+			std::memcpy(&bytes, pos, sizeof(bytes));
+			const uint64_t quotes = bytes ^ (Ones * '"');
+			const uint64_t backslashes = bytes ^ (Ones * '\\');
+			if ((((quotes - Ones) & ~quotes) | ((backslashes - Ones) & ~backslashes)) & Highs)
+			{
+				break;
+			}
+			pos += 8;
+		}
+#endif
+		while (pos < end && *pos != '"' && *pos != '\\')
+		{
+			++pos;
+		}
+		return pos;
+	}
+
+	inline const char* SkipSpace(const char* pos, const char* end)
+	{
+		while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n'))
+		{
+			++pos;
+		}
+		return pos;
+	}
+
+	inline void AppendUTF8(const uint32_t codePoint, std::string& out)
+	{
+		if (codePoint < 0x80)
+		{
+			out += static_cast<char>(codePoint);
+		}
+		else if (codePoint < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (codePoint >> 6));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			out += static_cast<char>(0xE0 | (codePoint >> 12));
+			out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xF0 | (codePoint >> 18));
+			out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	// Reads the 4 hex digits of a \u escape, returns false if they are not hex.
+	inline bool ParseHex4(const char* pos, const char* end, uint32_t& outValue)
+	{
+		if (end - pos < 4)
+		{
+			return false;
+		}
+
+		outValue = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			const char c = pos[i];
+			uint32_t digit;
+			if (c >= '0' && c <= '9') digit = c - '0';
+			else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+			else return false;
+			outValue = (outValue << 4) | digit;
+		}
+		return true;
+	}
+
+	// Parses a string from after its opening quote. The unescaped text is appended to out unless it is
+	// null. Returns the position after the closing quote, nullptr for a malformed string.
+	// Unpaired surrogates decode to U+FFFD, as in most JSON libraries.
+	inline const char* ParseString(const char* pos, const char* end, std::string* out)
+	{
+		constexpr uint32_t ReplacementCharacter = 0xFFFD;
+
+		for (;;)
+		{
+			const char* special = FindQuoteOrEscape(pos, end);
+			if (out)
+			{
+				out->append(pos, special);
+			}
+
+			if (special == end)
+			{
+				return nullptr;
+			}
+
+			if (*special == '"')
+			{
+				return special + 1;
+			}
+
+			pos = special + 1;
+			if (pos == end)
+			{
+				return nullptr;
+			}
+
+			char unescaped;
+			switch (*pos++)
+			{
+			case '"': unescaped = '"'; break;
+			case '\\': unescaped = '\\'; break;
+			case '/': unescaped = '/'; break;
+			case 'b': unescaped = '\b'; break;
+			case 'f': unescaped = '\f'; break;
+			case 'n': unescaped = '\n'; break;
+			case 'r': unescaped = '\r'; break;
+			case 't': unescaped = '\t'; break;
+			case 'u':
+			{
+				uint32_t codePoint;
+				if (!ParseHex4(pos, end, codePoint))
+				{
+					return nullptr;
+				}
+				pos += 4;
+
+				if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+				{
+					uint32_t low;
+					if (end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u' && ParseHex4(pos + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF)
+					{
+						codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+						pos += 6;
+					}
+					else
+					{
+						codePoint = ReplacementCharacter;
+					}
+				}
+				else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF)
+				{
+					codePoint = ReplacementCharacter;
+				}
+
+				if (out)
+				{
+					AppendUTF8(codePoint, *out);
+				}
+				continue;
+			}
+			default:
+				return nullptr;
+			}
+
+			if (out)
+			{
+				*out += unescaped;
+			}
+		}
+	}
+
+	// Skips any JSON value, returns the position after it or nullptr for malformed input.
+	inline const char* SkipValue(const char* pos, const char* end)
+	{
+		if (pos == end)
+		{
+			return nullptr;
+		}
+
+		if (*pos == '"')
+		{
+			return ParseString(pos + 1, end, nullptr);
+		}
+
+		if (*pos == '{' || *pos == '[')
+		{
+			// Only strings can hide brackets, everything else is counted.
+			size_t depth = 0;
+			while (pos < end)
+			{
+				const char c = *pos;
+				if (c == '"')
+				{
+					pos = ParseString(pos + 1, end, nullptr);
+					if (pos == nullptr)
+					{
+						return nullptr;
+					}
+					continue;
+				}
+
+				++pos;
+				if (c == '{' || c == '[')
+				{
+					++depth;
+				}
+				else if ((c == '}' || c == ']') && --depth == 0)
+				{
+					return pos;
+				}
+			}
+			return nullptr;
+		}
+
+		// Number, true, false or null
+		while (pos < end && *pos != ',' && *pos != '}' && *pos != ']' && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n')
+		{
+			++pos;
+		}
+		return pos;
+	}
+
+	// Appends the unescaped value of the top-level string field of the JSON object in line to outText.
+	// Returns false, leaving outText as it was, when the line is not an object or the field is missing
+	// or not a string.
+	inline bool ExtractField(const std::string_view line, const std::string_view field, std::string& outText)
+	{
+		const char* end = line.data() + line.size();
+		const char* pos = SkipSpace(line.data(), end);
+		if (pos == end || *pos != '{')
+		{
+			return false;
+		}
+
+		std::string escapedKey;
+		for (++pos; ; )
+		{
+			pos = SkipSpace(pos, end);
+			if (pos == end || *pos != '"')
+			{
+				return false;
+			}
+
+			// Keys rarely have escapes, compare them in place when they do not.
+			const char* keyBegin = ++pos;
+			std::string_view key;
+			const char* keyEnd = FindQuoteOrEscape(pos, end);
+			if (keyEnd < end && *keyEnd == '"')
+			{
+				key = std::string_view(keyBegin, keyEnd - keyBegin);
+				pos = keyEnd + 1;
+			}
+			else
+			{
+				escapedKey.clear();
+				pos = ParseString(keyBegin, end, &escapedKey);
+				if (pos == nullptr)
+				{
+					return false;
+				}
+				key = escapedKey;
+			}
+
+			pos = SkipSpace(pos, end);
+			if (pos == end || *pos != ':')
+			{
+				return false;
+			}
+			pos = SkipSpace(pos + 1, end);
+
+			if (key == field)
+			{
+				if (pos == end || *pos != '"')
+				{
+					return false;
+				}
+
+				const size_t previousSize = outText.size();
+				if (ParseString(pos + 1, end, &outText) == nullptr)
+				{
+					outText.resize(previousSize);
+					return false;
+				}
+				return true;
+			}
+
+			pos = SkipValue(pos, end);
+			if (pos == nullptr)
+			{
+				return false;
+			}
+
+			pos = SkipSpace(pos, end);
+			if (pos == end || *pos != ',')
+			{
+				return false; // '}' ends the object without the field
+			}
+			++pos;
+		}
+	}
+}
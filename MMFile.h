@@ -1,6 +1,7 @@
 #include <string>
 #include <stdexcept> // For std::runtime_error
 #include <cstddef>   // For size_t
+#include <cstdint>   // For uintptr_t
 #include <system_error> // For std::system_error (Windows)
 
 // Platform-specific includes and definitions
@@ -13,6 +14,7 @@
 #include <unistd.h>     // For close()
 #include <sys/mman.h>   // For mmap(), munmap()
 #include <sys/stat.h>   // For fstat()
+#include <sys/resource.h> // For getrusage()
 #include <cerrno>       // For errno
 #include <cstring>      // For strerror
 #endif
@@ -20,10 +22,13 @@
 class MemoryMappedFile 
 {
 public:
-	// Constructor: Opens and maps the file
-	MemoryMappedFile(const std::string& filename) 
+	// Constructor: Opens and maps the file.
+	// populate reads the whole file in at once (MAP_POPULATE), instead of one page fault at a time.
+	// hugePages maps at a huge page boundary and asks for transparent huge pages, which the kernel
+	// only gives where the filesystem supports large folios.
+	MemoryMappedFile(const std::string& filename, bool populate = false, bool hugePages = false) 
 	{
-		openAndMap(filename);
+		openAndMap(filename, populate, hugePages);
 	}
 
 	// Destructor: Unmaps and closes the file
@@ -107,6 +112,67 @@ public:
 		return m_data != nullptr;
 	}
 
+	// Page cache hints for a range of a mapping, see madvise(2). Failures are ignored, hints are optional.
+	enum class Advice
+	{
+		Sequential, // Read ahead more, pages behind the reader can be reclaimed early
+		WillNeed,   // Start reading the range in now
+		DontNeed    // Done with the range: drop its page table entries, the page cache may reclaim it
+	};
+
+	static void advise(const void* begin, const void* end, Advice advice)
+	{
+#ifdef _WIN32
+		(void)begin; (void)end; (void)advice;
+#else
+		static const uintptr_t PageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+		// Read hints cover every page touching the range. Released pages must be inside it, the
+		// neighbour sections may still be read.
+		uintptr_t first = reinterpret_cast<uintptr_t>(begin);
+		uintptr_t last = reinterpret_cast<uintptr_t>(end);
+		if (advice == Advice::DontNeed)
+		{
+			first = (first + PageSize - 1) & ~(PageSize - 1);
+			last &= ~(PageSize - 1);
+		}
+		else
+		{
+			first &= ~(PageSize - 1);
+			last = (last + PageSize - 1) & ~(PageSize - 1);
+		}
+
+		if (last <= first)
+		{
+			return;
+		}
+
+		const int flag = advice == Advice::Sequential ? MADV_SEQUENTIAL : advice == Advice::WillNeed ? MADV_WILLNEED : MADV_DONTNEED;
+		madvise(reinterpret_cast<void*>(first), last - first, flag);
+#endif
+	}
+
+	// Page faults taken by the process so far, to measure the hints above. Zero on Windows.
+	struct PageFaults
+	{
+		long minor = 0;
+		long major = 0;
+	};
+
+	static PageFaults pageFaults()
+	{
+		PageFaults faults;
+#ifndef _WIN32
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) == 0)
+		{
+			faults.minor = usage.ru_minflt;
+			faults.major = usage.ru_majflt;
+		}
+#endif
+		return faults;
+	}
+
 private:
 	void* m_data = nullptr;
 	size_t m_size = 0;
@@ -115,7 +181,7 @@ private:
 	HANDLE m_hFile = INVALID_HANDLE_VALUE;
 	HANDLE m_hMapping = NULL;
 
-	void openAndMap(const std::string& filename) 
+	void openAndMap(const std::string& filename, bool /*populate*/, bool /*hugePages*/) 
 	{
 		// 1. Open the file
 		m_hFile = CreateFileA(
@@ -213,7 +279,10 @@ private:
 #else // Linux/POSIX specific members
 	int m_fd = -1; // File descriptor
 
-	void openAndMap(const std::string& filename) 
+	// Transparent huge pages are PMD sized, 2 MB on x86-64 and most ARM64 kernels.
+	static constexpr size_t HugePageSize = size_t(2) << 20;
+
+	void openAndMap(const std::string& filename, bool populate, bool hugePages) 
 	{
 		// 1. Open the file
 		m_fd = open(filename.c_str(), O_RDONLY);
@@ -245,25 +314,86 @@ private:
 
 		m_size = sb.st_size;
 
+		int flags = MAP_SHARED; // Changes are shared, important for read-only too
+#ifdef MAP_POPULATE
+		if (populate)
+		{
+			flags |= MAP_POPULATE;
+		}
+#else
+		(void)populate;
+#endif
+
+		// A huge page can only map a huge page aligned range of addresses, reserve a larger range and
+		// map the file at its first aligned address.
+		void* address = nullptr;
+		void* reserved = MAP_FAILED;
+		const size_t reservedSize = m_size + HugePageSize;
+		if (hugePages && m_size >= HugePageSize)
+		{
+			reserved = mmap(nullptr, reservedSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (reserved != MAP_FAILED)
+			{
+				address = reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(reserved) + HugePageSize - 1) & ~(uintptr_t(HugePageSize) - 1));
+				flags |= MAP_FIXED;
+			}
+		}
+
 		// 3. Map the file into memory
 		m_data = (char *)mmap(
-			nullptr,            // Let the kernel choose the address
+			address,            // Let the kernel choose the address, unless aligned for huge pages
 			m_size,             // Length of the mapping
 			PROT_READ,          // Read permission
-			MAP_SHARED,         // Changes are shared, important for read-only too
+			flags,              // MAP_SHARED and the options above
 			m_fd,               // File descriptor
 			0                   // Offset within the file
 		);
+		int mapError = errno; // Before any other call can change it
+
+		if (reserved != MAP_FAILED)
+		{
+			if (m_data == MAP_FAILED)
+			{
+				// Huge pages are only a hint, map the file wherever the kernel likes instead
+				munmap(reserved, reservedSize);
+				m_data = (char *)mmap(nullptr, m_size, PROT_READ, flags & ~MAP_FIXED, m_fd, 0);
+				mapError = errno;
+			}
+			else
+			{
+				// Give back the reserved pages around the file mapping
+				const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+				const uintptr_t reservedBegin = reinterpret_cast<uintptr_t>(reserved);
+				const uintptr_t reservedEnd = reservedBegin + reservedSize;
+				const uintptr_t mappedBegin = reinterpret_cast<uintptr_t>(m_data);
+				const uintptr_t mappedEnd = (mappedBegin + m_size + pageSize - 1) & ~(pageSize - 1);
+
+				if (mappedBegin > reservedBegin)
+				{
+					munmap(reserved, mappedBegin - reservedBegin);
+				}
+				if (reservedEnd > mappedEnd)
+				{
+					munmap(reinterpret_cast<void*>(mappedEnd), reservedEnd - mappedEnd);
+				}
+			}
+		}
 
 		if (m_data == MAP_FAILED)
 		{
-			int err = errno;
 			close(m_fd);
 			m_fd = -1;
 			m_data = nullptr; // Ensure m_data is null on failure
-			throw std::runtime_error("Failed to map file to memory: " + std::string(strerror(err)));
+			throw std::runtime_error("Failed to map file to memory: " + std::string(strerror(mapError)));
 		}
 
+#ifdef MADV_HUGEPAGE
+		if (hugePages)
+		{
+			madvise(m_data, m_size, MADV_HUGEPAGE); // EINVAL where transparent huge pages are not built in
+		}
+#endif
+
 		// We can close the file descriptor after mmap succeeds (on POSIX)
 		// The mapping keeps a reference to the underlying file description.
 		if (close(m_fd) == -1)
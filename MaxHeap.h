@@ -81,6 +81,23 @@ public:
         bubbleUp(index);
     }
 
+    // Replaces the content with items (pairs must be unique), heapifies in linear time.
+    void Build(std::vector<PairData> items)
+    {
+        mHeap = std::move(items);
+        mPairToIndex.clear();
+        mPairToIndex.reserve(mHeap.size());
+        for (size_t index = 0; index < mHeap.size(); ++index)
+        {
+            mPairToIndex[mHeap[index].Pair] = index;
+        }
+
+        for (size_t index = mHeap.size() / 2; index-- > 0; )
+        {
+            bubbleDown(index);
+        }
+    }
+
     void Pop()
     {
         if (IsEmpty())
@@ -0,0 +1,283 @@
+#pragma once
+
+#include "StringHasher.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Merge rules of a model, from a pair of token ids to the id of the merged token. Built once when the
+// model is read and then only looked up, from all encoding threads at once. Two layouts give the same
+// ranks, SetLayout picks the one used:
+//
+// Hashed: pairs are packed into one 64-bit key, mixed with StringHash::mix and probed linearly in
+// buckets of one cache line, so most lookups, found or not, touch a single line. At most half full.
+//
+// Indexed: pairs of two byte ids, more than half of all lookups, index a dense array of 65536 ranks.
+// The others are grouped by first id with their sorted second ids, so no lookup hashes. Only built
+// when ids are dense, as in any model read from a file.
+class MergeRankTable
+{
+public:
+
+	static constexpr uint32_t NoRank = std::numeric_limits<uint32_t>::max();
+
+	enum class Layout
+	{
+		Hashed,
+		Indexed
+	};
+
+	struct Rule
+	{
+		uint32_t First;
+		uint32_t Second;
+		uint32_t Rank;
+	};
+
+	MergeRankTable() = default;
+
+	// A pair listed twice keeps its last rank, as assignments to a map would. Starts with the hashed layout.
+	void Build(const std::vector<Rule>& rules)
+	{
+		size_t bucketCount = 1;
+		while (bucketCount * SlotsPerBucket < rules.size() * 2)
+		{
+			bucketCount *= 2;
+		}
+
+		mBuckets.reset(new Bucket[bucketCount]);
+		mBucketMask = bucketCount - 1;
+		mSize = 0;
+		mLayout = Layout::Hashed;
+
+		for (const Rule& rule : rules)
+		{
+			insert(packKey(rule.First, rule.Second), rule.Rank);
+		}
+
+		buildIndex();
+	}
+
+	// Rank (merged token id) of the pair, NoRank if it is not merged.
+	uint32_t Find(const uint32_t first, const uint32_t second) const
+	{
+		return mLayout == Layout::Indexed ? findIndexed(first, second) : findHashed(first, second);
+	}
+
+	// Starts loading the memory Find(first, second) reads first, so that looking up the pairs of several
+	// words one after the other overlaps their cache misses.
+	void Prefetch(const uint32_t first, const uint32_t second) const
+	{
+		if (mLayout == Layout::Hashed)
+		{
+			if (mSize != 0)
+			{
+				prefetch(&mBuckets[bucketOf(packKey(first, second))]);
+			}
+		}
+		else if ((first | second) < ByteIds)
+		{
+			prefetch(&mBytePairRanks[(first << 8) | second]);
+		}
+		else if (static_cast<size_t>(first) + 1 < mFirstOffsets.size())
+		{
+			prefetch(&mFirstOffsets[first]);
+		}
+	}
+
+	// Falls back to Hashed if the ids are too sparse to index.
+	void SetLayout(const Layout layout) { mLayout = layout == Layout::Indexed && CanIndex() ? layout : Layout::Hashed; }
+	Layout GetLayout() const { return mLayout; }
+	bool CanIndex() const { return mBytePairRanks != nullptr; }
+
+	size_t size() const { return mSize; }
+	bool empty() const { return mSize == 0; }
+
+private:
+
+	static constexpr uint32_t SlotsPerBucket = 4;
+	static constexpr uint64_t EmptyKey = std::numeric_limits<uint64_t>::max(); // Both ids NoRank, never a rule
+	static constexpr uint32_t ByteIds = 256;
+
+	struct alignas(64) Bucket
+	{
+		uint64_t Keys[SlotsPerBucket] = { EmptyKey, EmptyKey, EmptyKey, EmptyKey };
+		uint32_t Ranks[SlotsPerBucket] = {};
+	};
+
+	Layout mLayout = Layout::Hashed;
+
+	// Hashed
+	std::unique_ptr<Bucket[]> mBuckets;
+	size_t mBucketMask = 0;
+	size_t mSize = 0;
+
+	// Indexed
+	std::unique_ptr<uint32_t[]> mBytePairRanks;
+	std::vector<uint32_t> mFirstOffsets; // Pairs of first id i are [mFirstOffsets[i], mFirstOffsets[i + 1])
+	std::vector<uint32_t> mSeconds;
+	std::vector<uint32_t> mRanks;
+
+	static void prefetch(const void* address)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+		(void)address;
+#endif
+	}
+
+	static uint64_t packKey(const uint32_t first, const uint32_t second)
+	{
+		return (static_cast<uint64_t>(first) << 32) | second;
+	}
+
+	size_t bucketOf(const uint64_t key) const
+	{
+		return static_cast<size_t>(StringHash::mix(key ^ StringHash::Secret[0], StringHash::Secret[1])) & mBucketMask;
+	}
+
+	uint32_t findHashed(const uint32_t first, const uint32_t second) const
+	{
+		if (mSize == 0)
+		{
+			return NoRank;
+		}
+
+		const uint64_t key = packKey(first, second);
+		for (size_t bucket = bucketOf(key); ; bucket = (bucket + 1) & mBucketMask)
+		{
+			const Bucket& slots = mBuckets[bucket];
+			for (uint32_t i = 0; i < SlotsPerBucket; ++i)
+			{
+				if (slots.Keys[i] == EmptyKey)
+				{
+					return NoRank;
+				}
+				if (slots.Keys[i] == key)
+				{
+					return slots.Ranks[i];
+				}
+			}
+		}
+	}
+
+	uint32_t findIndexed(const uint32_t first, const uint32_t second) const
+	{
+		if ((first | second) < ByteIds)
+		{
+			return mBytePairRanks[(first << 8) | second];
+		}
+
+		if (static_cast<size_t>(first) + 1 >= mFirstOffsets.size())
+		{
+			return NoRank;
+		}
+
+		// Lists of common first ids hold a hundred or more second ids. A search without branches on the
+		// data is not slowed down by mispredictions, which dominate a plain binary search here.
+		const uint32_t* base = mSeconds.data() + mFirstOffsets[first];
+		size_t count = mFirstOffsets[first + 1] - mFirstOffsets[first];
+		if (count == 0)
+		{
+			return NoRank;
+		}
+		while (count > 1)
+		{
+			const size_t half = count / 2;
+			base = base[half] <= second ? base + half : base;
+			count -= half;
+		}
+		return *base == second ? mRanks[base - mSeconds.data()] : NoRank;
+	}
+
+	void insert(const uint64_t key, const uint32_t rank)
+	{
+		for (size_t bucket = bucketOf(key); ; bucket = (bucket + 1) & mBucketMask)
+		{
+			Bucket& slots = mBuckets[bucket];
+			for (uint32_t i = 0; i < SlotsPerBucket; ++i)
+			{
+				if (slots.Keys[i] == key)
+				{
+					slots.Ranks[i] = rank;
+					return;
+				}
+				if (slots.Keys[i] == EmptyKey)
+				{
+					slots.Keys[i] = key;
+					slots.Ranks[i] = rank;
+					++mSize;
+					return;
+				}
+			}
+		}
+	}
+
+	// Built from the hashed pairs, where repeated rules are already resolved.
+	void buildIndex()
+	{
+		mBytePairRanks.reset();
+		mFirstOffsets.clear();
+		mSeconds.clear();
+		mRanks.clear();
+
+		std::vector<std::pair<uint64_t, uint32_t>> pairs;
+		pairs.reserve(mSize);
+		uint64_t maxFirst = 0;
+		for (size_t bucket = 0; mSize != 0 && bucket <= mBucketMask; ++bucket)
+		{
+			for (uint32_t i = 0; i < SlotsPerBucket; ++i)
+			{
+				if (mBuckets[bucket].Keys[i] != EmptyKey)
+				{
+					pairs.emplace_back(mBuckets[bucket].Keys[i], mBuckets[bucket].Ranks[i]);
+					maxFirst = std::max(maxFirst, mBuckets[bucket].Keys[i] >> 32);
+				}
+			}
+		}
+
+		// Offsets of sparse ids would take more memory than the rules
+		if (maxFirst >= 4 * (mSize + ByteIds))
+		{
+			return;
+		}
+
+		std::sort(pairs.begin(), pairs.end());
+
+		mBytePairRanks.reset(new uint32_t[ByteIds * ByteIds]);
+		std::fill(mBytePairRanks.get(), mBytePairRanks.get() + ByteIds * ByteIds, NoRank);
+		mFirstOffsets.assign(maxFirst + 2, 0);
+
+		for (const auto& [key, rank] : pairs)
+		{
+			const uint32_t first = static_cast<uint32_t>(key >> 32);
+			const uint32_t second = static_cast<uint32_t>(key);
+			if ((first | second) < ByteIds)
+			{
+				mBytePairRanks[(first << 8) | second] = rank;
+				continue;
+			}
+
+			mSeconds.push_back(second);
+			mRanks.push_back(rank);
+			++mFirstOffsets[first + 1];
+		}
+
+		for (size_t i = 1; i < mFirstOffsets.size(); ++i)
+		{
+			mFirstOffsets[i] += mFirstOffsets[i - 1];
+		}
+	}
+};
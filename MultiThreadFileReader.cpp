@@ -1,17 +1,30 @@
 #include "MultiThreadFileReader.h"
 #include "MMFile.h"
+#include "WindowedFile.h"
+#include "UringFileReader.h"
+#include "PreTokenizer.h"
+#include "CorpusPaths.h"
+#include "BufferedStreamReader.h"
+#include "DecompressingReader.h"
+#include "JsonlExtractor.h"
+#include "ConcurrentHashSet.h"
 
 #define USE_PCRE 1 // [USE_PCRE, STD_REGEX, NO_REGEX]
-#define PCRE2_CODE_UNIT_WIDTH 8 // Match the library you linked (8, 16, or 32)
-#include <pcre2.h>
 
 #include <thread>
 #include <regex>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <limits>
 
 //-------------------------------------------------------------------------------------------------
 
-MultiThreadFileReader::MultiThreadFileReader() = default;
+MultiThreadFileReader::MultiThreadFileReader()
+	: mPreTokenizer(std::make_unique<PreTokenizer>())
+{
+}
 
 //-------------------------------------------------------------------------------------------------
 
@@ -19,201 +32,826 @@ MultiThreadFileReader::~MultiThreadFileReader() = default;
 
 //-------------------------------------------------------------------------------------------------
 
-void MultiThreadFileReader::ReadText(const std::string& fileName, std::unordered_map<std::string_view, uint32_t>& outWordCount)
+void MultiThreadFileReader::ReadText(const std::string& fileName, MapType& outWordCount)
 {
-	mMappedFile = std::make_unique<MemoryMappedFile>(fileName);
+	std::vector<MapType> wordCounts;
+	ReadText(fileName, wordCounts);
 
-	if (!mMappedFile->isValid())
+	size_t uniqueWords = 0;
+	for (const auto& partition : wordCounts)
 	{
-		std::cout << "Mapped file is not valid (likely zero size)." << std::endl;
-		// Handle zero-size file case appropriately here if needed
-		return;
+		uniqueWords += partition.size();
+	}
+
+	outWordCount.reserve(outWordCount.size() + uniqueWords);
+	for (auto& partition : wordCounts)
+	{
+		// Cached hashes are reused, no key is hashed again.
+		outWordCount.Merge(std::move(partition));
 	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::ReadText(const std::string& fileName, std::vector<MapType>& outWordCounts)
+{
+	ReadText(std::vector<std::string>{ fileName }, outWordCounts, nullptr);
+}
 
-	std::cout << "File '" << fileName << "' mapped successfully." << std::endl;
-	std::cout << "Size: " << mMappedFile->getSize() << " bytes" << std::endl;
+//-------------------------------------------------------------------------------------------------
 
-	// Treat the mapped data as a char array
-	char* data = static_cast<char*>(mMappedFile->getData());
-	const uint32_t fileSize = mMappedFile->getSize();
+void MultiThreadFileReader::ReadText(const std::string& fileName, std::vector<MapType>& outWordCounts, const PartitionCallback& onPartitionReady)
+{
+	ReadText(std::vector<std::string>{ fileName }, outWordCounts, onPartitionReady);
+}
 
-	const uint8_t ThreadCount = 4;
-	const uint32_t SectionLength = fileSize / ThreadCount;
+//-------------------------------------------------------------------------------------------------
 
-	auto fileSections = std::vector<IntPair>(ThreadCount);
-	auto wordCounts = std::vector<MapType>(ThreadCount);
+void MultiThreadFileReader::ReadText(const std::vector<std::string>& inputPaths, std::vector<MapType>& outWordCounts, const PartitionCallback& onPartitionReady)
+{
+	outWordCounts = std::vector<MapType>(PartitionCount);
+	resetInputStats();
+
+	const MemoryMappedFile::PageFaults startFaults = MemoryMappedFile::pageFaults();
+	std::vector<std::string> fileNames = CorpusPaths::Expand(inputPaths);
 	auto totalWords = std::vector<size_t>(ThreadCount);
 
-	fileSections[0].first = 0;
-	fileSections[0].second = goToLineEnd(data, fileSize, SectionLength);
+	// Small files are read through io_uring first, only the others are mapped below.
+	std::vector<std::vector<MapType>> uringWordCounts;
+	const size_t uringFileCount = readSmallFiles(fileNames, uringWordCounts, totalWords);
+
+	// Map all files concurrently, opening many small shards is dominated by system call latency.
+	// Windowed files are only opened, their sections are mapped or read by the workers.
+	const bool windowed = mInputOptions.IsWindowed();
+	mMappedFiles = std::vector<std::unique_ptr<MemoryMappedFile>>(fileNames.size());
+	mWindowedFiles = std::vector<std::unique_ptr<WindowedFile>>(fileNames.size());
+	std::atomic<size_t> nextFile = 0;
 
-	for (int i = 1; i < ThreadCount; ++i)
+	runWorkers(ThreadCount, [&](const uint32_t)
 	{
-		const uint32_t sectionStart = fileSections[i - 1].second;
-		const uint32_t sectionEnd = sectionStart + SectionLength;
+		for (size_t i = nextFile++; i < fileNames.size(); i = nextFile++)
+		{
+			if (windowed)
+			{
+				mWindowedFiles[i] = std::make_unique<WindowedFile>(fileNames[i], mInputOptions.ReadBackend);
+				continue;
+			}
+
+			mMappedFiles[i] = std::make_unique<MemoryMappedFile>(fileNames[i], mInputOptions.PrefaultPages, mInputOptions.HugePages);
+		}
+	});
 
-		fileSections[i].first = sectionStart;
-		fileSections[i].second = goToLineEnd(data, fileSize, sectionEnd);
+	uint64_t totalSize = 0;
+	for (size_t i = 0; i < fileNames.size(); ++i)
+	{
+		totalSize += windowed ? mWindowedFiles[i]->GetSize() : mMappedFiles[i]->getSize();
 	}
 
-	std::vector<std::thread> workers;
-	workers.reserve(ThreadCount);
+	std::cout << (windowed ? "Opened " : "Mapped ") << fileNames.size() << " file(s), " << totalSize << " bytes." << std::endl;
 
-	for (int i = 0; i < ThreadCount; ++i)
+	// Sections of all files go to one queue, several per thread so threads finish together.
+	// A sample is made of small sections, spread over the whole corpus. A window holds one section.
+	size_t SectionLength = mInputOptions.IsSampling() ? MinSectionLength : std::max<size_t>(MinSectionLength, totalSize / (ThreadCount * SectionsPerThread));
+	if (windowed)
 	{
-		workers.emplace_back(
-			&MultiThreadFileReader::readFileSection,
-			this,
-			data,
-			std::cref(fileSections[i]),
-			std::ref(wordCounts[i]),
-			std::ref(totalWords[i])
-		);
+		const uint64_t windowBytes = mInputOptions.WindowBytes != 0 ? mInputOptions.WindowBytes : InputOptions::DefaultWindowBytes;
+		SectionLength = static_cast<size_t>(std::min<uint64_t>(SectionLength, windowBytes));
 	}
 
-	// Wait for all threads to finish
-	for (auto& worker : workers)
+	std::vector<FileSection> fileSections;
+	std::vector<const MemoryMappedFile*> compressedFiles;
+	for (size_t i = 0; i < fileNames.size(); ++i)
 	{
-		worker.join();
+		if (windowed)
+		{
+			const WindowedFile& file = *mWindowedFiles[i];
+			const WindowedFile::Window header = file.Read(0, 16);
+			if (DecompressingReader::Detect(header.GetData(), header.GetSize()) != DecompressingReader::Format::None)
+			{
+				// Compressed data is read once from start to end, the whole file is mapped.
+				mMappedFiles[i] = std::make_unique<MemoryMappedFile>(fileNames[i]);
+				compressedFiles.push_back(mMappedFiles[i].get());
+				continue;
+			}
+
+			for (uint64_t offset = 0; offset < file.GetSize(); offset += SectionLength)
+			{
+				fileSections.push_back({ nullptr, offset, std::min<uint64_t>(offset + SectionLength, file.GetSize()), &file });
+			}
+			continue;
+		}
+
+		const auto& mappedFile = mMappedFiles[i];
+		if (!mappedFile->isValid()) // Skip empty files
+		{
+			continue;
+		}
+
+		const char* data = static_cast<const char*>(mappedFile->getData());
+		if (DecompressingReader::Detect(data, mappedFile->getSize()) != DecompressingReader::Format::None)
+		{
+			compressedFiles.push_back(mappedFile.get());
+			continue;
+		}
+
+		appendSections(data, mappedFile->getSize(), SectionLength, fileSections);
 	}
 
-	uint64_t totalProcessedWords = 0;
-	for (int i = 0; i < ThreadCount; ++i)
+	// Documents extracted from JSONL are unescaped into reused buffers and released sections are read
+	// again from disk if touched, their words are copied.
+	const bool copyWords = mInputOptions.IsJsonl() || mInputOptions.ReleaseSections || windowed;
+	auto wordCounts = makeThreadWordCounts(copyWords ? MapType::KeyStorage::Interned : MapType::KeyStorage::External);
+
+	if (mInputOptions.IsSampling())
 	{
-		auto& currentCount = wordCounts[i];
-		for (const auto& pairItem : currentCount)
+		sampleSections(fileSections);
+	}
+
+	countSections(fileSections, wordCounts, totalWords, true);
+
+	if (!compressedFiles.empty())
+	{
+		// Decompressed text lives in reused buffers, its words are copied. These maps are merged with
+		// the others as if they came from more threads.
+		auto streamWordCounts = makeThreadWordCounts(MapType::KeyStorage::Interned);
+		for (const MemoryMappedFile* compressedFile : compressedFiles)
 		{
-			outWordCount[pairItem.first] += pairItem.second;
+			DecompressingReader decompressor(compressedFile->getData(), compressedFile->getSize(), ThreadCount);
+			BufferedStreamReader streamReader([&decompressor](char* buffer, const size_t size)
+			{
+				return decompressor.Read(buffer, size);
+			});
+			countStream(streamReader, streamWordCounts, totalWords);
 		}
 
+		wordCounts.insert(wordCounts.end(), std::make_move_iterator(streamWordCounts.begin()), std::make_move_iterator(streamWordCounts.end()));
+	}
+
+	wordCounts.insert(wordCounts.end(), std::make_move_iterator(uringWordCounts.begin()), std::make_move_iterator(uringWordCounts.end()));
+
+	const size_t uniqueWords = mergeThreadWordCounts(wordCounts, onPartitionReady, outWordCounts);
+
+	size_t totalProcessedWords = 0;
+	for (uint32_t i = 0; i < ThreadCount; ++i)
+	{
+		totalProcessedWords += totalWords[i];
+	}
+
+	fprintf(stderr, "Read %zu words (%zu unique) from %zu sections and %zu compressed file(s).\n", totalProcessedWords, uniqueWords, fileSections.size(), compressedFiles.size());
+	if (uringFileCount > 0)
+	{
+		fprintf(stderr, "Read %zu small file(s) through io_uring.\n", uringFileCount);
+	}
+
+	const MemoryMappedFile::PageFaults endFaults = MemoryMappedFile::pageFaults();
+	fprintf(stderr, "Page faults: %ld minor, %ld major.\n", endFaults.minor - startFaults.minor, endFaults.major - startFaults.major);
+
+	printInputStats();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::ReadStream(const int fd, std::vector<MapType>& outWordCounts, const PartitionCallback& onPartitionReady)
+{
+	outWordCounts = std::vector<MapType>(PartitionCount);
+	resetInputStats();
+
+	// Stream buffers are reused, so words are copied to the arenas of the maps.
+	auto wordCounts = makeThreadWordCounts(MapType::KeyStorage::Interned);
+	auto totalWords = std::vector<size_t>(ThreadCount);
+
+	BufferedStreamReader streamReader(fd);
+	countStream(streamReader, wordCounts, totalWords);
+
+	const size_t uniqueWords = mergeThreadWordCounts(wordCounts, onPartitionReady, outWordCounts);
+
+	size_t totalProcessedWords = 0;
+	for (uint32_t i = 0; i < ThreadCount; ++i)
+	{
 		totalProcessedWords += totalWords[i];
 	}
 
-	fprintf(stderr, "Read %llu words (%zu unique) from text file.\n", totalProcessedWords, outWordCount.size());
+	fprintf(stderr, "Read %zu words (%zu unique) from %zu bytes of stream.\n", totalProcessedWords, uniqueWords, streamReader.GetTotalBytes());
+
+	printInputStats();
+}
+
+//-------------------------------------------------------------------------------------------------
+// JSON strings can not hold a raw line end, and deduplicated lines must not be split, so both cut
+// sections and blocks right after a line end.
+bool MultiThreadFileReader::cutsAtLineEnds() const
+{
+	return mInputOptions.IsJsonl() || mInputOptions.Dedup != InputOptions::Deduplication::None;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::resetInputStats()
+{
+	mDocumentCount = 0;
+	mSkippedLines = 0;
+	mDuplicateCount = 0;
+	mDuplicateBytes = 0;
+
+	const bool deduplicate = mInputOptions.Dedup != InputOptions::Deduplication::None;
+	mSeenHashes = deduplicate ? std::make_unique<ConcurrentHashSet>() : nullptr;
+
+	if (!(mInputOptions.SampleFraction > 0.0 && mInputOptions.SampleFraction <= 1.0))
+	{
+		throw std::runtime_error("Sample fraction must be in (0, 1].");
+	}
+
+	mSampleBudget = mInputOptions.SampleBytes != 0 ? mInputOptions.SampleBytes : std::numeric_limits<uint64_t>::max();
+	mSampleIndex = 0;
+	mSampledBytes = 0;
+	mSkippedBytes = 0;
 }
 
 //-------------------------------------------------------------------------------------------------
 
-size_t MultiThreadFileReader::goToLineEnd(char* data, size_t fileSize, size_t startFrom)
+void MultiThreadFileReader::printInputStats() const
 {
-	if (startFrom >= fileSize)
+	if (mInputOptions.IsJsonl())
 	{
-		return fileSize;
+		fprintf(stderr, "Read %zu JSONL documents, skipped %zu lines without a '%s' string.\n", mDocumentCount.load(), mSkippedLines.load(), mInputOptions.JsonField.c_str());
 	}
 
-	for (int i = startFrom; i < fileSize; ++i)
+	if (mInputOptions.IsSampling())
+	{
+		fprintf(stderr, "Sampled %llu bytes, skipped %llu (seed %llu).\n",
+			static_cast<unsigned long long>(mSampledBytes), static_cast<unsigned long long>(mSkippedBytes), static_cast<unsigned long long>(mInputOptions.SampleSeed));
+	}
+
+	if (mSeenHashes)
+	{
+		const bool documents = mInputOptions.IsJsonl() && mInputOptions.Dedup == InputOptions::Deduplication::Documents;
+		fprintf(stderr, "Dropped %zu duplicate %s (%zu bytes), %zu unique.\n",
+			mDuplicateCount.load(), documents ? "documents" : "lines", mDuplicateBytes.load(), mSeenHashes->size());
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Blocks are counted while the next one is read.
+void MultiThreadFileReader::countStream(
+	BufferedStreamReader& streamReader,
+	std::vector<std::vector<MapType>>& threadWordCounts,
+	std::vector<size_t>& totalWords
+)
+{
+	const size_t SectionLength = BufferedStreamReader::DefaultBufferSize / (ThreadCount * SectionsPerThread);
+
+	streamReader.SetCutAtLineEnds(cutsAtLineEnds());
+
+	// Sections of a stream are sampled one by one, each with the share of the keys given by the fraction.
+	const double fraction = mInputOptions.SampleFraction;
+	const uint64_t keyThreshold = fraction < 1.0 ? static_cast<uint64_t>(fraction * 18446744073709551616.0) : std::numeric_limits<uint64_t>::max();
+
+	std::vector<FileSection> blockSections;
+	for (std::string_view block = streamReader.Next(); !block.empty() && mSampleBudget > 0; block = streamReader.Next())
 	{
-		if (data[i] == '\n' || data[i] == EOF)
+		blockSections.clear();
+		appendSections(block.data(), block.size(), SectionLength, blockSections);
+
+		if (mInputOptions.IsSampling())
 		{
-			return i;
+			std::erase_if(blockSections, [&](const FileSection& section)
+			{
+				const uint64_t length = section.End - section.Begin;
+				if (mSampleBudget == 0 || sampleKey(mInputOptions.SampleSeed, mSampleIndex++) > keyThreshold)
+				{
+					mSkippedBytes += length;
+					return true;
+				}
+
+				mSampleBudget -= std::min(mSampleBudget, length);
+				mSampledBytes += length;
+				return false;
+			});
 		}
+
+		countSections(blockSections, threadWordCounts, totalWords, false);
 	}
+}
 
-	return -1;
+//-------------------------------------------------------------------------------------------------
+// Sections get a key from the seed and their index, the ones with the lowest keys are read until the
+// sample holds SampleFraction of the bytes, or SampleBytes. The others are never read, so their pages
+// are never loaded. Sampled sections keep the order of the files.
+void MultiThreadFileReader::sampleSections(std::vector<FileSection>& fileSections)
+{
+	uint64_t totalBytes = 0;
+	for (const auto& section : fileSections)
+	{
+		totalBytes += section.End - section.Begin;
+	}
+
+	const uint64_t budget = std::min(mSampleBudget, static_cast<uint64_t>(mInputOptions.SampleFraction * totalBytes));
+
+	std::vector<std::pair<uint64_t, size_t>> keyOrder(fileSections.size());
+	for (size_t i = 0; i < fileSections.size(); ++i)
+	{
+		keyOrder[i] = { sampleKey(mInputOptions.SampleSeed, mSampleIndex++), i };
+	}
+	std::sort(keyOrder.begin(), keyOrder.end());
+
+	std::vector<bool> sampled(fileSections.size());
+	uint64_t sampledBytes = 0;
+	for (const auto& [key, index] : keyOrder)
+	{
+		if (sampledBytes >= budget)
+		{
+			break;
+		}
+		sampled[index] = true;
+		sampledBytes += fileSections[index].End - fileSections[index].Begin;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < fileSections.size(); ++i)
+	{
+		if (sampled[i])
+		{
+			fileSections[kept++] = fileSections[i];
+		}
+	}
+	fileSections.resize(kept);
+
+	mSampleBudget -= std::min(mSampleBudget, sampledBytes);
+	mSampledBytes += sampledBytes;
+	mSkippedBytes += totalBytes - sampledBytes;
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void MultiThreadFileReader::readFileSection(const char* data, const IntPair& fileSection, MapType& outWordCount, size_t& outTotalWords)
+uint64_t MultiThreadFileReader::sampleKey(const uint64_t seed, const uint64_t sectionIndex)
 {
-#if USE_PCRE
-	PCRETokenize(data, fileSection, outWordCount, outTotalWords);
-#elif STD_REGEX
-	STDRegexTokenize(data, fileSection, outWordCount, outTotalWords);
-#elif NO_REGEX
-	SimpleTokenize(data, fileSection, outWordCount, outTotalWords);
-#endif
+	return StringHash::Hash(&sectionIndex, sizeof(sectionIndex), seed);
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void MultiThreadFileReader::PCRETokenize(const char* data, const IntPair& fileSection, MapType& outWordCount, size_t& outTotalWords)
+void MultiThreadFileReader::appendSections(const char* data, const size_t size, const size_t sectionLength, std::vector<FileSection>& outSections)
 {
-	// This is equivalent to original GPT-2 pattern but executes faster (r50k)
-	const char* pattern =
-		R"('(?:[sdmt]|ll|ve|re)| ?\p{L}++| ?\p{N}++| ?[^\s\p{L}\p{N}]++|\s++$|\s+(?!\S)|\s)";
-
-	int errornumber;
-	PCRE2_SIZE erroroffset;
-	uint32_t compile_options = PCRE2_UCP;
-	pcre2_code* re = pcre2_compile(
-		(PCRE2_SPTR)pattern,
-		PCRE2_ZERO_TERMINATED,
-		compile_options,
-		&errornumber,
-		&erroroffset,
-		nullptr
-	);
+	for (size_t sectionStart = 0; sectionStart < size; )
+	{
+		const size_t sectionEnd = findCut(data, size, sectionStart + sectionLength);
+		outSections.push_back({ data, sectionStart, sectionEnd });
+		sectionStart = sectionEnd;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// First point at or after from where sections can be cut, size if there is none.
+size_t MultiThreadFileReader::findCut(const char* data, const size_t size, const size_t from) const
+{
+	if (cutsAtLineEnds())
+	{
+		if (from >= size)
+		{
+			return size;
+		}
+
+		const void* lineEnd = std::memchr(data + from, '\n', size - from);
+		return lineEnd ? static_cast<const char*>(lineEnd) - data + 1 : size;
+	}
+
+	return goToLineEnd(data, size, from);
+}
+
+//-------------------------------------------------------------------------------------------------
+// A windowed section starts at the first cut at or after its nominal begin and ends at the first cut
+// at or after its nominal end, which is where the next section starts: both workers find that cut
+// from the same bytes. The window starts one byte early, split points look at the previous byte,
+// and grows until the end cut is inside it.
+void MultiThreadFileReader::readWindowSection(const FileSection& section, std::vector<MapType>& outWordCount, size_t& outTotalWords)
+{
+	const WindowedFile& file = *section.File;
+	const uint64_t windowBegin = section.Begin > 0 ? section.Begin - 1 : 0;
+	const bool lastSection = section.End == file.GetSize();
+
+	for (size_t margin = WindowMargin; ; margin *= 2)
+	{
+		const WindowedFile::Window window = file.Read(windowBegin, section.End - windowBegin + (lastSection ? 0 : margin), mInputOptions.PrefaultPages);
+		const char* data = window.GetData();
+		const size_t size = window.GetSize();
+
+		const size_t end = lastSection ? size : findCut(data, size, section.End - windowBegin);
+		if (end == size && windowBegin + size < file.GetSize())
+		{
+			continue; // The cut may be further on
+		}
+
+		const size_t begin = section.Begin > 0 ? std::min(findCut(data, size, section.Begin - windowBegin), end) : 0;
+
+		if (mInputOptions.AdviseSections && file.GetBackend() == WindowedFile::Backend::Mmap)
+		{
+			MemoryMappedFile::advise(data + begin, data + end, MemoryMappedFile::Advice::Sequential);
+			MemoryMappedFile::advise(data + begin, data + end, MemoryMappedFile::Advice::WillNeed);
+		}
+
+		readFileSection({ data, begin, end }, outWordCount, outTotalWords);
+		return;
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Counts the files that fit a buffer of UringFileReader, one thread drives the ring while the workers
+// tokenize the buffers it fills. Files left over stay in fileNames. Returns the number of files read.
+size_t MultiThreadFileReader::readSmallFiles(
+	std::vector<std::string>& fileNames,
+	std::vector<std::vector<MapType>>& outThreadWordCounts,
+	std::vector<size_t>& totalWords
+)
+{
+	if (!mInputOptions.UseIoUring || mInputOptions.IsSampling() || mInputOptions.IsWindowed() || fileNames.empty())
+	{
+		return 0;
+	}
+
+	if (!UringFileReader::IsAvailable())
+	{
+		fprintf(stderr, "io_uring is not available, mapping all files.\n");
+		return 0;
+	}
+
+	// Buffers are reused for the next files, words are copied.
+	outThreadWordCounts = makeThreadWordCounts(MapType::KeyStorage::Interned);
+
+	std::vector<size_t> otherFiles;
+	{
+		UringFileReader reader(fileNames);
+		runWorkers(ThreadCount + 1, [&](const uint32_t worker)
+		{
+			if (worker == ThreadCount)
+			{
+				reader.Run();
+				return;
+			}
+
+			try
+			{
+				UringFileReader::File file;
+				while (reader.Next(file))
+				{
+					// Compressed files are decompressed as streams with the mapped ones
+					const bool plainText = DecompressingReader::Detect(file.Data, file.Size) == DecompressingReader::Format::None;
+					if (plainText)
+					{
+						readFileSection({ file.Data, 0, file.Size }, outThreadWordCounts[worker], totalWords[worker]);
+					}
+					reader.Release(file, plainText);
+				}
+			}
+			catch (...)
+			{
+				reader.Cancel();
+				throw;
+			}
+		});
+
+		otherFiles = reader.GetOtherFiles();
+	}
+
+	const size_t readCount = fileNames.size() - otherFiles.size();
 
-	if (!re)
+	std::vector<std::string> otherFileNames;
+	otherFileNames.reserve(otherFiles.size());
+	for (const size_t i : otherFiles)
 	{
-		PCRE2_UCHAR buffer[256];
-		pcre2_get_error_message(errornumber, buffer, sizeof(buffer));
-		throw std::runtime_error("Failed to compile pattern: " + std::string((char*)buffer));
+		otherFileNames.push_back(std::move(fileNames[i]));
 	}
+	fileNames = std::move(otherFileNames);
 
-	// Compile to native machine code
-	int jit_ret = pcre2_jit_compile(re, PCRE2_JIT_COMPLETE);
-	if (jit_ret != 0)
+	return readCount;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::vector<std::vector<MultiThreadFileReader::MapType>> MultiThreadFileReader::makeThreadWordCounts(const MapType::KeyStorage keyStorage)
+{
+	auto wordCounts = std::vector<std::vector<MapType>>(ThreadCount);
+	for (auto& threadWordCounts : wordCounts)
 	{
-		pcre2_code_free(re);
-		throw std::runtime_error("JIT compilation failed");
+		threadWordCounts.reserve(PartitionCount);
+		for (uint32_t partition = 0; partition < PartitionCount; ++partition)
+		{
+			threadWordCounts.emplace_back(keyStorage);
+		}
 	}
+	return wordCounts;
+}
 
-	const char* dataStart = data + fileSection.first;
-	const PCRE2_SIZE length = fileSection.second - fileSection.first;
-	PCRE2_SIZE start_offset = 0;
+//-------------------------------------------------------------------------------------------------
 
-	pcre2_match_data* match_data = pcre2_match_data_create_from_pattern(re, nullptr);
+void MultiThreadFileReader::countSections(
+	const std::vector<FileSection>& fileSections,
+	std::vector<std::vector<MapType>>& threadWordCounts,
+	std::vector<size_t>& totalWords,
+	const bool mappedSections
+)
+{
+	// Page hints only apply to mapped files, stream buffers are heap memory.
+	const bool advise = mappedSections && mInputOptions.AdviseSections;
+	const bool release = mappedSections && mInputOptions.ReleaseSections;
 
-	while (start_offset < length)
+	std::atomic<size_t> nextSection = 0;
+	runWorkers(ThreadCount, [&](const uint32_t worker)
 	{
-		int rc = pcre2_match(
-			re,
-			(PCRE2_SPTR)dataStart,
-			length,
-			start_offset,
-			0,
-			match_data,
-			nullptr
-		);
+		for (size_t i = nextSection++; i < fileSections.size(); i = nextSection++)
+		{
+			const FileSection& section = fileSections[i];
+			if (section.File != nullptr)
+			{
+				readWindowSection(section, threadWordCounts[worker], totalWords[worker]);
+				continue;
+			}
 
-		if (rc < 0)
+			const char* begin = section.Data + section.Begin;
+			const char* end = section.Data + section.End;
+
+			if (advise)
+			{
+				MemoryMappedFile::advise(begin, end, MemoryMappedFile::Advice::Sequential);
+				MemoryMappedFile::advise(begin, end, MemoryMappedFile::Advice::WillNeed);
+			}
+
+			readFileSection(section, threadWordCounts[worker], totalWords[worker]);
+
+			if (release)
+			{
+				MemoryMappedFile::advise(begin, end, MemoryMappedFile::Advice::DontNeed);
+			}
+		}
+	});
+}
+
+//-------------------------------------------------------------------------------------------------
+// Partition k of every thread goes to the same output map, merge partitions in parallel.
+size_t MultiThreadFileReader::mergeThreadWordCounts(
+	std::vector<std::vector<MapType>>& threadWordCounts,
+	const PartitionCallback& onPartitionReady,
+	std::vector<MapType>& outWordCounts
+)
+{
+	std::atomic<uint32_t> nextPartition = 0;
+	std::atomic<size_t> uniqueWords = 0;
+
+	runWorkers(ThreadCount, [&](const uint32_t)
+	{
+		mergePartitions(threadWordCounts, nextPartition, onPartitionReady, outWordCounts, uniqueWords);
+	});
+
+	return uniqueWords;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Runs task(workerIndex) on threadCount threads, the first exception is rethrown on the calling thread.
+void MultiThreadFileReader::runWorkers(const uint32_t threadCount, const std::function<void(uint32_t)>& task)
+{
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> errors(threadCount);
+	workers.reserve(threadCount);
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+	{
+		workers.emplace_back([&task, &errors, i]()
 		{
-			if (rc != PCRE2_ERROR_NOMATCH)
+			try
 			{
-				throw std::runtime_error("PCRE match error!");
+				task(i);
+			}
+			catch (...)
+			{
+				errors[i] = std::current_exception();
+			}
+		});
+	}
+
+	// Wait for all threads to finish
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	for (const auto& error : errors)
+	{
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::mergePartitions(
+	std::vector<std::vector<MapType>>& threadWordCounts,
+	std::atomic<uint32_t>& nextPartition,
+	const PartitionCallback& onPartitionReady,
+	std::vector<MapType>& outWordCounts,
+	std::atomic<size_t>& outUniqueWords
+)
+{
+	for (uint32_t partition = nextPartition++; partition < PartitionCount; partition = nextPartition++)
+	{
+		// Start from the biggest map and fold the others into it.
+		size_t largest = 0;
+		for (size_t i = 1; i < threadWordCounts.size(); ++i)
+		{
+			if (threadWordCounts[i][partition].size() > threadWordCounts[largest][partition].size())
+			{
+				largest = i;
 			}
-			break;
 		}
 
-		PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(match_data);
-		// Validate match bounds
-		if (ovector[0] > ovector[1] || ovector[1] > length || ovector[0] > length)
+		MapType& outWordCount = outWordCounts[partition];
+		outWordCount = std::move(threadWordCounts[largest][partition]);
+
+		for (size_t i = 0; i < threadWordCounts.size(); ++i)
 		{
-			throw std::runtime_error("Invalid match bounds!");
+			if (i == largest)
+			{
+				continue;
+			}
+
+			// Frees the merged map as soon as possible
+			outWordCount.Merge(std::move(threadWordCounts[i][partition]));
 		}
 
-		size_t token_len = static_cast<size_t>(ovector[1] - ovector[0]);
-		const std::string_view match_view(dataStart + ovector[0], token_len);
-		outWordCount[match_view]++;
-		outTotalWords++;
+		outUniqueWords += outWordCount.size();
 
-		// Prevent infinite loop if no progress
-		if (ovector[1] <= start_offset)
+		if (onPartitionReady)
 		{
-			break;
+			onPartitionReady(partition, outWordCount);
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t MultiThreadFileReader::goToLineEnd(const char* data, size_t fileSize, size_t startFrom)
+{
+	// Cutting right before a line end could split a run of whitespace, which changes pretokens.
+	return PreTokenizer::FindSplitPoint(data, fileSize, startFrom);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::readFileSection(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
+{
+	if (mInputOptions.IsJsonl())
+	{
+		readJsonlSection(fileSection, outWordCounts, outTotalWords);
+	}
+	else if (mSeenHashes)
+	{
+		tokenizeUniqueLines(fileSection, outWordCounts, outTotalWords);
+	}
+	else
+	{
+		tokenizeSection(fileSection, outWordCounts, outTotalWords);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+// Every line is one document, pretokenized on its own so no word spans two documents.
+void MultiThreadFileReader::readJsonlSection(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
+{
+	thread_local std::string document;
+
+	const char* pos = fileSection.Data + fileSection.Begin;
+	const char* end = fileSection.Data + fileSection.End;
+
+	size_t documentCount = 0;
+	size_t skippedLines = 0;
+
+	while (pos < end)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+		if (lineEnd == nullptr)
+		{
+			lineEnd = end;
+		}
+
+		const std::string_view line(pos, lineEnd - pos);
+		pos = lineEnd + 1;
+
+		document.clear();
+		if (Jsonl::ExtractField(line, mInputOptions.JsonField, document))
+		{
+			++documentCount;
+
+			const FileSection documentSection = { document.data(), 0, document.size() };
+			if (!mSeenHashes)
+			{
+				tokenizeSection(documentSection, outWordCounts, outTotalWords);
+			}
+			else if (mInputOptions.Dedup == InputOptions::Deduplication::Lines)
+			{
+				tokenizeUniqueLines(documentSection, outWordCounts, outTotalWords);
+			}
+			else if (mSeenHashes->Insert(StringHash::Hash(document.data(), document.size())))
+			{
+				tokenizeSection(documentSection, outWordCounts, outTotalWords);
+			}
+			else
+			{
+				++mDuplicateCount;
+				mDuplicateBytes += document.size();
+			}
+		}
+		else if (Jsonl::SkipSpace(line.data(), line.data() + line.size()) != line.data() + line.size())
+		{
+			++skippedLines; // Blank lines are not counted
 		}
-		start_offset = ovector[1];
 	}
 
-	pcre2_match_data_free(match_data);
-	pcre2_code_free(re);
+	mDocumentCount += documentCount;
+	mSkippedLines += skippedLines;
 }
 
 //-------------------------------------------------------------------------------------------------
+// Lines seen before are dropped. Which copy of a line is kept depends on which thread reads it first,
+// so each line is pretokenized on its own, with its line end: its words are those of any copy, and do
+// not depend on the lines around it. Lines of whitespace are always kept, each run of them in one piece.
+void MultiThreadFileReader::tokenizeUniqueLines(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
+{
+	const char* data = fileSection.Data;
+
+	size_t duplicateCount = 0;
+	size_t duplicateBytes = 0;
+	size_t blankBegin = fileSection.Begin;
+
+	for (size_t lineBegin = fileSection.Begin; lineBegin < fileSection.End; )
+	{
+		const void* newLine = std::memchr(data + lineBegin, '\n', fileSection.End - lineBegin);
+		const size_t lineEnd = newLine ? static_cast<const char*>(newLine) - data + 1 : fileSection.End;
 
-void MultiThreadFileReader::STDRegexTokenize(const char* data, const IntPair& fileSection, MapType& outWordCount, size_t& outTotalWords)
+		const std::string_view line(data + lineBegin, lineEnd - lineBegin);
+		if (line.find_first_not_of(" \t\r\n") == std::string_view::npos)
+		{
+			lineBegin = lineEnd;
+			continue;
+		}
+
+		if (blankBegin < lineBegin)
+		{
+			tokenizeSection({ data, blankBegin, lineBegin }, outWordCounts, outTotalWords);
+		}
+
+		// Copies match in all their bytes, the line end included, as those are the bytes pretokenized.
+		if (mSeenHashes->Insert(StringHash::Hash(line.data(), line.size())))
+		{
+			tokenizeSection({ data, lineBegin, lineEnd }, outWordCounts, outTotalWords);
+		}
+		else
+		{
+			++duplicateCount;
+			duplicateBytes += line.size();
+		}
+
+		lineBegin = lineEnd;
+		blankBegin = lineEnd;
+	}
+
+	if (blankBegin < fileSection.End)
+	{
+		tokenizeSection({ data, blankBegin, fileSection.End }, outWordCounts, outTotalWords);
+	}
+
+	mDuplicateCount += duplicateCount;
+	mDuplicateBytes += duplicateBytes;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::tokenizeSection(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
+{
+#if USE_PCRE
+	PCRETokenize(fileSection, outWordCounts, outTotalWords);
+#elif STD_REGEX
+	STDRegexTokenize(fileSection, outWordCounts, outTotalWords);
+#elif NO_REGEX
+	SimpleTokenize(fileSection, outWordCounts, outTotalWords);
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::PCRETokenize(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
+{
+	const std::string_view text(fileSection.Data + fileSection.Begin, fileSection.End - fileSection.Begin);
+	mPreTokenizer->PCRETokenize(text, [&](const std::string_view word)
+	{
+		const uint64_t hash = MapType::Hash(word);
+		outWordCounts[GetPartition(hash)].FindOrInsert(word, hash)++;
+		outTotalWords++;
+	});
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void MultiThreadFileReader::STDRegexTokenize(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
 {
 	// Portable alternative without Unicode properties
 	const std::regex token_pattern(
@@ -221,8 +859,8 @@ void MultiThreadFileReader::STDRegexTokenize(const char* data, const IntPair& fi
 		std::regex_constants::optimize
 	);
 
-	const char* start_ptr = data + fileSection.first;
-	const char* end_ptr = data + fileSection.second;
+	const char* start_ptr = fileSection.Data + fileSection.Begin;
+	const char* end_ptr = fileSection.Data + fileSection.End;
 
 	std::cregex_iterator it(start_ptr, end_ptr, token_pattern);
 	std::cregex_iterator end_it;
@@ -230,42 +868,24 @@ void MultiThreadFileReader::STDRegexTokenize(const char* data, const IntPair& fi
 	{
 		const auto& match = *it;
 		const std::string_view match_view(match[0].first, match[0].length());
-		outWordCount[match_view]++;
+		const uint64_t hash = MapType::Hash(match_view);
+		outWordCounts[GetPartition(hash)].FindOrInsert(match_view, hash)++;
 		outTotalWords++;
 	}
 }
 
 //-------------------------------------------------------------------------------------------------
 
-void MultiThreadFileReader::SimpleTokenize(const char* data, const IntPair& fileSection, MapType& outWordCount, size_t& outTotalWords)
+// Regex-free pretokenizer, gives the same splits as the PCRE pattern in UTF mode.
+void MultiThreadFileReader::SimpleTokenize(const FileSection& fileSection, std::vector<MapType>& outWordCounts, size_t& outTotalWords)
 {
-	size_t word_start = fileSection.first;
-	for (size_t i = fileSection.first; i < fileSection.second; ++i)
+	const std::string_view text(fileSection.Data + fileSection.Begin, fileSection.End - fileSection.Begin);
+	PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
 	{
-		const char cur_char = data[i];
-		if (cur_char == ' ' || cur_char == '\n')
-		{
-			if (i == word_start)
-			{
-				word_start = i + 1;
-				continue;
-			}
-
-			// end of word
-			const std::string_view match_view(data + word_start, i - word_start);
-			outWordCount[match_view]++;
-			outTotalWords++;
-			word_start = i + 1;
-		}
-	}
-
-	// Add the last word if there's one
-	if (word_start < fileSection.second)
-	{
-		const std::string_view match_view(data + word_start, fileSection.second - word_start);
-		outWordCount[match_view]++;
+		const uint64_t hash = MapType::Hash(word);
+		outWordCounts[GetPartition(hash)].FindOrInsert(word, hash)++;
 		outTotalWords++;
-	}
+	});
 }
 
 //-------------------------------------------------------------------------------------------------
\ No newline at end of file
@@ -1,53 +1,192 @@
 #pragma once
 
+#include "FlatStringMap.h"
+#include "InputOptions.h"
+
 #include <string>
 #include <utility>  // For std::pair
-#include <unordered_map>
+#include <vector>
 #include <memory>
+#include <atomic>
+#include <functional>
 
 class MultiThreadFileReader
 {
 public:
 
+	using MapType = FlatStringCountMap;
+
+	// Called on a merge thread as soon as a partition holds the final counts of its words.
+	// The partition may be consumed (e.g. cleared) by the callback.
+	using PartitionCallback = std::function<void(uint32_t partition, MapType& wordCount)>;
+
+	// Words are routed to partitions by hash, so each partition can be merged independently.
+	static constexpr uint32_t PartitionBits = 6;
+	static constexpr uint32_t PartitionCount = 1u << PartitionBits;
+
 	MultiThreadFileReader();
 	~MultiThreadFileReader();
 
-	void ReadText(const std::string& fileName, std::unordered_map<std::string_view, uint32_t>& wordCount);
+	void ReadText(const std::string& fileName, MapType& outWordCount);
+
+	// Same as above but leaves the counts split in PartitionCount disjoint maps, skips the serial merge.
+	void ReadText(const std::string& fileName, std::vector<MapType>& outWordCounts);
+
+	// Same as above, also hands every finished partition to onPartitionReady while others are still merged.
+	void ReadText(const std::string& fileName, std::vector<MapType>& outWordCounts, const PartitionCallback& onPartitionReady);
+
+	// Reads a corpus made of many files. Inputs can be files, directories or file name patterns
+	// (see CorpusPaths.h), sections of all files are scheduled on one worker pool.
+	// gzip and zstd files are recognized by content and decompressed on the fly (see DecompressingReader.h).
+	void ReadText(
+		const std::vector<std::string>& inputPaths,
+		std::vector<MapType>& outWordCounts,
+		const PartitionCallback& onPartitionReady = nullptr
+	);
+
+	// Reads text from a pipe or any other file descriptor (e.g. zcat output) with constant buffer memory.
+	void ReadStream(const int fd, std::vector<MapType>& outWordCounts, const PartitionCallback& onPartitionReady = nullptr);
+
+	// JSONL input extracts one field of every line, see InputOptions.h.
+	void SetInputOptions(const InputOptions& inputOptions) { mInputOptions = inputOptions; }
+
+	// Partitions use the top bits of the word hash, the maps index their slots with the low bits.
+	static uint32_t GetPartition(const uint64_t wordHash)
+	{
+		return static_cast<uint32_t>(wordHash >> (64 - PartitionBits));
+	}
 
 private:
 		
-	using MapType = std::unordered_map<std::string_view, uint32_t>;
-	using IntPair = std::pair<uint32_t, uint32_t>;
+	static constexpr uint32_t ThreadCount = 4;
+
+	// Sections are cut at line ends, shorter files make a single section.
+	static constexpr size_t MinSectionLength = 1 << 20;
+	static constexpr size_t SectionsPerThread = 4;
+
+	// Windowed files are mapped from the section offset with this much more, doubled until the end cut is in.
+	static constexpr size_t WindowMargin = 64 << 10;
+
+	// Sections of windowed files have no Data: Begin and End are nominal offsets in File, which the
+	// worker resolves to cut points once it maps them, see readWindowSection.
+	struct FileSection
+	{
+		const char* Data;
+		size_t Begin;
+		size_t End;
+		const class WindowedFile* File = nullptr;
+	};
+
+	// Words are views into the mapped files, keep them until the reader is destroyed.
+	std::vector<std::unique_ptr<class MemoryMappedFile>> mMappedFiles;
+	std::vector<std::unique_ptr<class WindowedFile>> mWindowedFiles;
+	std::unique_ptr<class PreTokenizer> mPreTokenizer;
+
+	InputOptions mInputOptions;
+	std::atomic<size_t> mDocumentCount = 0;
+	std::atomic<size_t> mSkippedLines = 0;
+
+	// Hashes of the lines or documents read so far when deduplicating, see InputOptions::Dedup.
+	std::unique_ptr<class ConcurrentHashSet> mSeenHashes;
+	std::atomic<size_t> mDuplicateCount = 0;
+	std::atomic<size_t> mDuplicateBytes = 0;
+
+	// Sampling state of the current read, see InputOptions::SampleFraction.
+	uint64_t mSampleBudget = 0;
+	uint64_t mSampleIndex = 0;
+	uint64_t mSampledBytes = 0;
+	uint64_t mSkippedBytes = 0;
+
+	void sampleSections(std::vector<FileSection>& fileSections);
+	static uint64_t sampleKey(const uint64_t seed, const uint64_t sectionIndex);
+
+	bool cutsAtLineEnds() const;
+	void resetInputStats();
+	void printInputStats() const;
+
+	static void runWorkers(const uint32_t threadCount, const std::function<void(uint32_t)>& task);
 
-	std::unique_ptr<class MemoryMappedFile> mMappedFile;
+	static size_t goToLineEnd(const char* data, size_t fileSize, size_t startFrom);
 
-	size_t goToLineEnd(char* data, size_t fileSize, size_t startFrom);
+	size_t findCut(const char* data, const size_t size, const size_t from) const;
+	void appendSections(const char* data, const size_t size, const size_t sectionLength, std::vector<FileSection>& outSections);
+	void readWindowSection(const FileSection& section, std::vector<MapType>& outWordCount, size_t& outTotalWords);
+
+	static std::vector<std::vector<MapType>> makeThreadWordCounts(const MapType::KeyStorage keyStorage);
+
+	size_t readSmallFiles(
+		std::vector<std::string>& fileNames,
+		std::vector<std::vector<MapType>>& outThreadWordCounts,
+		std::vector<size_t>& totalWords
+	);
+
+	void countStream(
+		class BufferedStreamReader& streamReader,
+		std::vector<std::vector<MapType>>& threadWordCounts,
+		std::vector<size_t>& totalWords
+	);
+
+	// mappedSections are in mapped files, where the page hints of mInputOptions apply.
+	void countSections(
+		const std::vector<FileSection>& fileSections,
+		std::vector<std::vector<MapType>>& threadWordCounts,
+		std::vector<size_t>& totalWords,
+		const bool mappedSections
+	);
+
+	size_t mergeThreadWordCounts(
+		std::vector<std::vector<MapType>>& threadWordCounts,
+		const PartitionCallback& onPartitionReady,
+		std::vector<MapType>& outWordCounts
+	);
+
+	void mergePartitions(
+		std::vector<std::vector<MapType>>& threadWordCounts,
+		std::atomic<uint32_t>& nextPartition,
+		const PartitionCallback& onPartitionReady,
+		std::vector<MapType>& outWordCounts,
+		std::atomic<size_t>& outUniqueWords
+	);
 
 	void readFileSection(
-		const char* data,
-		const IntPair& fileSection,
-		MapType& outWordCount,
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
+		size_t& outTotalWords
+	);
+
+	void readJsonlSection(
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
+		size_t& outTotalWords
+	);
+
+	void tokenizeUniqueLines(
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
+		size_t& outTotalWords
+	);
+
+	void tokenizeSection(
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
 		size_t& outTotalWords
 	);
 
 	void PCRETokenize(
-		const char* data,
-		const IntPair& fileSection,
-		MapType& outWordCount,
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
 		size_t& outTotalWords
 	);
 
 	void STDRegexTokenize(
-		const char* data,
-		const IntPair& fileSection,
-		MapType& outWordCount,
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
 		size_t& outTotalWords
 	);
 
 	void SimpleTokenize(
-		const char* data,
-		const IntPair& fileSection,
-		MapType& outWordCount,
+		const FileSection& fileSection,
+		std::vector<MapType>& outWordCounts,
 		size_t& outTotalWords
 	);
 };
\ No newline at end of file
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "StringHasher.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// Tokens of recently encoded words, shared by all encoding threads. Natural text is Zipfian: a few
+// hundred thousand words make up most of any corpus, and each is encoded once instead of every time.
+// The top bits of the word hash pick one of ShardCount shards behind their own lock. Each shard holds
+// a fixed number of entries and evicts with CLOCK: an entry read since the hand last passed it gets
+// another round, so frequent words stay while one-off words are replaced.
+//
+// A hit must cost less than encoding a short word, so entries keep the word and its tokens inline in
+// two cache lines and are found through a linear probing table of hashes, nothing else is followed.
+class PretokenCache
+{
+public:
+
+	static constexpr uint32_t ShardBits = 6;
+	static constexpr uint32_t ShardCount = 1u << ShardBits;
+
+	// Longer words, or words of more tokens, are rare and not cached.
+	static constexpr size_t MaxWordLength = 40;
+	static constexpr size_t MaxTokens = 16;
+
+	struct Stats
+	{
+		uint64_t Hits = 0;
+		uint64_t Misses = 0;
+		uint64_t Evictions = 0;
+		size_t Size = 0;
+	};
+
+	// Capacity in words, rounded up to a multiple of ShardCount.
+	explicit PretokenCache(const size_t capacity)
+		: mShards(ShardCount)
+		, mShardCapacity((capacity + ShardCount - 1) / ShardCount)
+	{
+		// At most half of the slots are used, probes stay short
+		size_t slotCount = 1;
+		while (slotCount < 2 * mShardCapacity)
+		{
+			slotCount *= 2;
+		}
+
+		for (Shard& shard : mShards)
+		{
+			shard.Entries.reserve(mShardCapacity);
+			shard.Slots.assign(slotCount, EmptySlot);
+		}
+	}
+
+	PretokenCache(const PretokenCache&) = delete;
+	PretokenCache& operator=(const PretokenCache&) = delete;
+
+	size_t GetCapacity() const { return mShardCapacity * ShardCount; }
+
+	static bool IsCacheable(const std::string_view word)
+	{
+		return !word.empty() && word.size() <= MaxWordLength;
+	}
+
+	// Copies the tokens of word to outTokens, false if it is not cached.
+	bool Find(const std::string_view word, std::vector<uint32_t>& outTokens)
+	{
+		const uint64_t hash = StringHash::Hash(word.data(), word.size());
+		Shard& shard = shardOf(hash);
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+
+		const uint32_t slot = shard.find(word, hash);
+		if (shard.Slots[slot] == EmptySlot)
+		{
+			++shard.Misses;
+			return false;
+		}
+
+		++shard.Hits;
+		Entry& entry = shard.Entries[shard.Slots[slot]];
+		entry.Referenced = true;
+		outTokens.assign(entry.Tokens, entry.Tokens + entry.TokenCount);
+		return true;
+	}
+
+	void Insert(const std::string_view word, const std::vector<uint32_t>& tokens)
+	{
+		if (mShardCapacity == 0 || !IsCacheable(word) || tokens.size() > MaxTokens)
+		{
+			return;
+		}
+
+		const uint64_t hash = StringHash::Hash(word.data(), word.size());
+		Shard& shard = shardOf(hash);
+		std::lock_guard<std::mutex> lock(shard.Mutex);
+
+		// Another thread may have encoded the same word meanwhile
+		if (shard.Slots[shard.find(word, hash)] != EmptySlot)
+		{
+			return;
+		}
+
+		uint32_t index;
+		if (shard.Entries.size() < mShardCapacity)
+		{
+			index = static_cast<uint32_t>(shard.Entries.size());
+			shard.Entries.emplace_back();
+		}
+		else
+		{
+			while (shard.Entries[shard.Hand].Referenced)
+			{
+				shard.Entries[shard.Hand].Referenced = false;
+				shard.Hand = (shard.Hand + 1) % mShardCapacity;
+			}
+
+			index = static_cast<uint32_t>(shard.Hand);
+			shard.Hand = (shard.Hand + 1) % mShardCapacity;
+			shard.erase(index);
+			++shard.Evictions;
+		}
+
+		Entry& entry = shard.Entries[index];
+		entry.Hash = hash;
+		entry.WordLength = static_cast<uint8_t>(word.size());
+		entry.TokenCount = static_cast<uint8_t>(tokens.size());
+		entry.Referenced = false;
+		std::memcpy(entry.Word, word.data(), word.size());
+		std::memcpy(entry.Tokens, tokens.data(), tokens.size() * sizeof(uint32_t));
+
+		// The slot found above is still free, nothing moved since
+		shard.Slots[shard.find(word, hash)] = index;
+	}
+
+	Stats GetStats() const
+	{
+		Stats stats;
+		for (const Shard& shard : mShards)
+		{
+			std::lock_guard<std::mutex> lock(shard.Mutex);
+			stats.Hits += shard.Hits;
+			stats.Misses += shard.Misses;
+			stats.Evictions += shard.Evictions;
+			stats.Size += shard.Entries.size();
+		}
+		return stats;
+	}
+
+private:
+
+	static constexpr uint32_t EmptySlot = UINT32_MAX;
+
+	struct alignas(64) Entry
+	{
+		uint64_t Hash = 0;
+		uint8_t WordLength = 0;
+		uint8_t TokenCount = 0;
+		bool Referenced = false;
+		char Word[MaxWordLength];
+		uint32_t Tokens[MaxTokens];
+	};
+
+	struct alignas(64) Shard
+	{
+		mutable std::mutex Mutex;
+		std::vector<Entry> Entries;
+		std::vector<uint32_t> Slots; // Index of the entry, or EmptySlot
+		size_t Hand = 0;
+
+		uint64_t Hits = 0;
+		uint64_t Misses = 0;
+		uint64_t Evictions = 0;
+
+		uint32_t slotMask() const { return static_cast<uint32_t>(Slots.size() - 1); }
+
+		// Slot of word, or the empty slot where it would go.
+		uint32_t find(const std::string_view word, const uint64_t hash) const
+		{
+			for (uint32_t slot = static_cast<uint32_t>(hash) & slotMask(); ; slot = (slot + 1) & slotMask())
+			{
+				if (Slots[slot] == EmptySlot)
+				{
+					return slot;
+				}
+
+				const Entry& entry = Entries[Slots[slot]];
+				if (entry.Hash == hash && entry.WordLength == word.size() && std::memcmp(entry.Word, word.data(), word.size()) == 0)
+				{
+					return slot;
+				}
+			}
+		}
+
+		// Removes the slot of entry index, later entries of its probe run move back into the gap so
+		// that no lookup stops short of them.
+		void erase(const uint32_t index)
+		{
+			const Entry& erased = Entries[index];
+			uint32_t gap = find(std::string_view(erased.Word, erased.WordLength), erased.Hash);
+			for (uint32_t slot = (gap + 1) & slotMask(); Slots[slot] != EmptySlot; slot = (slot + 1) & slotMask())
+			{
+				const uint32_t home = static_cast<uint32_t>(Entries[Slots[slot]].Hash) & slotMask();
+				if (((slot - home) & slotMask()) >= ((slot - gap) & slotMask()))
+				{
+					Slots[gap] = Slots[slot];
+					gap = slot;
+				}
+			}
+			Slots[gap] = EmptySlot;
+		}
+	};
+
+	std::vector<Shard> mShards;
+	const size_t mShardCapacity;
+
+	Shard& shardOf(const uint64_t hash)
+	{
+		// The low bits pick the slot, the high bits the shard
+		return mShards[hash >> (64 - ShardBits)];
+	}
+};
@@ -34,6 +34,17 @@ _lib.BPELearner_destroy.argtypes = [ctypes.c_void_p]
 _lib.BPELearner_LearnFromFile.restype = ctypes.c_void_p
 _lib.BPELearner_LearnFromFile.argtypes = [ctypes.c_uint, ctypes.c_char_p]
 
+_lib.BPELearner_LearnFromFiles.restype = None
+_lib.BPELearner_LearnFromFiles.argtypes = [
+    ctypes.c_void_p,
+    ctypes.c_uint,
+    ctypes.POINTER(ctypes.c_char_p),
+    ctypes.c_size_t,
+]
+
+_lib.BPELearner_LearnFromStream.restype = None
+_lib.BPELearner_LearnFromStream.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_int]
+
 _lib.BPELearner_LearnFromChunk.restype = None
 _lib.BPELearner_LearnFromChunk.argtypes = [
     ctypes.c_void_p,
@@ -45,6 +56,40 @@ _lib.BPELearner_LearnFromChunk.argtypes = [
 _lib.BPELearner_Save.restype = ctypes.c_void_p
 _lib.BPELearner_Save.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
 
+_lib.BPELearner_SetJsonlField.restype = None
+_lib.BPELearner_SetJsonlField.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+
+_lib.BPELearner_SetDeduplication.restype = None
+_lib.BPELearner_SetDeduplication.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPELearner_SetPageHints.restype = None
+_lib.BPELearner_SetPageHints.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPELearner_SetReadBackend.restype = None
+_lib.BPELearner_SetReadBackend.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_uint64]
+
+_lib.BPELearner_SetIoUring.restype = None
+_lib.BPELearner_SetIoUring.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPELearner_SetSampling.restype = None
+_lib.BPELearner_SetSampling.argtypes = [ctypes.c_void_p, ctypes.c_double, ctypes.c_uint64, ctypes.c_uint64]
+
+#--------------------------------------------------------------------------------------------------
+# Page cache hints for mapped input files, combined as flags for SetPageHints
+PageHintPrefault = 1
+PageHintAdvise = 2
+PageHintHugePages = 4
+PageHintRelease = 8
+
+# How input files are read, for SetReadBackend
+ReadBackendMmap = 0
+ReadBackendPread = 1
+ReadBackendDirectIO = 2
+
+# How words are encoded, for SetEncoder. Both give the same tokens
+EncoderMerge = 0
+EncoderBacktrack = 1
+
 #--------------------------------------------------------------------------------------------------
 
 class BPELearner:
@@ -65,9 +110,50 @@ class BPELearner:
         
         _lib.BPELearner_LearnFromChunk(self.obj, vocabSize, c_strings, len(textChunks))
        
+    def LearnFromFiles(self, vocabSize, inputPaths: List[str]):
+        # Files, directories or file name patterns like "shards/*.txt"
+        c_strings = (ctypes.c_char_p * len(inputPaths))()
+        for i, s in enumerate(inputPaths):
+            c_strings[i] = s.encode('utf-8')
+
+        _lib.BPELearner_LearnFromFiles(self.obj, vocabSize, c_strings, len(inputPaths))
+
+    def LearnFromStream(self, vocabSize, fd):
+        # fd of a pipe or any other stream, e.g. sys.stdin.fileno()
+        _lib.BPELearner_LearnFromStream(self.obj, vocabSize, fd)
+
     def Save(self, outputFileName):
          _lib.BPELearner_Save(self.obj, outputFileName.encode('utf-8'))
 
+    def SetJsonlField(self, jsonField='text'):
+        # Read inputs as JSONL and learn from this field, None for plain text
+        _lib.BPELearner_SetJsonlField(self.obj, jsonField.encode('utf-8') if jsonField is not None else None)
+
+    # Modes of SetDeduplication
+    DedupNone = 0
+    DedupLines = 1
+    DedupDocuments = 2
+
+    def SetDeduplication(self, mode):
+        # Drop exact repeats of lines or JSONL documents before counting words
+        _lib.BPELearner_SetDeduplication(self.obj, mode)
+
+    def SetPageHints(self, flags):
+        # PageHint flags for mapped input files
+        _lib.BPELearner_SetPageHints(self.obj, flags)
+
+    def SetReadBackend(self, backend, windowBytes=0):
+        # ReadBackend of input files, windowBytes 0 for the default window size
+        _lib.BPELearner_SetReadBackend(self.obj, backend, windowBytes)
+
+    def SetIoUring(self, enable=True):
+        # Read small input files in batches through io_uring on Linux, they are mapped where it is not available
+        _lib.BPELearner_SetIoUring(self.obj, 1 if enable else 0)
+
+    def SetSampling(self, fraction=1.0, maxBytes=0, seed=0):
+        # Learn from a deterministic sample of the input: this fraction of the bytes, at most maxBytes (0 for no limit)
+        _lib.BPELearner_SetSampling(self.obj, fraction, maxBytes, seed)
+
 #--------------------------------------------------------------------------------------------------
 #--------------------------------------------------------------------------------------------------
 # Set up function prototypes
@@ -83,6 +169,36 @@ _lib.BPETokenizer_Encode.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
 _lib.BPETokenizer_EncodeFile.restype = ctypes.c_void_p
 _lib.BPETokenizer_EncodeFile.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
 
+_lib.BPETokenizer_EncodeStream.restype = None
+_lib.BPETokenizer_EncodeStream.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_char_p]
+
+_lib.BPETokenizer_SetJsonlField.restype = None
+_lib.BPETokenizer_SetJsonlField.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+
+_lib.BPETokenizer_SetPageHints.restype = None
+_lib.BPETokenizer_SetPageHints.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPETokenizer_SetReadBackend.restype = None
+_lib.BPETokenizer_SetReadBackend.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPETokenizer_SetEncoder.restype = None
+_lib.BPETokenizer_SetEncoder.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPETokenizer_SetCacheCapacity.restype = None
+_lib.BPETokenizer_SetCacheCapacity.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+
+_lib.BPETokenizer_GetCacheStats.restype = None
+_lib.BPETokenizer_GetCacheStats.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint64), ctypes.POINTER(ctypes.c_uint64)]
+
+_lib.BPETokenizer_SetDeduplicateWords.restype = None
+_lib.BPETokenizer_SetDeduplicateWords.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPETokenizer_SetFusedFileEncode.restype = None
+_lib.BPETokenizer_SetFusedFileEncode.argtypes = [ctypes.c_void_p, ctypes.c_int]
+
+_lib.BPETokenizer_SetEncodeCostPerThread.restype = None
+_lib.BPETokenizer_SetEncodeCostPerThread.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+
 _lib.BPETokenizer_EncodeWords.restype = ctypes.c_void_p
 _lib.BPETokenizer_EncodeWords.argtypes = [
     ctypes.c_void_p, 
@@ -119,6 +235,47 @@ class BPETokenizer:
     def EncodeFile(self, inputFileName, outputFileName):
          _lib.BPETokenizer_EncodeFile(self.obj, inputFileName.encode('utf-8'), outputFileName.encode('utf-8'))
 
+    def EncodeStream(self, fd, outputFileName):
+         _lib.BPETokenizer_EncodeStream(self.obj, fd, outputFileName.encode('utf-8'))
+
+    def SetJsonlField(self, jsonField='text'):
+        # Read inputs as JSONL and encode this field, None for plain text
+        _lib.BPETokenizer_SetJsonlField(self.obj, jsonField.encode('utf-8') if jsonField is not None else None)
+
+    def SetPageHints(self, flags):
+        # PageHint flags for the mapped input file, PageHintRelease is ignored
+        _lib.BPETokenizer_SetPageHints(self.obj, flags)
+
+    def SetReadBackend(self, backend):
+        # ReadBackend of the input file
+        _lib.BPETokenizer_SetReadBackend(self.obj, backend)
+
+    def SetEncoder(self, encoder):
+        # EncoderBacktrack is linear in the word length, for untrusted input
+        _lib.BPETokenizer_SetEncoder(self.obj, encoder)
+
+    def SetCacheCapacity(self, capacity):
+        # Words whose tokens are kept across calls, 0 turns the cache off
+        _lib.BPETokenizer_SetCacheCapacity(self.obj, capacity)
+
+    def GetCacheStats(self):
+        hits = ctypes.c_uint64()
+        misses = ctypes.c_uint64()
+        _lib.BPETokenizer_GetCacheStats(self.obj, ctypes.pointer(hits), ctypes.pointer(misses))
+        return hits.value, misses.value
+
+    def SetDeduplicateWords(self, deduplicate):
+        # Repeats of a word in one EncodeWords call are encoded once
+        _lib.BPETokenizer_SetDeduplicateWords(self.obj, 1 if deduplicate else 0)
+
+    def SetFusedFileEncode(self, fused):
+        # EncodeFile keeps only the tokens in memory, not every word of the file
+        _lib.BPETokenizer_SetFusedFileEncode(self.obj, 1 if fused else 0)
+
+    def SetEncodeCostPerThread(self, costPerThread):
+        # About bytes of input per encoding thread, 0 always starts all threads
+        _lib.BPETokenizer_SetEncodeCostPerThread(self.obj, costPerThread)
+
     def EncodeWords(self, input_words):
 
         input_words_c = (ctypes.c_char_p * len(input_words))(*[word.encode('utf-8') for word in input_words])
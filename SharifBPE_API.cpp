@@ -4,6 +4,27 @@
 
 //-------------------------------------------------------------------------------------------------
 
+static InputOptions WithJsonlField(InputOptions inputOptions, SharifBPE_ConstStr jsonField)
+{
+	inputOptions.InputFormat = jsonField != nullptr ? InputOptions::Format::Jsonl : InputOptions::Format::Text;
+	if (jsonField != nullptr)
+	{
+		inputOptions.JsonField = jsonField;
+	}
+	return inputOptions;
+}
+
+static InputOptions WithPageHints(InputOptions inputOptions, const int flags)
+{
+	inputOptions.PrefaultPages = (flags & SharifBPE_PageHint_Prefault) != 0;
+	inputOptions.AdviseSections = (flags & SharifBPE_PageHint_Advise) != 0;
+	inputOptions.HugePages = (flags & SharifBPE_PageHint_HugePages) != 0;
+	inputOptions.ReleaseSections = (flags & SharifBPE_PageHint_Release) != 0;
+	return inputOptions;
+}
+
+//-------------------------------------------------------------------------------------------------
+
 SHARIF_BPE_API BPELearnerHandle BPELearner_create()
 {
 	auto* aBPELearner = new BPELearner();
@@ -28,6 +49,29 @@ SHARIF_BPE_API void BPELearner_LearnFromFile(BPELearnerHandle handle, const unsi
 
 //-------------------------------------------------------------------------------------------------
 
+SHARIF_BPE_API void BPELearner_LearnFromFiles(BPELearnerHandle handle, const unsigned int vocabSize, SharifBPE_ConstStr* inputPaths, size_t count)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+
+	std::vector<std::string> inputPathsVec;
+	for (size_t i = 0; i < count; ++i)
+	{
+		inputPathsVec.emplace_back(inputPaths[i]);
+	}
+
+	aBPELearner->LearnFromFiles(vocabSize, inputPathsVec);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPELearner_LearnFromStream(BPELearnerHandle handle, const unsigned int vocabSize, int fd)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+	aBPELearner->LearnFromStream(vocabSize, fd);
+}
+
+//-------------------------------------------------------------------------------------------------
+
 SHARIF_BPE_API void BPELearner_LearnFromChunk(BPELearnerHandle handle, const unsigned int vocabSize, SharifBPE_ConstStr* textChunks, size_t count)
 {
 	auto* aBPELearner = static_cast<BPELearner*>(handle);
@@ -59,6 +103,69 @@ SHARIF_BPE_API BPETokenizerHandle BPETokenizer_create()
 
 //-------------------------------------------------------------------------------------------------
 
+SHARIF_BPE_API void BPELearner_SetJsonlField(BPELearnerHandle handle, SharifBPE_ConstStr jsonField)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+	aBPELearner->SetInputOptions(WithJsonlField(aBPELearner->GetInputOptions(), jsonField));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPELearner_SetDeduplication(BPELearnerHandle handle, int mode)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+
+	InputOptions inputOptions = aBPELearner->GetInputOptions();
+	inputOptions.Dedup = static_cast<InputOptions::Deduplication>(mode);
+	aBPELearner->SetInputOptions(inputOptions);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPELearner_SetPageHints(BPELearnerHandle handle, int flags)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+	aBPELearner->SetInputOptions(WithPageHints(aBPELearner->GetInputOptions(), flags));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPELearner_SetReadBackend(BPELearnerHandle handle, int backend, uint64_t windowBytes)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+
+	InputOptions inputOptions = aBPELearner->GetInputOptions();
+	inputOptions.ReadBackend = static_cast<WindowedFile::Backend>(backend);
+	inputOptions.WindowBytes = windowBytes;
+	aBPELearner->SetInputOptions(inputOptions);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPELearner_SetIoUring(BPELearnerHandle handle, int enable)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+
+	InputOptions inputOptions = aBPELearner->GetInputOptions();
+	inputOptions.UseIoUring = enable != 0;
+	aBPELearner->SetInputOptions(inputOptions);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPELearner_SetSampling(BPELearnerHandle handle, double fraction, uint64_t maxBytes, uint64_t seed)
+{
+	auto* aBPELearner = static_cast<BPELearner*>(handle);
+
+	InputOptions inputOptions = aBPELearner->GetInputOptions();
+	inputOptions.SampleFraction = fraction;
+	inputOptions.SampleBytes = maxBytes;
+	inputOptions.SampleSeed = seed;
+	aBPELearner->SetInputOptions(inputOptions);
+}
+
+//-------------------------------------------------------------------------------------------------
+
 SHARIF_BPE_API void BPETokenizer_destroy(BPETokenizerHandle handle)
 {
 	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
@@ -91,6 +198,91 @@ SHARIF_BPE_API void BPETokenizer_EncodeFile(BPETokenizerHandle handle, SharifBPE
 
 //-------------------------------------------------------------------------------------------------
 
+SHARIF_BPE_API void BPETokenizer_EncodeStream(BPETokenizerHandle handle, int fd, SharifBPE_ConstStr outputFileName)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->EncodeStream(fd, outputFileName);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetJsonlField(BPETokenizerHandle handle, SharifBPE_ConstStr jsonField)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetInputOptions(WithJsonlField(aBPETokenizer->GetInputOptions(), jsonField));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetPageHints(BPETokenizerHandle handle, int flags)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetInputOptions(WithPageHints(aBPETokenizer->GetInputOptions(), flags));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetReadBackend(BPETokenizerHandle handle, int backend)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+
+	InputOptions inputOptions = aBPETokenizer->GetInputOptions();
+	inputOptions.ReadBackend = static_cast<WindowedFile::Backend>(backend);
+	aBPETokenizer->SetInputOptions(inputOptions);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetEncoder(BPETokenizerHandle handle, int encoder)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetEncoder(static_cast<BPETokenizer::Encoder>(encoder));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetCacheCapacity(BPETokenizerHandle handle, uint64_t capacity)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetCacheCapacity(static_cast<size_t>(capacity));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_GetCacheStats(BPETokenizerHandle handle, uint64_t* outHits, uint64_t* outMisses)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	const PretokenCache::Stats stats = aBPETokenizer->GetCacheStats();
+	*outHits = stats.Hits;
+	*outMisses = stats.Misses;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetDeduplicateWords(BPETokenizerHandle handle, int deduplicate)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetDeduplicateWords(deduplicate != 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetFusedFileEncode(BPETokenizerHandle handle, int fused)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetFusedFileEncode(fused != 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+SHARIF_BPE_API void BPETokenizer_SetEncodeCostPerThread(BPETokenizerHandle handle, uint64_t costPerThread)
+{
+	auto* aBPETokenizer = static_cast<BPETokenizer*>(handle);
+	aBPETokenizer->SetEncodeCostPerThread(static_cast<size_t>(costPerThread));
+}
+
+//-------------------------------------------------------------------------------------------------
+
 SHARIF_BPE_API void BPETokenizer_EncodeWords(
 	BPETokenizerHandle handle, 
 	SharifBPE_ConstStr* inputWords, 
@@ -108,7 +300,7 @@ SHARIF_BPE_API void BPETokenizer_EncodeWords(
 		words.emplace_back(inputWords[i]);
 	}
 
-	std::vector<std::vector<uint32_t>> result;
+	EncodedWords result;
 
 	aBPETokenizer->Encode(words, result);
 
@@ -118,22 +310,24 @@ SHARIF_BPE_API void BPETokenizer_EncodeWords(
 	*outResult = new uint32_t * [resultSize];
 	*innerResultSizes = new size_t[resultSize];
 
-	// Allocate memory for each inner vector and copy data
-	for (size_t i = 0; i < result.size(); ++i) 
+	// The tokens of all words are one block, (*outResult)[i] points to those of word i
+	uint32_t* ids = resultSize != 0 ? new uint32_t[result.Ids.size() + 1] : nullptr;
+	std::copy(result.Ids.begin(), result.Ids.end(), ids);
+	for (size_t i = 0; i < resultSize; ++i) 
 	{
-		(*innerResultSizes)[i] = resultSize;
-		(*outResult)[i] = new uint32_t[resultSize];
-		std::copy(result[i].begin(), result[i].end(), (*outResult)[i]);
+		(*innerResultSizes)[i] = result[i].size();
+		(*outResult)[i] = ids + result.Offsets[i];
 	}
 }
 
 //-------------------------------------------------------------------------------------------------
 
-SHARIF_BPE_API void BPETokenizer_FreeResult(BPETokenizerHandle handle, uint32_t*** result, size_t outNumResults, size_t** innerResultSizes)
+SHARIF_BPE_API void BPETokenizer_FreeResult(BPETokenizerHandle handle, uint32_t** result, size_t outNumResults, size_t* innerResultSizes)
 {
-	for (size_t i = 0; i < outNumResults; ++i) 
+	// The first word points to the start of the token block
+	if (outNumResults != 0)
 	{
-		delete[] result[i];
+		delete[] result[0];
 	}
 	delete[] result;
 	delete[] innerResultSizes;
@@ -50,6 +50,21 @@ typedef char SharifBPE_Char;
 SHARIF_BPE_API
 typedef SharifBPE_Char const * SharifBPE_ConstStr;
 
+// Page cache hints for mapped input files, combined as flags
+#define SharifBPE_PageHint_Prefault		1	// read whole files in when they are mapped
+#define SharifBPE_PageHint_Advise		2	// sequential read ahead of each section
+#define SharifBPE_PageHint_HugePages	4	// transparent huge pages where the filesystem allows them
+#define SharifBPE_PageHint_Release		8	// drop the pages of each section once read
+
+// How input files are read
+#define SharifBPE_ReadBackend_Mmap		0	// map files
+#define SharifBPE_ReadBackend_Pread		1	// read windows into buffers with pread
+#define SharifBPE_ReadBackend_DirectIO	2	// same with O_DIRECT, bypassing the page cache
+
+// How words are encoded, both give the same tokens
+#define SharifBPE_Encoder_Merge			0	// replay the merges by rank, fastest on natural text
+#define SharifBPE_Encoder_Backtrack		1	// linear in the word length, for untrusted input
+
 //======================================================================
 
 //----------------------------------------------------------------------
@@ -65,8 +80,16 @@ SHARIF_BPE_API void BPELearner_destroy(BPELearnerHandle handle);
 
 // Member functions
 SHARIF_BPE_API void BPELearner_LearnFromFile(BPELearnerHandle handle, const unsigned int vocabSize, SharifBPE_ConstStr inputFileName);
+SHARIF_BPE_API void BPELearner_LearnFromFiles(BPELearnerHandle handle, const unsigned int vocabSize, SharifBPE_ConstStr* inputPaths, size_t count); // files, directories or file name patterns
+SHARIF_BPE_API void BPELearner_LearnFromStream(BPELearnerHandle handle, const unsigned int vocabSize, int fd); // pipe or any file descriptor, 0 for stdin
 SHARIF_BPE_API void BPELearner_LearnFromChunk(BPELearnerHandle handle, const unsigned int vocabSize, SharifBPE_ConstStr* textChunks, size_t count); // chunks are words splited by regEx
 SHARIF_BPE_API void BPELearner_Save(BPELearnerHandle handle, SharifBPE_ConstStr outputFileName);
+SHARIF_BPE_API void BPELearner_SetJsonlField(BPELearnerHandle handle, SharifBPE_ConstStr jsonField); // read JSONL and learn from this field, NULL for plain text
+SHARIF_BPE_API void BPELearner_SetDeduplication(BPELearnerHandle handle, int mode); // drop repeats before counting: 0 none, 1 lines, 2 documents
+SHARIF_BPE_API void BPELearner_SetPageHints(BPELearnerHandle handle, int flags); // SharifBPE_PageHint flags for mapped input files
+SHARIF_BPE_API void BPELearner_SetReadBackend(BPELearnerHandle handle, int backend, uint64_t windowBytes); // SharifBPE_ReadBackend, windowBytes 0 for the default
+SHARIF_BPE_API void BPELearner_SetIoUring(BPELearnerHandle handle, int enable); // read small files through io_uring on Linux, mapped otherwise
+SHARIF_BPE_API void BPELearner_SetSampling(BPELearnerHandle handle, double fraction, uint64_t maxBytes, uint64_t seed); // learn from a seeded sample of the input, fraction 1 and maxBytes 0 read everything
 
 //----------------------------------------------------------------------
 // BPETokenizer
@@ -83,8 +106,18 @@ SHARIF_BPE_API void BPETokenizer_destroy(BPETokenizerHandle handle);
 SHARIF_BPE_API void BPETokenizer_ReadModel(BPETokenizerHandle handle, SharifBPE_ConstStr modelFileName);
 SHARIF_BPE_API void BPETokenizer_Encode(BPETokenizerHandle handle, SharifBPE_ConstStr text);
 SHARIF_BPE_API void BPETokenizer_EncodeFile(BPETokenizerHandle handle, SharifBPE_ConstStr inputFileName, SharifBPE_ConstStr outputFileName);
+SHARIF_BPE_API void BPETokenizer_EncodeStream(BPETokenizerHandle handle, int fd, SharifBPE_ConstStr outputFileName);
+SHARIF_BPE_API void BPETokenizer_SetJsonlField(BPETokenizerHandle handle, SharifBPE_ConstStr jsonField); // read JSONL and encode this field, NULL for plain text
+SHARIF_BPE_API void BPETokenizer_SetPageHints(BPETokenizerHandle handle, int flags); // SharifBPE_PageHint flags, release is ignored
+SHARIF_BPE_API void BPETokenizer_SetReadBackend(BPETokenizerHandle handle, int backend); // SharifBPE_ReadBackend
+SHARIF_BPE_API void BPETokenizer_SetEncoder(BPETokenizerHandle handle, int encoder); // SharifBPE_Encoder
+SHARIF_BPE_API void BPETokenizer_SetCacheCapacity(BPETokenizerHandle handle, uint64_t capacity); // words of the pretoken cache, 0 for none
+SHARIF_BPE_API void BPETokenizer_GetCacheStats(BPETokenizerHandle handle, uint64_t* outHits, uint64_t* outMisses);
+SHARIF_BPE_API void BPETokenizer_SetDeduplicateWords(BPETokenizerHandle handle, int deduplicate); // encode repeats of a word in a batch once
+SHARIF_BPE_API void BPETokenizer_SetFusedFileEncode(BPETokenizerHandle handle, int fused); // EncodeFile encodes words as they are pretokenized, keeping no list of words
+SHARIF_BPE_API void BPETokenizer_SetEncodeCostPerThread(BPETokenizerHandle handle, uint64_t costPerThread); // about bytes of input per encoding thread, smaller batches run on the caller's thread, 0 always uses all threads
 SHARIF_BPE_API void BPETokenizer_EncodeWords(BPETokenizerHandle handle, SharifBPE_ConstStr* inputWords, size_t numWords, uint32_t*** outResult, size_t* outNumResults, size_t** innerResultSizes);
-SHARIF_BPE_API void BPETokenizer_FreeResult(BPETokenizerHandle handle, uint32_t*** result, size_t outNumResults, size_t** innerResultSizes);
+SHARIF_BPE_API void BPETokenizer_FreeResult(BPETokenizerHandle handle, uint32_t** result, size_t outNumResults, size_t* innerResultSizes); // the arrays EncodeWords returned
 
 //======================================================================
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// 64-bit string hash following the design of wyhash (public domain), strong enough for open
+// addressing with power of two tables and a few times faster than std::hash on short words.
+namespace StringHash
+{
+	inline constexpr uint64_t Secret[4] =
+	{
+		0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+	};
+
+	// 64x64 -> 128 bit multiply, folded to 64 bits.
+	inline uint64_t mix(uint64_t a, uint64_t b)
+	{
+#if defined(__SIZEOF_INT128__)
+		const __uint128_t r = static_cast<__uint128_t>(a) * b;
+		return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		uint64_t high;
+		const uint64_t low = _umul128(a, b, &high);
+		return low ^ high;
+#else
+		const uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+		const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+		const uint64_t t = rl + (rm0 << 32);
+		uint64_t c = t < rl;
+		const uint64_t low = t + (rm1 << 32);
+		c += low < t;
+		const uint64_t high = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+		return low ^ high;
+#endif
+	}
+
+	inline uint64_t read64(const unsigned char* p)
+	{
+		uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t read32(const unsigned char* p)
+	{
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	inline uint64_t Hash(const void* data, const size_t length, uint64_t seed = 0)
+	{
+		const auto* p = static_cast<const unsigned char*>(data);
+		seed ^= mix(seed ^ Secret[0], Secret[1]);
+
+		uint64_t a = 0, b = 0;
+		if (length <= 16)
+		{
+			if (length >= 4)
+			{
+				const size_t shift = (length >> 3) << 2;
+				a = (read32(p) << 32) | read32(p + shift);
+				b = (read32(p + length - 4) << 32) | read32(p + length - 4 - shift);
+			}
+			else if (length > 0)
+			{
+				a = (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[length >> 1]) << 8) | p[length - 1];
+			}
+		}
+		else
+		{
+			size_t i = length;
+			if (i > 48)
+			{
+				uint64_t see1 = seed, see2 = seed;
+				do
+				{
+					seed = mix(read64(p) ^ Secret[1], read64(p + 8) ^ seed);
+					see1 = mix(read64(p + 16) ^ Secret[2], read64(p + 24) ^ see1);
+					see2 = mix(read64(p + 32) ^ Secret[3], read64(p + 40) ^ see2);
+					p += 48;
+					i -= 48;
+				} while (i > 48);
+				seed ^= see1 ^ see2;
+			}
+
+			while (i > 16)
+			{
+				seed = mix(read64(p) ^ Secret[1], read64(p + 8) ^ seed);
+				i -= 16;
+				p += 16;
+			}
+
+			a = read64(p + i - 16);
+			b = read64(p + i - 8);
+		}
+
+		return mix(Secret[1] ^ length, mix(a ^ Secret[1], b ^ seed));
+	}
+}
+
+struct StringHasher
+{
+	size_t operator()(const std::string_view text) const
+	{
+		return static_cast<size_t>(StringHash::Hash(text.data(), text.size()));
+	}
+};
@@ -3,8 +3,13 @@
 //======================================================================
 
 #include "catch.hpp"
+#include "TestHelpers.h"
 
 #include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <filesystem>
 
 #include "BPELearner.h"
 #include "BPETokenizer.h"
@@ -20,6 +25,7 @@ TEST_CASE("BPELearner TestCase 1", "[BPELearner][0]")
 {
     BPELearner aBPELearner;
     aBPELearner.Learn(256 + 1, { "Hello", "He", "is", "Programmer" });
+    aBPELearner.Save("vocab.model");
 
     BPETokenizer bpeTokenizer;
     bpeTokenizer.ReadModel("vocab.model");
@@ -40,4 +46,91 @@ TEST_CASE("BPELearner TestCase 1", "[BPELearner][0]")
         std::cout << ']' << '\n';
     }
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("BPELearner pipelined ingestion", "[BPELearner][1]")
+{
+    const char* syllables[] = { "th", "e", "an", "in", "re", "on", "er", "'s", " ", " ", "\n", ".", "7", "\xD8\xB3", "\xD9\x84", "\xE4\xB8\xAD" };
+
+    const TempDirectory directory("pipelined");
+    const std::string textFileName = directory / "pipelined.txt";
+
+    std::mt19937 random(30);
+    std::string text;
+    for (int i = 0; i < 200000; ++i)
+    {
+        text += syllables[random() % std::size(syllables)];
+    }
+    WriteFile(textFileName, text);
+
+    auto learn = [&](const bool pipelined, const std::string& modelFileName)
+    {
+        BPELearner aBPELearner;
+        aBPELearner.SetPipelinedIngestion(pipelined);
+        aBPELearner.Learn(256 + 300, textFileName.c_str());
+        aBPELearner.Save(modelFileName);
+
+        std::ifstream modelFile(modelFileName);
+        return std::string(std::istreambuf_iterator<char>(modelFile), std::istreambuf_iterator<char>());
+    };
+
+    const std::string standardModel = learn(false, directory / "standard.model");
+    const std::string pipelinedModel = learn(true, directory / "pipelined.model");
+
+    REQUIRE(!standardModel.empty());
+    REQUIRE(pipelinedModel == standardModel);
+}
+
+TEST_CASE("BPELearner multiple files", "[BPELearner][1]")
+{
+    const char* words[] = { "the", "an", "inner", "order", "'s", "7", "42", "\xD8\xB3\xD9\x84", "\xE4\xB8\xAD", "!",
+        "pipeline", "tokenizer", "shards", "corpus" };
+
+    const TempDirectory directory("shards");
+    const std::filesystem::path shards = directory.GetPath() / "shards";
+    const std::string modelFileName = directory / "shards.model";
+
+    // Lines are not split between shards, so shards and the concatenated file have the same words.
+    std::filesystem::create_directories(shards);
+    std::ofstream wholeFile(directory / "shards_whole.txt", std::ios::binary);
+    std::mt19937 random(31);
+    for (int shard = 0; shard < 7; ++shard)
+    {
+        std::ofstream shardFile(shards / ("shard-" + std::to_string(shard) + ".txt"), std::ios::binary);
+        for (int line = 0; line < 500 + shard * 100; ++line)
+        {
+            std::string text = words[random() % std::size(words)];
+            for (int w = random() % 12; w > 0; --w)
+            {
+                text += ' ';
+                text += words[random() % std::size(words)];
+            }
+            text += '\n';
+
+            shardFile << text;
+            wholeFile << text;
+        }
+    }
+    wholeFile.close();
+
+    auto learn = [&](const std::vector<std::string>& inputPaths)
+    {
+        BPELearner aBPELearner;
+        aBPELearner.LearnFromFiles(256 + 40, inputPaths);
+        aBPELearner.Save(modelFileName);
+
+        std::ifstream modelFile(modelFileName);
+        return std::string(std::istreambuf_iterator<char>(modelFile), std::istreambuf_iterator<char>());
+    };
+
+    const auto shardPath = [&](const std::string& name) { return (shards / name).string(); };
+
+    const std::string wholeModel = learn({ directory / "shards_whole.txt" });
+    REQUIRE(!wholeModel.empty());
+    REQUIRE(learn({ shards.string() }) == wholeModel);
+    REQUIRE(learn({ shardPath("shard-*.txt") }) == wholeModel);
+
+    // Order of files does not change the counts
+    REQUIRE(learn({ shardPath("shard-4.txt"), shardPath("shard-0.txt"), shardPath("shard-1.txt"), shardPath("shard-2.txt"),
+        shardPath("shard-3.txt"), shardPath("shard-5.txt"), shardPath("shard-6.txt") }) == wholeModel);
+}
@@ -0,0 +1,597 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "BPELearner.h"
+#include "BPETokenizer.h"
+#include "SharifBPE_API.h"
+
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+// The merges of the model applied one rank at a time, every occurrence from left to right. Words that
+// are tokens of the model are that token.
+class ReferenceEncoder
+{
+public:
+
+    explicit ReferenceEncoder(const std::string& modelFileName)
+    {
+        std::vector<std::string> tokens;
+        for (uint32_t byte = 0; byte < BPETokenizer::InitialVocabSize; ++byte)
+        {
+            tokens.push_back(std::string(1, static_cast<char>(byte)));
+        }
+
+        std::ifstream modelFile(modelFileName);
+        uint32_t first, second;
+        while (modelFile >> first >> second)
+        {
+            const uint32_t rank = static_cast<uint32_t>(tokens.size());
+            mRanks[{ first, second }] = rank;
+            tokens.push_back(tokens[first] + tokens[second]);
+            mTokens[tokens.back()] = rank;
+        }
+    }
+
+    std::vector<uint32_t> Encode(const std::string& word) const
+    {
+        const auto token = mTokens.find(word);
+        if (token != mTokens.end())
+        {
+            return { token->second };
+        }
+
+        std::vector<uint32_t> ids(word.begin(), word.end());
+        for (uint32_t& id : ids)
+        {
+            id = static_cast<uint8_t>(id);
+        }
+
+        for (;;)
+        {
+            uint32_t minRank = std::numeric_limits<uint32_t>::max();
+            for (size_t i = 0; i + 1 < ids.size(); ++i)
+            {
+                const auto rank = mRanks.find({ ids[i], ids[i + 1] });
+                if (rank != mRanks.end() && rank->second < minRank)
+                {
+                    minRank = rank->second;
+                }
+            }
+            if (minRank == std::numeric_limits<uint32_t>::max())
+            {
+                return ids;
+            }
+
+            std::vector<uint32_t> merged;
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                const auto rank = i + 1 < ids.size() ? mRanks.find({ ids[i], ids[i + 1] }) : mRanks.end();
+                if (rank != mRanks.end() && rank->second == minRank)
+                {
+                    merged.push_back(minRank);
+                    ++i;
+                }
+                else
+                {
+                    merged.push_back(ids[i]);
+                }
+            }
+            ids = merged;
+        }
+    }
+
+private:
+
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> mRanks;
+    std::map<std::string, uint32_t> mTokens;
+};
+
+//======================================================================
+
+TEST_CASE("Long words encode like short ones", "[BPETokenizer][1]")
+{
+    std::mt19937 random(43);
+
+    const TempDirectory directory("long_words");
+    const LearnedModel model = LearnModel(43, 256 + 200, 100, directory, 3000);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+    const ReferenceEncoder reference(model.FileName);
+
+    // The batch is too small for the cost model to split, encode it on every thread anyway
+    tokenizer.SetEncodeCostPerThread(0);
+
+    // Lengths around the switch to the heap encoder and far above it
+    std::vector<std::string> words;
+    for (const size_t length : { 1, 2, 3, 10, 39, 40, 41, 64, 100, 1000, 5000 })
+    {
+        for (int i = 0; i < 20; ++i)
+        {
+            words.push_back(RandomWord(random, length));
+        }
+    }
+    words.push_back(std::string(3000, 'a'));
+    words.push_back(std::string(3001, 'a'));
+
+    const std::vector<std::string_view> wordViews(words.begin(), words.end());
+    std::vector<std::vector<uint32_t>> tokens;
+    tokenizer.Encode(wordViews, tokens);
+
+    REQUIRE(tokens.size() == words.size());
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        INFO("word " << i << " of " << words[i].size() << " bytes");
+        REQUIRE(tokens[i] == reference.Encode(words[i]));
+    }
+}
+
+TEST_CASE("Backtracking encoder gives the merge tokens", "[BPETokenizer][2]")
+{
+    std::mt19937 random(44);
+
+    // Merges of repeats and of syllables, with UTF-8 so tokens split inside characters
+    const char* syllables[] = { "th", "e", "an", "in", "re", "on", "er", "'s", " ", "\xD8\xB3", "\xD9\x84", "\xE4\xB8\xAD" };
+    std::vector<std::string> learnWords;
+    for (int i = 0; i < 3000; ++i)
+    {
+        learnWords.push_back(RandomWord(random, 1 + random() % 100));
+        std::string word;
+        for (uint32_t length = 1 + random() % 12; length > 0; --length)
+        {
+            word += syllables[random() % std::size(syllables)];
+        }
+        learnWords.push_back(word);
+    }
+
+    const TempDirectory directory("backtracking");
+    const std::string modelFileName = directory / "backtracking.model";
+
+    BPELearner learner;
+    learner.Learn(256 + 400, learnWords);
+    learner.Save(modelFileName);
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(modelFileName);
+
+    std::vector<std::string> words = learnWords;
+    for (const size_t length : { 2, 5, 40, 300, 4000 })
+    {
+        for (int i = 0; i < 20; ++i)
+        {
+            words.push_back(RandomWord(random, length));
+        }
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::string word;
+        for (uint32_t length = 1 + random() % 30; length > 0; --length)
+        {
+            word += syllables[random() % std::size(syllables)];
+        }
+        words.push_back(word.substr(random() % 2)); // Some start inside a character
+    }
+
+    const std::vector<std::string_view> wordViews(words.begin(), words.end());
+
+    std::vector<std::vector<uint32_t>> mergeTokens;
+    tokenizer.Encode(wordViews, mergeTokens);
+
+    tokenizer.SetEncoder(BPETokenizer::Encoder::Backtrack);
+    std::vector<std::vector<uint32_t>> backtrackTokens;
+    tokenizer.Encode(wordViews, backtrackTokens);
+
+    REQUIRE(backtrackTokens.size() == mergeTokens.size());
+    bool sameTokens = true;
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        sameTokens &= backtrackTokens[i] == mergeTokens[i];
+    }
+    REQUIRE(sameTokens);
+}
+
+TEST_CASE("Cached tokens are the encoded tokens", "[BPETokenizer][3]")
+{
+    std::mt19937 random(45);
+
+    const TempDirectory directory("cache");
+    const LearnedModel model = LearnModel(45, 256 + 200, 20, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+
+    // Every encoding thread, all sharing the cache
+    tokenizer.SetEncodeCostPerThread(0);
+
+    // Repeated words, and a few longer than the cache holds
+    std::vector<std::string> words;
+    for (int i = 0; i < 5000; ++i)
+    {
+        words.push_back(random() % 50 == 0 ? RandomWord(random, 100) : learnWords[random() % 300]);
+    }
+    const std::vector<std::string_view> wordViews(words.begin(), words.end());
+
+    std::vector<std::vector<uint32_t>> uncachedTokens;
+    tokenizer.Encode(wordViews, uncachedTokens);
+
+    // Small enough to evict while encoding
+    tokenizer.SetCacheCapacity(128);
+    for (const BPETokenizer::Encoder encoder : { BPETokenizer::Encoder::Merge, BPETokenizer::Encoder::Backtrack })
+    {
+        tokenizer.SetEncoder(encoder);
+        std::vector<std::vector<uint32_t>> cachedTokens;
+        tokenizer.Encode(wordViews, cachedTokens);
+        REQUIRE(cachedTokens == uncachedTokens);
+    }
+
+    const PretokenCache::Stats stats = tokenizer.GetCacheStats();
+    REQUIRE(stats.Hits > 0);
+    REQUIRE(stats.Evictions > 0);
+    REQUIRE(stats.Size <= 128);
+
+    tokenizer.SetCacheCapacity(0);
+    REQUIRE(tokenizer.GetCacheStats().Hits == 0);
+}
+
+TEST_CASE("Deduplicated words encode like the others", "[BPETokenizer][4]")
+{
+    std::mt19937 random(46);
+
+    const TempDirectory directory("dedup");
+    const LearnedModel model = LearnModel(46, 256 + 200, 20, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+
+    // Every encoding thread, so that repeats fall into different sections
+    tokenizer.SetEncodeCostPerThread(0);
+
+    // Repeats within and across the sections of the encoding threads, and single tokens
+    std::vector<std::string> words;
+    for (int i = 0; i < 5000; ++i)
+    {
+        words.push_back(random() % 10 == 0 ? std::string(1, 'a' + random() % 3) : learnWords[random() % 300]);
+    }
+    const std::vector<std::string_view> wordViews(words.begin(), words.end());
+
+    std::vector<std::vector<uint32_t>> tokens;
+    tokenizer.Encode(wordViews, tokens);
+
+    tokenizer.SetDeduplicateWords(true);
+    std::vector<std::vector<uint32_t>> deduplicatedTokens;
+    tokenizer.Encode(wordViews, deduplicatedTokens);
+
+    REQUIRE(deduplicatedTokens == tokens);
+}
+
+TEST_CASE("Encoded words hold the tokens of each word", "[BPETokenizer][5]")
+{
+    std::mt19937 random(47);
+
+    const TempDirectory directory("encoded_words");
+    const LearnedModel model = LearnModel(47, 256 + 200, 20, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+    const ReferenceEncoder reference(model.FileName);
+
+    // A batch, then a smaller one into the same buffers, with empty and long words
+    EncodedWords encoded;
+    for (const size_t wordCount : { 3000, 7 })
+    {
+        std::vector<std::string> words;
+        for (size_t i = 0; i < wordCount; ++i)
+        {
+            words.push_back(random() % 20 == 0 ? RandomWord(random, random() % 200) : learnWords[random() % learnWords.size()]);
+        }
+        const std::vector<std::string_view> wordViews(words.begin(), words.end());
+
+        tokenizer.Encode(wordViews, encoded);
+
+        REQUIRE(encoded.size() == words.size());
+        REQUIRE(encoded.Offsets.back() == encoded.Ids.size());
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            const std::vector<uint32_t> tokens(encoded[i].begin(), encoded[i].end());
+            REQUIRE(tokens == reference.Encode(words[i]));
+        }
+    }
+}
+
+TEST_CASE("C API returns the tokens of each word", "[BPETokenizer][6]")
+{
+    const TempDirectory directory("api");
+    const LearnedModel model = LearnModel(48, 256 + 50, 20, directory, 500);
+
+    const BPETokenizerHandle handle = BPETokenizer_create();
+    BPETokenizer_ReadModel(handle, model.FileName.c_str());
+
+    SharifBPE_ConstStr words[] = { "aaab", "b", "", "abababababab", "+/+/abc=" };
+    uint32_t** result = nullptr;
+    size_t resultCount = 0;
+    size_t* resultSizes = nullptr;
+    BPETokenizer_EncodeWords(handle, words, std::size(words), &result, &resultCount, &resultSizes);
+
+    const ReferenceEncoder reference(model.FileName);
+    REQUIRE(resultCount == std::size(words));
+    for (size_t i = 0; i < resultCount; ++i)
+    {
+        REQUIRE(std::vector<uint32_t>(result[i], result[i] + resultSizes[i]) == reference.Encode(words[i]));
+    }
+
+    BPETokenizer_FreeResult(handle, result, resultCount, resultSizes);
+    BPETokenizer_destroy(handle);
+}
+
+TEST_CASE("Interleaved word groups encode like single words", "[BPETokenizer][7]")
+{
+    std::mt19937 random(49);
+
+    const TempDirectory directory("interleave");
+    const LearnedModel model = LearnModel(49, 256 + 300, 30, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+
+    // Every encoding thread, each with groups of its own section
+    tokenizer.SetEncodeCostPerThread(0);
+
+    // Tokens, words of many merges and of none, long words, and a batch not a multiple of the group
+    std::vector<std::string> words;
+    for (int i = 0; i < 4001; ++i)
+    {
+        words.push_back(random() % 30 == 0 ? RandomWord(random, 1 + random() % 100) : learnWords[random() % learnWords.size()]);
+    }
+    const std::vector<std::string_view> wordViews(words.begin(), words.end());
+
+    EncodedWords tokens;
+    tokenizer.Encode(wordViews, tokens);
+
+    tokenizer.SetInterleaveWords(true);
+    for (const size_t cacheCapacity : { 0, 256 })
+    {
+        tokenizer.SetCacheCapacity(cacheCapacity);
+        EncodedWords interleavedTokens;
+        tokenizer.Encode(wordViews, interleavedTokens);
+
+        REQUIRE(interleavedTokens.Ids == tokens.Ids);
+        REQUIRE(interleavedTokens.Offsets == tokens.Offsets);
+    }
+}
+
+TEST_CASE("Fused EncodeFile writes the same tokens", "[BPETokenizer][8]")
+{
+    std::mt19937 random(50);
+
+    const TempDirectory directory("fused");
+    const LearnedModel model = LearnModel(50, 256 + 200, 20, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    // Several sections of words, spaces and line ends, and the same lines as JSONL documents
+    std::string text, jsonl;
+    for (int line = 0; line < 20000; ++line)
+    {
+        std::string lineText;
+        for (uint32_t i = random() % 12; i > 0; --i)
+        {
+            lineText += learnWords[random() % learnWords.size()] + (random() % 4 == 0 ? "  " : " ");
+        }
+        text += lineText + "\n";
+        jsonl += "{\"text\": \"" + lineText + "\"}\n";
+    }
+    WriteFile(directory / "fused.txt", text);
+    WriteFile(directory / "fused.jsonl", jsonl);
+
+    const auto readFile = [](const std::string& fileName)
+    {
+        std::ifstream file(fileName, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+
+    for (const bool isJsonl : { false, true })
+    {
+        InputOptions inputOptions;
+        inputOptions.InputFormat = isJsonl ? InputOptions::Format::Jsonl : InputOptions::Format::Text;
+        const std::string inputFileName = directory / (isJsonl ? "fused.jsonl" : "fused.txt");
+
+        BPETokenizer tokenizer;
+        tokenizer.ReadModel(model.FileName);
+        tokenizer.SetInputOptions(inputOptions);
+        tokenizer.EncodeFile(inputFileName, directory / "unfused.tokens");
+
+        tokenizer.SetFusedFileEncode(true);
+        tokenizer.EncodeFile(inputFileName, directory / "fused.tokens");
+
+        const std::string tokens = readFile(directory / "unfused.tokens");
+        REQUIRE(!tokens.empty());
+        REQUIRE(readFile(directory / "fused.tokens") == tokens);
+    }
+}
+
+TEST_CASE("Encode gives the same tokens on any number of threads", "[BPETokenizer][9]")
+{
+    std::mt19937 random(51);
+
+    const TempDirectory directory("threads");
+    const LearnedModel model = LearnModel(51, 256 + 200, 20, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+
+    // Empty, tiny and larger batches, fewer words than threads included
+    for (const size_t wordCount : { 0, 1, 3, 5, 1000, 50000 })
+    {
+        std::vector<std::string> words;
+        for (size_t i = 0; i < wordCount; ++i)
+        {
+            words.push_back(learnWords[random() % learnWords.size()]);
+        }
+        const std::vector<std::string_view> wordViews(words.begin(), words.end());
+
+        // All threads always, one thread per word, and the default cost model
+        std::vector<EncodedWords> results;
+        for (const size_t costPerThread : { size_t(0), size_t(1), BPETokenizer::DefaultEncodeCostPerThread })
+        {
+            tokenizer.SetEncodeCostPerThread(costPerThread);
+            results.emplace_back();
+            tokenizer.Encode(wordViews, results.back());
+
+            REQUIRE(results.back().size() == wordCount);
+            REQUIRE(results.back().Ids == results.front().Ids);
+            REQUIRE(results.back().Offsets == results.front().Offsets);
+        }
+    }
+}
+
+TEST_CASE("Concurrent Encode calls give the tokens of each batch", "[BPETokenizer][10]")
+{
+    std::mt19937 random(52);
+
+    const TempDirectory directory("concurrent");
+    const LearnedModel model = LearnModel(52, 256 + 200, 20, directory);
+    const std::vector<std::string>& learnWords = model.Words;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+
+    // All encoding threads for every batch, so both calls split their batches at once
+    tokenizer.SetEncodeCostPerThread(0);
+
+    // A batch per caller, of different sizes so their sections differ
+    std::vector<std::vector<std::string>> batches(2);
+    for (size_t batch = 0; batch < batches.size(); ++batch)
+    {
+        for (size_t i = 0; i < 20000 + batch * 7777; ++i)
+        {
+            batches[batch].push_back(learnWords[random() % learnWords.size()]);
+        }
+    }
+
+    std::vector<EncodedWords> expected(batches.size());
+    for (size_t batch = 0; batch < batches.size(); ++batch)
+    {
+        const std::vector<std::string_view> wordViews(batches[batch].begin(), batches[batch].end());
+        tokenizer.Encode(wordViews, expected[batch]);
+    }
+
+    // Rounds that gave other tokens, one counter per caller
+    std::vector<int> mismatches(batches.size(), 0);
+    std::vector<std::thread> callers;
+    for (size_t batch = 0; batch < batches.size(); ++batch)
+    {
+        callers.emplace_back([&, batch]()
+        {
+            const std::vector<std::string_view> wordViews(batches[batch].begin(), batches[batch].end());
+            EncodedWords encoded;
+            for (int round = 0; round < 20; ++round)
+            {
+                tokenizer.Encode(wordViews, encoded);
+                mismatches[batch] += encoded.Ids != expected[batch].Ids || encoded.Offsets != expected[batch].Offsets;
+            }
+        });
+    }
+    for (auto& caller : callers)
+    {
+        caller.join();
+    }
+
+    REQUIRE(mismatches == std::vector<int>{ 0, 0 });
+}
+
+TEST_CASE("Reading another model drops the cached tokens", "[BPETokenizer][11]")
+{
+    // Two models of the same words with different numbers of merges
+    const TempDirectory directory("reload");
+    const LearnedModel firstModel = LearnModel(53, 256 + 300, 20, directory);
+    const LearnedModel secondModel = LearnModel(53, 256 + 100, 20, directory);
+    const std::vector<std::string>& learnWords = firstModel.Words;
+
+    const std::vector<std::string_view> wordViews(learnWords.begin(), learnWords.end());
+
+    BPETokenizer tokenizer;
+    tokenizer.SetCacheCapacity(1 << 14);
+    tokenizer.ReadModel(firstModel.FileName);
+    std::vector<std::vector<uint32_t>> firstTokens;
+    tokenizer.Encode(wordViews, firstTokens);
+
+    tokenizer.ReadModel(secondModel.FileName);
+    REQUIRE(tokenizer.GetCacheStats().Size == 0);
+
+    std::vector<std::vector<uint32_t>> secondTokens;
+    tokenizer.Encode(wordViews, secondTokens);
+    REQUIRE(secondTokens != firstTokens);
+
+    const ReferenceEncoder reference(secondModel.FileName);
+    for (size_t i = 0; i < learnWords.size(); ++i)
+    {
+        REQUIRE(secondTokens[i] == reference.Encode(learnWords[i]));
+    }
+}
+
+TEST_CASE("EncodeFile writes no document ends of an earlier file", "[BPETokenizer][12]")
+{
+    const TempDirectory directory("document_ends");
+    const LearnedModel model = LearnModel(54, 256 + 100, 20, directory);
+
+    WriteFile(directory / "documents.jsonl", "{\"text\": \"ab ba\"}\n{\"text\": \"abc\"}\n");
+    WriteFile(directory / "empty.jsonl", "");
+
+    InputOptions inputOptions;
+    inputOptions.InputFormat = InputOptions::Format::Jsonl;
+
+    BPETokenizer tokenizer;
+    tokenizer.ReadModel(model.FileName);
+    tokenizer.SetInputOptions(inputOptions);
+    tokenizer.EncodeFile(directory / "documents.jsonl", directory / "documents.tokens");
+    tokenizer.EncodeFile(directory / "empty.jsonl", directory / "empty.tokens");
+
+    REQUIRE(std::filesystem::file_size(directory / "documents.tokens") > 0);
+    REQUIRE(std::filesystem::file_size(directory / "empty.tokens") == 0);
+}
+
+TEST_CASE("Backtracking encoder follows the model read", "[BPETokenizer][13]")
+{
+    // Selected before any model, then kept while another model is read
+    const TempDirectory directory("backtracking_reload");
+    const LearnedModel firstModel = LearnModel(61, 256 + 300, 30, directory);
+    const LearnedModel secondModel = LearnModel(62, 256 + 200, 30, directory);
+
+    BPETokenizer tokenizer;
+    tokenizer.SetEncoder(BPETokenizer::Encoder::Backtrack);
+
+    for (const LearnedModel* model : { &firstModel, &secondModel })
+    {
+        tokenizer.ReadModel(model->FileName);
+
+        const std::vector<std::string_view> wordViews(model->Words.begin(), model->Words.end());
+        std::vector<std::vector<uint32_t>> tokens;
+        tokenizer.Encode(wordViews, tokens);
+
+        const ReferenceEncoder reference(model->FileName);
+        bool sameTokens = true;
+        for (size_t i = 0; i < model->Words.size(); ++i)
+        {
+            sameTokens &= tokens[i] == reference.Encode(model->Words[i]);
+        }
+        REQUIRE(sameTokens);
+    }
+}
@@ -0,0 +1,53 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+
+#include "CorpusPaths.h"
+
+#include <filesystem>
+#include <fstream>
+
+//======================================================================
+
+TEST_CASE("Wildcard match", "[CorpusPaths][0]")
+{
+    REQUIRE(CorpusPaths::MatchWildcard("*.txt", "shard-001.txt"));
+    REQUIRE(CorpusPaths::MatchWildcard("shard-???.txt", "shard-001.txt"));
+    REQUIRE(CorpusPaths::MatchWildcard("*", ""));
+    REQUIRE(CorpusPaths::MatchWildcard("a*b*c", "aXbYbZc"));
+    REQUIRE(!CorpusPaths::MatchWildcard("*.txt", "shard-001.txt.gz"));
+    REQUIRE(!CorpusPaths::MatchWildcard("shard-??.txt", "shard-001.txt"));
+    REQUIRE(!CorpusPaths::MatchWildcard("a*b*c", "aXbYbZ"));
+}
+
+TEST_CASE("Expand corpus paths", "[CorpusPaths][1]")
+{
+    namespace fs = std::filesystem;
+
+    const fs::path root = "corpus_paths_test";
+    fs::remove_all(root);
+    fs::create_directories(root / "nested");
+    for (const char* name : { "b.txt", "a.txt", "c.json", "nested/d.txt" })
+    {
+        std::ofstream(root / name) << "text\n";
+    }
+
+    const auto fileNames = [](const std::vector<std::string>& paths)
+    {
+        std::vector<std::string> names;
+        for (const auto& path : paths)
+        {
+            names.push_back(fs::path(path).filename().string());
+        }
+        return names;
+    };
+
+    REQUIRE(fileNames(CorpusPaths::Expand({ (root / "*.txt").string() })) == std::vector<std::string>{ "a.txt", "b.txt" });
+    REQUIRE(fileNames(CorpusPaths::Expand({ root.string() })) == std::vector<std::string>{ "a.txt", "b.txt", "c.json", "d.txt" });
+    REQUIRE(CorpusPaths::Expand({ "plain.txt" }) == std::vector<std::string>{ "plain.txt" });
+    REQUIRE_THROWS(CorpusPaths::Expand({ (root / "*.csv").string() }));
+
+    fs::remove_all(root);
+}
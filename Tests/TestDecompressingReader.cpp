@@ -0,0 +1,177 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "DecompressingReader.h"
+#include "MultiThreadFileReader.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef SHARIF_BPE_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef SHARIF_BPE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+//======================================================================
+//----------------------------------------------------------------------
+
+static std::string Decompress(const std::string& data, const uint32_t threadCount)
+{
+    DecompressingReader decompressor(data.data(), data.size(), threadCount);
+
+    std::string text;
+    char buffer[4096];
+    for (size_t length = decompressor.Read(buffer, sizeof(buffer)); length > 0; length = decompressor.Read(buffer, sizeof(buffer)))
+    {
+        text.append(buffer, length);
+    }
+    return text;
+}
+
+static void RequireSameCounts(const std::string& plainFileName, const std::string& compressedFileName)
+{
+    std::vector<MultiThreadFileReader::MapType> plainCounts;
+    MultiThreadFileReader plainReader;
+    plainReader.ReadText(plainFileName, plainCounts);
+
+    std::vector<MultiThreadFileReader::MapType> compressedCounts;
+    MultiThreadFileReader compressedReader;
+    compressedReader.ReadText(compressedFileName, compressedCounts);
+
+    RequireSameCounts(plainCounts, compressedCounts);
+}
+
+#ifdef SHARIF_BPE_WITH_ZLIB
+
+static std::string Gzip(const std::string_view text)
+{
+    z_stream stream = {};
+    REQUIRE(deflateInit2(&stream, 1, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+
+    std::string compressed(deflateBound(&stream, static_cast<uLong>(text.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+    stream.avail_in = static_cast<uInt>(text.size());
+    stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    stream.avail_out = static_cast<uInt>(compressed.size());
+
+    REQUIRE(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return compressed;
+}
+
+// Same layout as bgzip: gzip members of at most 64 KB with their size in a 'BC' extra field.
+static std::string Bgzf(const std::string_view text)
+{
+    constexpr size_t BlockLength = 60000;
+
+    std::string compressed;
+    for (size_t begin = 0; begin < text.size(); begin += BlockLength)
+    {
+        const std::string member = Gzip(text.substr(begin, BlockLength));
+
+        // Rebuild the header with the extra field, keep deflate data and trailer.
+        const size_t memberSize = member.size() + 8;
+        const unsigned char header[] = {
+            0x1F, 0x8B, 8, 0x04, 0, 0, 0, 0, 0, 0xFF, 6, 0,
+            'B', 'C', 2, 0, static_cast<unsigned char>((memberSize - 1) & 0xFF), static_cast<unsigned char>((memberSize - 1) >> 8)
+        };
+        compressed.append(reinterpret_cast<const char*>(header), sizeof(header));
+        compressed.append(member, 10);
+    }
+    return compressed;
+}
+
+//======================================================================
+
+TEST_CASE("Decompress gzip stream", "[Decompress][1]")
+{
+    const std::string text = RandomWords(40, 300000);
+    const std::string compressed = Gzip(text);
+
+    REQUIRE(DecompressingReader::Detect(compressed.data(), compressed.size()) == DecompressingReader::Format::Gzip);
+    REQUIRE(DecompressingReader::Detect(text.data(), text.size()) == DecompressingReader::Format::None);
+
+    DecompressingReader decompressor(compressed.data(), compressed.size(), 4);
+    REQUIRE_FALSE(decompressor.IsParallel());
+
+    REQUIRE(Decompress(compressed, 4) == text);
+
+    // Concatenated members, as written by `cat a.gz b.gz`
+    REQUIRE(Decompress(compressed + Gzip("end\n"), 4) == text + "end\n");
+}
+
+TEST_CASE("Decompress BGZF blocks in parallel", "[Decompress][2]")
+{
+    const std::string text = RandomWords(41, 3 << 20);
+    const std::string compressed = Bgzf(text);
+
+    DecompressingReader decompressor(compressed.data(), compressed.size(), 4);
+    REQUIRE(decompressor.IsParallel());
+
+    REQUIRE(Decompress(compressed, 4) == text);
+    REQUIRE(Decompress(compressed, 1) == text);
+}
+
+TEST_CASE("Decompress truncated gzip", "[Decompress][3]")
+{
+    const std::string compressed = Gzip(RandomWords(42, 100000));
+    REQUIRE_THROWS_AS(Decompress(compressed.substr(0, compressed.size() / 2), 4), std::runtime_error);
+}
+
+TEST_CASE("Read word counts from gzip files", "[Decompress][4]")
+{
+    const TempDirectory directory("compressed");
+
+    const std::string text = RandomWords(43, 3 << 20);
+    WriteFile(directory / "compressed.txt", text);
+    WriteFile(directory / "compressed.txt.gz", Gzip(text));
+    WriteFile(directory / "compressed.bgzf.gz", Bgzf(text));
+
+    RequireSameCounts(directory / "compressed.txt", directory / "compressed.txt.gz");
+    RequireSameCounts(directory / "compressed.txt", directory / "compressed.bgzf.gz");
+}
+
+#endif
+
+#ifdef SHARIF_BPE_WITH_ZSTD
+
+TEST_CASE("Decompress zstd frames in parallel", "[Decompress][5]")
+{
+    const std::string text = RandomWords(44, 3 << 20);
+
+    // One frame per 256 KB of text, as written by zstd --long or pzstd
+    std::string compressed;
+    for (size_t begin = 0; begin < text.size(); begin += 1 << 18)
+    {
+        const std::string_view piece = std::string_view(text).substr(begin, 1 << 18);
+        std::string frame(ZSTD_compressBound(piece.size()), '\0');
+        const size_t frameSize = ZSTD_compress(frame.data(), frame.size(), piece.data(), piece.size(), 1);
+        REQUIRE_FALSE(ZSTD_isError(frameSize));
+        compressed.append(frame.data(), frameSize);
+    }
+
+    REQUIRE(DecompressingReader::Detect(compressed.data(), compressed.size()) == DecompressingReader::Format::Zstd);
+
+    DecompressingReader decompressor(compressed.data(), compressed.size(), 4);
+    REQUIRE(decompressor.IsParallel());
+
+    REQUIRE(Decompress(compressed, 4) == text);
+    REQUIRE(Decompress(compressed, 1) == text);
+    REQUIRE_THROWS_AS(Decompress(compressed.substr(0, compressed.size() - 100), 1), std::runtime_error);
+
+    const TempDirectory directory("compressed");
+    WriteFile(directory / "compressed.txt", text);
+    WriteFile(directory / "compressed.txt.zst", compressed);
+    RequireSameCounts(directory / "compressed.txt", directory / "compressed.txt.zst");
+}
+
+#endif
@@ -0,0 +1,216 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "ConcurrentHashSet.h"
+#include "MultiThreadFileReader.h"
+#include "PreTokenizer.h"
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+static WordCounts CountWords(const std::string_view text)
+{
+    WordCounts counts;
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+    {
+        counts[std::string(word)]++;
+    });
+    return counts;
+}
+
+// Lines drawn from a small pool, so most of them repeat. Every line ends with a visible character,
+// pretokens never span two lines.
+static std::vector<std::string> RandomLines(const uint32_t seed, const size_t count)
+{
+    std::mt19937 random(seed);
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint32_t pick = random() % 3000;
+        lines.push_back("line " + std::to_string(pick) + " says " + std::string(1 + pick % 7, 'a' + pick % 26) + "!");
+    }
+    return lines;
+}
+
+//======================================================================
+
+TEST_CASE("Concurrent hash set", "[Dedup][1]")
+{
+    constexpr uint32_t ThreadCount = 4;
+    constexpr uint64_t Range = 100000;
+
+    ConcurrentHashSet set;
+    std::atomic<size_t> inserted = 0;
+
+    // Threads insert overlapping ranges, each value must be new exactly once.
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < ThreadCount; ++t)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (uint64_t i = t * Range / 2; i < t * Range / 2 + Range; ++i)
+            {
+                if (set.Insert(i * 0x9E3779B97F4A7C15ull))
+                {
+                    ++inserted;
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const size_t expected = (ThreadCount - 1) * Range / 2 + Range;
+    REQUIRE(inserted == expected);
+    REQUIRE(set.size() == expected);
+    REQUIRE_FALSE(set.Insert(0x9E3779B97F4A7C15ull));
+}
+
+TEST_CASE("Drop duplicate lines", "[Dedup][2]")
+{
+    // Under MinSectionLength, one section is read in order and the first copy of a line is kept.
+    const std::vector<std::string> lines = RandomLines(60, 20000);
+
+    // Each kept line is pretokenized on its own, with its line end.
+    std::string text;
+    WordCounts expected;
+    std::unordered_set<std::string> seen;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        if (i % 10 == 0)
+        {
+            // Blank lines are never dropped
+            text += "\n";
+            expected["\n"]++;
+        }
+
+        text += lines[i] + "\n";
+        if (seen.insert(lines[i]).second)
+        {
+            for (const auto& [word, count] : CountWords(lines[i] + "\n"))
+            {
+                expected[word] += count;
+            }
+        }
+    }
+
+    const TempDirectory directory("duplicates");
+    const std::string fileName = directory / "duplicates.txt";
+    WriteFile(fileName, text);
+
+    InputOptions inputOptions;
+    REQUIRE(ReadCounts(fileName, inputOptions) == CountWords(text));
+
+    inputOptions.Dedup = InputOptions::Deduplication::Lines;
+    REQUIRE(ReadCounts(fileName, inputOptions) == expected);
+}
+
+TEST_CASE("Drop duplicate lines across sections", "[Dedup][3]")
+{
+    // Sections race for the first copy of a line, without blank lines the words do not depend on it.
+    const std::vector<std::string> lines = RandomLines(61, 200000);
+
+    std::string text;
+    std::string uniqueText;
+    std::unordered_set<std::string> seen;
+    for (const auto& line : lines)
+    {
+        text += line + "\n";
+        if (seen.insert(line).second)
+        {
+            uniqueText += line + "\n";
+        }
+    }
+
+    const TempDirectory directory("duplicates");
+    const std::string fileName = directory / "duplicates.txt";
+    WriteFile(fileName, text);
+
+    InputOptions inputOptions;
+    inputOptions.Dedup = InputOptions::Deduplication::Lines;
+    REQUIRE(ReadCounts(fileName, inputOptions) == CountWords(uniqueText));
+}
+
+TEST_CASE("Drop duplicate JSONL documents", "[Dedup][4]")
+{
+    const std::vector<std::string> lines = RandomLines(62, 100000);
+
+    // Documents of two lines, many of them seen before.
+    std::string jsonl;
+    std::string uniqueText;
+    std::unordered_set<std::string> seen;
+    for (size_t i = 0; i + 1 < lines.size(); i += 2)
+    {
+        const std::string document = lines[i] + "\n" + lines[i + 1].substr(0, 6);
+        jsonl += "{\"id\": " + std::to_string(i) + ", \"text\": \"" + lines[i] + "\\n" + lines[i + 1].substr(0, 6) + "\"}\n";
+        if (seen.insert(document).second)
+        {
+            uniqueText += document + "\n";
+        }
+    }
+
+    const TempDirectory directory("duplicates");
+    const std::string fileName = directory / "duplicates.jsonl";
+    WriteFile(fileName, jsonl);
+
+    InputOptions inputOptions;
+    inputOptions.InputFormat = InputOptions::Format::Jsonl;
+    inputOptions.Dedup = InputOptions::Deduplication::Documents;
+
+    // Each document is pretokenized alone, the line ends added between documents here are the only
+    // difference: remove their count.
+    WordCounts expected = CountWords(uniqueText);
+    if ((expected["\n"] -= static_cast<uint32_t>(seen.size())) == 0)
+    {
+        expected.erase("\n");
+    }
+
+    REQUIRE(ReadCounts(fileName, inputOptions) == expected);
+}
+
+TEST_CASE("Dropped lines do not change the words of kept ones", "[Dedup][5]")
+{
+    // Lines that start with whitespace pretokenize differently after a line end than after another
+    // line's words, and sections race for the first copy of each.
+    std::mt19937 random(63);
+    std::string text;
+    WordCounts expected;
+    std::unordered_set<std::string> seen;
+    for (const auto& line : RandomLines(64, 200000))
+    {
+        const std::string indentedLine = std::string(random() % 3, ' ') + line + "\n";
+        text += indentedLine;
+        if (seen.insert(indentedLine).second)
+        {
+            for (const auto& [word, count] : CountWords(indentedLine))
+            {
+                expected[word] += count;
+            }
+        }
+    }
+
+    const TempDirectory directory("duplicates");
+    const std::string fileName = directory / "duplicates.txt";
+    WriteFile(fileName, text);
+
+    InputOptions inputOptions;
+    inputOptions.Dedup = InputOptions::Deduplication::Lines;
+    const WordCounts counts = ReadCounts(fileName, inputOptions);
+    REQUIRE(counts == expected);
+    REQUIRE(ReadCounts(fileName, inputOptions) == counts);
+}
@@ -0,0 +1,103 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+
+#include "FlatStringMap.h"
+
+#include <string>
+#include <vector>
+#include <random>
+#include <unordered_map>
+
+//======================================================================
+
+TEST_CASE("String hash", "[FlatStringMap][0]")
+{
+    const std::string text = "the quick brown fox jumps over the lazy dog, again and again and again";
+
+    // Every length takes a different read path, all of them must see every byte.
+    for (size_t length = 0; length <= text.size(); ++length)
+    {
+        std::string changed = text.substr(0, length);
+        const uint64_t hash = StringHash::Hash(changed.data(), changed.size());
+        REQUIRE(hash == StringHash::Hash(text.data(), length));
+
+        for (size_t i = 0; i < length; ++i)
+        {
+            changed[i] ^= 1;
+            REQUIRE(StringHash::Hash(changed.data(), changed.size()) != hash);
+            changed[i] ^= 1;
+        }
+    }
+
+    REQUIRE(FlatStringCountMap::Hash("") != 0);
+}
+
+TEST_CASE("Flat string map counts like unordered_map", "[FlatStringMap][1]")
+{
+    std::mt19937 random(29);
+    std::vector<std::string> words;
+    for (int i = 0; i < 5000; ++i)
+    {
+        words.emplace_back(std::string(random() % 24, 'a' + random() % 3) + std::to_string(random() % 97));
+    }
+
+    FlatStringCountMap wordCount;
+    std::unordered_map<std::string_view, uint32_t> expected;
+    for (int i = 0; i < 100000; ++i)
+    {
+        const std::string& word = words[random() % words.size()];
+        wordCount[word]++;
+        expected[word]++;
+    }
+
+    REQUIRE(wordCount.size() == expected.size());
+    REQUIRE(wordCount.capacity() >= wordCount.size());
+
+    size_t visited = 0;
+    for (const auto& [word, count] : wordCount)
+    {
+        REQUIRE(expected.at(word) == count);
+        ++visited;
+    }
+    REQUIRE(visited == expected.size());
+
+    REQUIRE(wordCount.Find("not a word") == nullptr);
+    REQUIRE(*wordCount.Find(words[0]) == expected[words[0]]);
+}
+
+TEST_CASE("Flat string map interned keys and merge", "[FlatStringMap][1]")
+{
+    FlatStringCountMap merged(FlatStringCountMap::KeyStorage::Interned);
+    {
+        FlatStringCountMap first(FlatStringCountMap::KeyStorage::Interned);
+        FlatStringCountMap second(FlatStringCountMap::KeyStorage::Interned);
+        for (int i = 0; i < 1000; ++i)
+        {
+            std::string word = "word" + std::to_string(i);
+            first[word] += 1;
+            if (i % 2 == 0)
+            {
+                second[word] += 2;
+            }
+        }
+
+        // Key longer than an arena block
+        std::string longWord(3 << 20, 'x');
+        second[longWord] = 5;
+        longWord.assign(longWord.size(), 'y');
+
+        merged.Merge(std::move(first));
+        merged.Merge(std::move(second));
+        REQUIRE(first.empty());
+        REQUIRE(second.empty());
+    } // Source strings and maps are gone, keys live in the arena of merged.
+
+    REQUIRE(merged.size() == 1001);
+    REQUIRE(*merged.Find("word0") == 3);
+    REQUIRE(*merged.Find("word1") == 1);
+    REQUIRE(*merged.Find("word998") == 3);
+    REQUIRE(*merged.Find(std::string(3 << 20, 'x')) == 5);
+}
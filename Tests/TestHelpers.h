@@ -0,0 +1,182 @@
+//======================================================================
+// Text generators, temporary files and count comparisons shared by the tests.
+//======================================================================
+
+#pragma once
+
+#include "catch.hpp"
+
+#include "BPELearner.h"
+#include "MultiThreadFileReader.h"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+// Directory under the system temp path, removed with its files when the test ends.
+class TempDirectory
+{
+public:
+
+    explicit TempDirectory(const std::string& name)
+        : mPath(std::filesystem::temp_directory_path() / ("sharif_bpe_" + name))
+    {
+        std::filesystem::remove_all(mPath);
+        std::filesystem::create_directories(mPath);
+    }
+
+    ~TempDirectory()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(mPath, error);
+    }
+
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    const std::filesystem::path& GetPath() const { return mPath; }
+
+    std::string operator/(const std::string& fileName) const { return (mPath / fileName).string(); }
+
+private:
+
+    std::filesystem::path mPath;
+};
+
+//----------------------------------------------------------------------
+
+// Short words separated by whitespace runs, digits, punctuation and multibyte characters. With
+// longRuns, a few stretches of 100 to 200 KB have no split point.
+inline std::string RandomText(const uint32_t seed, const size_t size, const bool longRuns = false)
+{
+    const char* pieces[] = { " ", "  ", "\n", "\n\n", " \n", "\t", "42", "'s", "!", "\xD8\xB3\xD9\x84", " \xE4\xB8\xAD", "\xE3\x80\x80" };
+
+    std::mt19937 random(seed);
+    std::string text;
+    while (text.size() < size)
+    {
+        if (longRuns && random() % 5000 == 0)
+        {
+            text += std::string(100000 + random() % 100000, 'x');
+        }
+
+        for (uint32_t length = 1 + random() % 8; length > 0; --length)
+        {
+            text += static_cast<char>('a' + random() % 26);
+        }
+        text += pieces[random() % std::size(pieces)];
+    }
+    return text;
+}
+
+// Words of random letters on lines of about ten words, so the text does not compress too well.
+inline std::string RandomWords(const uint32_t seed, const size_t size)
+{
+    std::mt19937 random(seed);
+    std::string text;
+    while (text.size() < size)
+    {
+        const uint32_t length = 1 + random() % 8;
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            text += static_cast<char>('a' + random() % 26);
+        }
+        text += random() % 10 == 0 ? '\n' : ' ';
+    }
+    return text;
+}
+
+inline void WriteFile(const std::string& fileName, const std::string& content)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    file << content;
+}
+
+// Partition by partition, as reading the same words must give.
+inline void RequireSameCounts(const std::vector<MultiThreadFileReader::MapType>& expectedCounts, const std::vector<MultiThreadFileReader::MapType>& wordCounts)
+{
+    REQUIRE(wordCounts.size() == expectedCounts.size());
+
+    // One REQUIRE per word would flood the test log
+    bool sameCounts = true;
+    for (size_t partition = 0; partition < expectedCounts.size(); ++partition)
+    {
+        sameCounts &= wordCounts[partition].size() == expectedCounts[partition].size();
+        for (const auto& [word, count] : expectedCounts[partition])
+        {
+            const uint32_t* readCount = wordCounts[partition].Find(word);
+            sameCounts &= readCount != nullptr && *readCount == count;
+        }
+    }
+    REQUIRE(sameCounts);
+}
+
+using WordCounts = std::unordered_map<std::string, uint32_t>;
+
+// Counts of all partitions in one map.
+inline WordCounts ReadCounts(const std::string& fileName, const InputOptions& inputOptions)
+{
+    std::vector<MultiThreadFileReader::MapType> partitions;
+    MultiThreadFileReader reader;
+    reader.SetInputOptions(inputOptions);
+    reader.ReadText(fileName, partitions);
+
+    WordCounts counts;
+    for (const auto& partition : partitions)
+    {
+        for (const auto& [word, count] : partition)
+        {
+            counts[std::string(word)] = count;
+        }
+    }
+    return counts;
+}
+
+//----------------------------------------------------------------------
+
+// Words over a few letters with long repeats, so that merges chain and overlap, like base64 or
+// minified code.
+inline std::string RandomWord(std::mt19937& random, const size_t length)
+{
+    const char* pieces[] = { "a", "b", "ab", "aa", "ba", "c", "abc", "=", "+/" };
+
+    std::string word;
+    while (word.size() < length)
+    {
+        word += random() % 20 == 0 ? std::string(random() % 50, 'a') : pieces[random() % std::size(pieces)];
+    }
+    word.resize(length);
+    return word;
+}
+
+struct LearnedModel
+{
+    std::vector<std::string> Words; // Learned from
+    std::string FileName;
+};
+
+// Model of vocabSize tokens learned from wordCount random words of 1 to maxLength bytes, saved in
+// directory. The same seed gives the same words.
+inline LearnedModel LearnModel(const uint32_t seed, const uint32_t vocabSize, const size_t maxLength, const TempDirectory& directory, const size_t wordCount = 2000)
+{
+    std::mt19937 random(seed);
+
+    LearnedModel model;
+    for (size_t i = 0; i < wordCount; ++i)
+    {
+        model.Words.push_back(RandomWord(random, 1 + random() % maxLength));
+    }
+
+    BPELearner learner;
+    learner.Learn(vocabSize, model.Words);
+    model.FileName = directory / ("model-" + std::to_string(seed) + "-" + std::to_string(vocabSize) + ".model");
+    learner.Save(model.FileName);
+    return model;
+}
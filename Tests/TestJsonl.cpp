@@ -0,0 +1,166 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "JsonlExtractor.h"
+#include "MultiThreadFileReader.h"
+#include "PreTokenizer.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+static std::string Extract(const std::string_view line, const std::string_view field = "text")
+{
+    std::string text;
+    REQUIRE(Jsonl::ExtractField(line, field, text));
+    return text;
+}
+
+static bool HasField(const std::string_view line, const std::string_view field = "text")
+{
+    std::string text = "unchanged";
+    const bool found = Jsonl::ExtractField(line, field, text);
+    if (!found)
+    {
+        REQUIRE(text == "unchanged");
+    }
+    return found;
+}
+
+// JSON string literal of text, non-ASCII is kept as UTF-8 except for a few \u escapes.
+static std::string Quote(const std::string_view text, std::mt19937& random)
+{
+    std::string quoted = "\"";
+    for (const char c : text)
+    {
+        switch (c)
+        {
+        case '"': quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\t': quoted += "\\t"; break;
+        case ' ': quoted += random() % 8 == 0 ? "\\u0020" : " "; break;
+        default: quoted += c; break;
+        }
+    }
+    return quoted + "\"";
+}
+
+//======================================================================
+
+TEST_CASE("Extract JSONL text field", "[Jsonl][1]")
+{
+    REQUIRE(Extract(R"({"text": "Hello world"})") == "Hello world");
+    REQUIRE(Extract(R"(  {"id":1,"text":"a"}  )") == "a");
+    REQUIRE(Extract(R"({"text":""})") == "");
+
+    // Escapes
+    REQUIRE(Extract(R"({"text": "a\"b\\c\/d\ne\tf\rg\bh\fi"})") == "a\"b\\c/d\ne\tf\rg\bh\fi");
+    REQUIRE(Extract(R"({"text": "\u0041\u00e9\u4E2D"})") == "A\xC3\xA9\xE4\xB8\xAD");
+    REQUIRE(Extract(R"({"text": "\ud83d\ude00"})") == "\xF0\x9F\x98\x80");
+    REQUIRE(Extract(R"({"text": "\ud83d."})") == "\xEF\xBF\xBD.");
+
+    // Other values are skipped, including look-alike keys inside them
+    REQUIRE(Extract(R"({"meta": {"text": "no", "list": [1, "}", {"a": null}]}, "n": -1.5e3, "ok": true, "text": "yes"})") == "yes");
+    REQUIRE(Extract(R"({"title": "text", "text": "body"})") == "body");
+    REQUIRE(Extract(R"({"t\u0065xt": "escaped key"})") == "escaped key");
+    REQUIRE(Extract(R"({"content": "x", "text": "y"})", "content") == "x");
+
+    // Long strings go through the vector scanner
+    const std::string longText(1000, 'x');
+    REQUIRE(Extract("{\"text\": \"" + longText + "\\n" + longText + "\"}") == longText + "\n" + longText);
+}
+
+TEST_CASE("Skip JSONL lines without text", "[Jsonl][2]")
+{
+    REQUIRE_FALSE(HasField(""));
+    REQUIRE_FALSE(HasField("[1, 2]"));
+    REQUIRE_FALSE(HasField(R"({"id": 1})"));
+    REQUIRE_FALSE(HasField(R"({"text": null})"));
+    REQUIRE_FALSE(HasField(R"({"text": 42})"));
+    REQUIRE_FALSE(HasField(R"({"text": "unterminated)"));
+    REQUIRE_FALSE(HasField(R"({"text": "bad \x escape"})"));
+    REQUIRE_FALSE(HasField(R"({"text": "bad \u12"})"));
+    REQUIRE_FALSE(HasField(R"({"a": [1, 2, "text": "b"})"));
+}
+
+TEST_CASE("Find quotes and escapes", "[Jsonl][3]")
+{
+    std::mt19937 random(50);
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::string text(random() % 100, 'a');
+        for (char& c : text)
+        {
+            const uint32_t r = random() % 40;
+            c = r == 0 ? '"' : r == 1 ? '\\' : r == 2 ? '\xA2' : 'a' + r % 26;
+        }
+
+        const size_t expected = text.find_first_of("\"\\");
+        const char* found = Jsonl::FindQuoteOrEscape(text.data(), text.data() + text.size());
+        REQUIRE(static_cast<size_t>(found - text.data()) == (expected == std::string::npos ? text.size() : expected));
+    }
+}
+
+TEST_CASE("Read word counts from JSONL", "[Jsonl][4]")
+{
+    const char* pieces[] = { "word", " ", "  ", "\n", "\t", "42", "'s", "!", "\"", "\\", "\xD8\xB3\xD9\x84", " \xE4\xB8\xAD" };
+
+    // Words never span two documents, so count each document on its own. Several MB, several sections.
+    std::mt19937 random(51);
+    std::unordered_map<std::string, uint32_t> expectedCounts;
+    std::string jsonl;
+    for (int document = 0; document < 60000; ++document)
+    {
+        std::string text;
+        for (uint32_t i = random() % 30; i > 0; --i)
+        {
+            text += pieces[random() % std::size(pieces)];
+        }
+
+        PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+        {
+            expectedCounts[std::string(word)]++;
+        });
+
+        jsonl += "{\"id\": " + std::to_string(document) + ", \"text\": " + Quote(text, random) + ", \"tags\": [\"a\"]}\n";
+        if (document % 100 == 0)
+        {
+            jsonl += "{\"id\": \"no text\"}\n\n";
+        }
+    }
+
+    const TempDirectory directory("documents");
+    const std::string fileName = directory / "documents.jsonl";
+    WriteFile(fileName, jsonl);
+
+    InputOptions inputOptions;
+    inputOptions.InputFormat = InputOptions::Format::Jsonl;
+
+    std::vector<MultiThreadFileReader::MapType> wordCounts;
+    MultiThreadFileReader reader;
+    reader.SetInputOptions(inputOptions);
+    reader.ReadText(fileName, wordCounts);
+
+    size_t uniqueWords = 0;
+    for (const auto& partition : wordCounts)
+    {
+        uniqueWords += partition.size();
+    }
+    REQUIRE(uniqueWords == expectedCounts.size());
+
+    for (const auto& [word, count] : expectedCounts)
+    {
+        const uint32_t* readCount = wordCounts[MultiThreadFileReader::GetPartition(MultiThreadFileReader::MapType::Hash(word))].Find(word);
+        REQUIRE(readCount != nullptr);
+        REQUIRE(*readCount == count);
+    }
+}
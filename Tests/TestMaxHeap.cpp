@@ -170,4 +170,34 @@ TEST_CASE("push to root", "[MaxHeap][1]")
 
     REQUIRE(maxPair == p4);
     REQUIRE(Count == 100);
-}
\ No newline at end of file
+}
+
+TEST_CASE("build pops in order", "[MaxHeap][1]")
+{
+    std::vector<PairData> items;
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        items.emplace_back(IntPair(i, i + 1), (i * 37) % 11);
+    }
+
+    MaxHeap maxHeap;
+    maxHeap.Build(items);
+    REQUIRE(maxHeap.GetSize() == items.size());
+    REQUIRE(maxHeap.Contains(IntPair(5, 6)));
+
+    std::sort(items.begin(), items.end(), std::greater<PairData>());
+    for (const auto& expected : items)
+    {
+        IntPair maxPair;
+        uint32_t count = 0;
+        maxHeap.Top(maxPair, count);
+        REQUIRE(maxPair == expected.Pair);
+        REQUIRE(count == expected.Count);
+
+        // Pop() can not remove the last item
+        if (maxHeap.GetSize() > 1)
+        {
+            maxHeap.Pop();
+        }
+    }
+}
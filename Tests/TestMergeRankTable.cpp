@@ -0,0 +1,104 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+
+#include "MergeRankTable.h"
+#include "PairHasher.h"
+
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+//======================================================================
+
+TEST_CASE("Merge rank table finds what unordered_map finds", "[MergeRankTable][1]")
+{
+    std::mt19937 random(41);
+
+    // Mostly small ids like a real model, a few large ones, and repeated pairs
+    std::vector<MergeRankTable::Rule> rules;
+    std::unordered_map<std::pair<uint32_t, uint32_t>, uint32_t, PairHasher> expectedRanks;
+    for (uint32_t rank = 256; rank < 256 + 20000; ++rank)
+    {
+        const uint32_t first = random() % 8 == 0 ? static_cast<uint32_t>(random()) : random() % rank;
+        const uint32_t second = random() % 1000 == 0 ? first : random() % rank;
+        rules.push_back({ first, second, rank });
+        expectedRanks[{ first, second }] = rank;
+    }
+    rules.push_back({ rules[10].First, rules[10].Second, 99999 });
+    expectedRanks[{ rules[10].First, rules[10].Second }] = 99999;
+
+    MergeRankTable table;
+    REQUIRE(table.Find(1, 2) == MergeRankTable::NoRank);
+
+    table.Build(rules);
+    REQUIRE(table.size() == expectedRanks.size());
+
+    bool sameRanks = true;
+    for (const auto& [pair, rank] : expectedRanks)
+    {
+        sameRanks &= table.Find(pair.first, pair.second) == rank;
+    }
+    REQUIRE(sameRanks);
+
+    bool noMissFound = true;
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        const uint32_t first = random() % 300, second = random() % 300;
+        const auto expected = expectedRanks.find({ first, second });
+        noMissFound &= table.Find(first, second) == (expected != expectedRanks.end() ? expected->second : MergeRankTable::NoRank);
+    }
+    REQUIRE(noMissFound);
+    REQUIRE(table.Find(MergeRankTable::NoRank, MergeRankTable::NoRank) == MergeRankTable::NoRank);
+
+    // Building again replaces the rules
+    table.Build({ { 7, 8, 300 } });
+    REQUIRE(table.size() == 1);
+    REQUIRE(table.Find(7, 8) == 300);
+    REQUIRE(table.Find(rules[0].First, rules[0].Second) == MergeRankTable::NoRank);
+}
+
+TEST_CASE("Merge rank table layouts give the same ranks", "[MergeRankTable][2]")
+{
+    std::mt19937 random(43);
+
+    // Ids of a model: merges of bytes first, then of earlier tokens
+    std::vector<MergeRankTable::Rule> rules;
+    for (uint32_t rank = 256; rank < 256 + 30000; ++rank)
+    {
+        const uint32_t bound = rank < 1000 ? 256 : rank;
+        rules.push_back({ static_cast<uint32_t>(random() % bound), static_cast<uint32_t>(random() % bound), rank });
+    }
+
+    MergeRankTable hashed, indexed;
+    hashed.Build(rules);
+    indexed.Build(rules);
+    REQUIRE(indexed.CanIndex());
+    indexed.SetLayout(MergeRankTable::Layout::Indexed);
+    REQUIRE(indexed.GetLayout() == MergeRankTable::Layout::Indexed);
+
+    bool sameRanks = true;
+    for (const auto& rule : rules)
+    {
+        sameRanks &= indexed.Find(rule.First, rule.Second) == hashed.Find(rule.First, rule.Second);
+        sameRanks &= indexed.Find(rule.Second, rule.First) == hashed.Find(rule.Second, rule.First);
+    }
+    for (uint32_t i = 0; i < 200000; ++i)
+    {
+        const uint32_t first = random() % 40000, second = random() % (i % 2 == 0 ? 256 : 40000);
+        sameRanks &= indexed.Find(first, second) == hashed.Find(first, second);
+    }
+    REQUIRE(sameRanks);
+    REQUIRE(indexed.Find(MergeRankTable::NoRank, 5) == MergeRankTable::NoRank);
+    REQUIRE(indexed.Find(5, MergeRankTable::NoRank) == MergeRankTable::NoRank);
+
+    // Sparse ids are not indexed
+    MergeRankTable sparse;
+    sparse.Build({ { 3000000000u, 1, 256 } });
+    sparse.SetLayout(MergeRankTable::Layout::Indexed);
+    REQUIRE(!sparse.CanIndex());
+    REQUIRE(sparse.GetLayout() == MergeRankTable::Layout::Hashed);
+    REQUIRE(sparse.Find(3000000000u, 1) == 256);
+}
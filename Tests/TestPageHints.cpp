@@ -0,0 +1,70 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "MMFile.h"
+#include "MultiThreadFileReader.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+//======================================================================
+
+TEST_CASE("Map files with page hints", "[PageHints][1]")
+{
+    const TempDirectory directory("pagehints");
+    const std::string fileName = directory / "pagehints.txt";
+
+    // Larger than a huge page
+    const std::string text = RandomWords(80, 5 << 20);
+    WriteFile(fileName, text);
+
+    for (const bool populate : { false, true })
+    {
+        for (const bool hugePages : { false, true })
+        {
+            MemoryMappedFile mappedFile(fileName, populate, hugePages);
+            REQUIRE(mappedFile.getSize() == text.size());
+
+            const char* data = static_cast<const char*>(mappedFile.getData());
+            REQUIRE(std::memcmp(data, text.data(), text.size()) == 0);
+
+            // Released pages of a file mapping are read again on the next access
+            MemoryMappedFile::advise(data + 1000, data + text.size() - 1000, MemoryMappedFile::Advice::DontNeed);
+            MemoryMappedFile::advise(data, data + text.size(), MemoryMappedFile::Advice::WillNeed);
+            REQUIRE(std::memcmp(data, text.data(), text.size()) == 0);
+        }
+    }
+}
+
+TEST_CASE("Read word counts with page hints", "[PageHints][2]")
+{
+    const TempDirectory directory("pagehints");
+    const std::string fileName = directory / "pagehints.txt";
+
+    WriteFile(fileName, RandomWords(80, 5 << 20));
+
+    std::vector<MultiThreadFileReader::MapType> expectedCounts;
+    MultiThreadFileReader plainReader;
+    plainReader.ReadText(fileName, expectedCounts);
+
+    for (uint32_t flags = 1; flags < 16; ++flags)
+    {
+        InputOptions inputOptions;
+        inputOptions.PrefaultPages = (flags & 1) != 0;
+        inputOptions.AdviseSections = (flags & 2) != 0;
+        inputOptions.HugePages = (flags & 4) != 0;
+        inputOptions.ReleaseSections = (flags & 8) != 0;
+
+        std::vector<MultiThreadFileReader::MapType> wordCounts;
+        MultiThreadFileReader reader;
+        reader.SetInputOptions(inputOptions);
+        reader.ReadText(fileName, wordCounts);
+
+        RequireSameCounts(expectedCounts, wordCounts);
+    }
+}
@@ -0,0 +1,151 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+
+#include "PreTokenizer.h"
+
+#include <string>
+#include <vector>
+#include <random>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+static std::vector<std::string> SimpleSplit(const std::string& text)
+{
+    std::vector<std::string> words;
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+    {
+        words.emplace_back(word);
+    });
+    return words;
+}
+
+static std::vector<std::string> PCRESplit(const PreTokenizer& preTokenizer, const std::string& text)
+{
+    std::vector<std::string> words;
+    preTokenizer.PCRETokenize(text, [&](const std::string_view word)
+    {
+        words.emplace_back(word);
+    });
+    return words;
+}
+
+//======================================================================
+
+TEST_CASE("Unicode classes", "[PreTokenizer][0]")
+{
+    REQUIRE(Unicode::GetCharClass('a') == CharClass::Letter);
+    REQUIRE(Unicode::GetCharClass('7') == CharClass::Number);
+    REQUIRE(Unicode::GetCharClass('\n') == CharClass::Space);
+    REQUIRE(Unicode::GetCharClass('!') == CharClass::Other);
+    REQUIRE(Unicode::GetCharClass(0x0633) == CharClass::Letter);   // ARABIC LETTER SEEN
+    REQUIRE(Unicode::GetCharClass(0x06F1) == CharClass::Number);   // EXTENDED ARABIC-INDIC DIGIT ONE
+    REQUIRE(Unicode::GetCharClass(0x2167) == CharClass::Number);   // ROMAN NUMERAL EIGHT
+    REQUIRE(Unicode::GetCharClass(0x3000) == CharClass::Space);    // IDEOGRAPHIC SPACE
+    REQUIRE(Unicode::GetCharClass(0x4E2D) == CharClass::Letter);   // CJK
+    REQUIRE(Unicode::GetCharClass(0x1F600) == CharClass::Other);   // Emoji
+    REQUIRE(Unicode::GetCharClass(0x10FFFF) == CharClass::Other);
+}
+
+TEST_CASE("UTF-8 decoder", "[PreTokenizer][0]")
+{
+    auto decode = [](const std::string& bytes, uint32_t& codePoint)
+    {
+        const auto* text = reinterpret_cast<const unsigned char*>(bytes.data());
+        return Unicode::DecodeUTF8(text, text + bytes.size(), codePoint);
+    };
+
+    uint32_t codePoint = 0;
+    REQUIRE(decode("\xD8\xB3", codePoint) == 2);
+    REQUIRE(codePoint == 0x0633);
+    REQUIRE(decode("\xF0\x9F\x98\x80", codePoint) == 4);
+    REQUIRE(codePoint == 0x1F600);
+
+    REQUIRE(decode("\xC0\x80", codePoint) == 0);          // Overlong
+    REQUIRE(decode("\xE0\x80\xAF", codePoint) == 0);      // Overlong
+    REQUIRE(decode("\xED\xA0\x80", codePoint) == 0);      // Surrogate
+    REQUIRE(decode("\xF4\x90\x80\x80", codePoint) == 0);  // Above U+10FFFF
+    REQUIRE(decode("\xE2\x82", codePoint) == 0);          // Truncated
+    REQUIRE(decode("\x80", codePoint) == 0);              // Lone continuation
+}
+
+TEST_CASE("Simple pretokenizer ASCII", "[PreTokenizer][1]")
+{
+    REQUIRE(SimpleSplit("Hello world's  test\n") ==
+        std::vector<std::string>{ "Hello", " world", "'s", " ", " test", "\n" });
+
+    REQUIRE(SimpleSplit("I'm 123abc!! x") ==
+        std::vector<std::string>{ "I", "'m", " 123", "abc", "!!", " x" });
+
+    REQUIRE(SimpleSplit("they'll\n\nend  ") ==
+        std::vector<std::string>{ "they", "'ll", "\n", "\n", "end", "  " });
+
+    REQUIRE(SimpleSplit(" 'quoted'") ==
+        std::vector<std::string>{ " '", "quoted", "'" });
+}
+
+TEST_CASE("Simple pretokenizer Unicode", "[PreTokenizer][1]")
+{
+    // Persian words and digits
+    REQUIRE(SimpleSplit("\xD8\xB3\xD9\x84\xD8\xA7\xD9\x85 \xDB\xB1\xDB\xB2") ==
+        std::vector<std::string>{ "\xD8\xB3\xD9\x84\xD8\xA7\xD9\x85", " \xDB\xB1\xDB\xB2" });
+
+    // CJK with a full width comma
+    REQUIRE(SimpleSplit("\xE4\xB8\xAD\xE6\x96\x87\xEF\xBC\x8C\xE4\xB8\xAD") ==
+        std::vector<std::string>{ "\xE4\xB8\xAD\xE6\x96\x87", "\xEF\xBC\x8C", "\xE4\xB8\xAD" });
+
+    // No-break space is whitespace
+    REQUIRE(SimpleSplit("a\xC2\xA0\xC2\xA0" "b") ==
+        std::vector<std::string>{ "a", "\xC2\xA0", "\xC2\xA0", "b" });
+}
+
+TEST_CASE("Simple pretokenizer invalid UTF-8", "[PreTokenizer][1]")
+{
+    REQUIRE(SimpleSplit("ab\xFF\xFE" "cd") ==
+        std::vector<std::string>{ "ab", "\xFF\xFE", "cd" });
+
+    REQUIRE(SimpleSplit("a  \xE2\x82" "b") ==
+        std::vector<std::string>{ "a", "  ", "\xE2\x82", "b" });
+}
+
+TEST_CASE("UTF-8 validation", "[PreTokenizer][0]")
+{
+    REQUIRE(Unicode::IsValidUTF8(""));
+    REQUIRE(Unicode::IsValidUTF8("plain ASCII text that is longer than sixteen bytes"));
+    REQUIRE(Unicode::IsValidUTF8("mixed \xD8\xB3\xD9\x84\xD8\xA7\xD9\x85 and \xE4\xB8\xAD\xE6\x96\x87 text \xF0\x9F\x98\x80"));
+    REQUIRE(!Unicode::IsValidUTF8("sixteen ascii bytes then \xC0\x80"));
+    REQUIRE(!Unicode::IsValidUTF8("truncated at the end \xE4\xB8"));
+    REQUIRE(!Unicode::IsValidUTF8("\xED\xA0\x80 surrogate"));
+}
+
+TEST_CASE("PCRE and simple pretokenizers agree", "[PreTokenizer][2]")
+{
+    const PreTokenizer preTokenizer;
+
+    REQUIRE(PCRESplit(preTokenizer, "ab\xFF\xFE" "cd  ") ==
+        std::vector<std::string>{ "ab", "\xFF\xFE", "cd", "  " });
+    REQUIRE(PCRESplit(preTokenizer, "ok\x80") ==
+        std::vector<std::string>{ "ok", "\x80" });
+
+    const char* pieces[] = {
+        " ", "  ", "\n", "\t", "\r\n", "a", "Z", "'", "s", "ll", "'ve", "1", "42", "!", ".",
+        "\xC2\xA0", "\xD8\xB3", "\xDB\xB1", "\xE4\xB8\xAD", "\xEF\xBC\x8C", "\xF0\x9F\x98\x80",
+        "\xE3\x80\x80", "\xCC\x81", "\xFF", "\x80", "\xE2\x82"
+    };
+
+    std::mt19937 random(26);
+    for (int i = 0; i < 20000; ++i)
+    {
+        std::string text;
+        const int pieceCount = random() % 16;
+        for (int p = 0; p < pieceCount; ++p)
+        {
+            text += pieces[random() % std::size(pieces)];
+        }
+
+        REQUIRE(PCRESplit(preTokenizer, text) == SimpleSplit(text));
+    }
+}
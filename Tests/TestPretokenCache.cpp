@@ -0,0 +1,87 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+
+#include "PretokenCache.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//======================================================================
+
+TEST_CASE("Pretoken cache returns what was inserted and evicts past its capacity", "[PretokenCache][1]")
+{
+    std::mt19937 random(45);
+
+    // Far more words than fit, so every shard evicts and moves probe runs many times
+    PretokenCache cache(1024);
+    std::unordered_map<std::string, std::vector<uint32_t>> expectedTokens;
+    std::vector<std::string> words;
+    for (int i = 0; i < 20000; ++i)
+    {
+        std::string word = "w" + std::to_string(random() % 5000);
+        std::vector<uint32_t> tokens(1 + word.size() % PretokenCache::MaxTokens);
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            tokens[i] = static_cast<uint32_t>(std::hash<std::string>()(word) + i);
+        }
+
+        std::vector<uint32_t> found;
+        if (cache.Find(word, found))
+        {
+            REQUIRE(found == expectedTokens[word]);
+        }
+        else
+        {
+            expectedTokens[word] = tokens;
+            cache.Insert(word, tokens);
+        }
+        words.push_back(word);
+    }
+
+    const PretokenCache::Stats stats = cache.GetStats();
+    REQUIRE(stats.Hits + stats.Misses == 20000);
+    REQUIRE(stats.Hits > 0);
+    REQUIRE(stats.Evictions > 0);
+    REQUIRE(stats.Size <= cache.GetCapacity());
+    REQUIRE(cache.GetCapacity() == 1024);
+
+    // Whatever is still cached has the right tokens, and exactly Size words are
+    size_t cachedWords = 0;
+    for (const auto& [word, tokens] : expectedTokens)
+    {
+        std::vector<uint32_t> found;
+        if (cache.Find(word, found))
+        {
+            REQUIRE(found == tokens);
+            ++cachedWords;
+        }
+    }
+    REQUIRE(cachedWords == stats.Size);
+}
+
+TEST_CASE("Pretoken cache skips words it cannot hold", "[PretokenCache][2]")
+{
+    PretokenCache cache(64);
+
+    const std::string longWord(PretokenCache::MaxWordLength + 1, 'a');
+    const std::vector<uint32_t> manyTokens(PretokenCache::MaxTokens + 1, 7);
+    cache.Insert(longWord, { 1 });
+    cache.Insert("many", manyTokens);
+    cache.Insert("", { 1 });
+
+    std::vector<uint32_t> found;
+    REQUIRE_FALSE(cache.Find(longWord, found));
+    REQUIRE_FALSE(cache.Find("many", found));
+    REQUIRE(cache.GetStats().Size == 0);
+
+    const std::string longest(PretokenCache::MaxWordLength, 'b');
+    const std::vector<uint32_t> mostTokens(PretokenCache::MaxTokens, 9);
+    cache.Insert(longest, mostTokens);
+    REQUIRE(cache.Find(longest, found));
+    REQUIRE(found == mostTokens);
+}
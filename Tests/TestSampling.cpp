@@ -0,0 +1,79 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "MultiThreadFileReader.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+// Bytes covered by the counted words.
+static size_t CountedBytes(const WordCounts& counts)
+{
+    size_t bytes = 0;
+    for (const auto& [word, count] : counts)
+    {
+        bytes += word.size() * count;
+    }
+    return bytes;
+}
+
+//======================================================================
+
+TEST_CASE("Sample sections deterministically", "[Sampling][1]")
+{
+    const TempDirectory directory("sampling");
+    const std::string fileName = directory / "sampling.txt";
+
+    // 8 MB, so the file has several sections
+    WriteFile(fileName, RandomWords(70, 8 << 20));
+
+    InputOptions inputOptions;
+    const WordCounts fullCounts = ReadCounts(fileName, inputOptions);
+    const size_t fullBytes = CountedBytes(fullCounts);
+
+    inputOptions.SampleFraction = 0.25;
+    inputOptions.SampleSeed = 1;
+    const WordCounts sampleCounts = ReadCounts(fileName, inputOptions);
+    REQUIRE(ReadCounts(fileName, inputOptions) == sampleCounts);
+
+    // Whole sections are taken until a quarter of the bytes is reached
+    const size_t sampleBytes = CountedBytes(sampleCounts);
+    REQUIRE(sampleBytes >= fullBytes / 4);
+    REQUIRE(sampleBytes < fullBytes / 2);
+
+    inputOptions.SampleSeed = 2;
+    REQUIRE(ReadCounts(fileName, inputOptions) != sampleCounts);
+}
+
+TEST_CASE("Sample up to a byte budget", "[Sampling][2]")
+{
+    const TempDirectory directory("sampling");
+    const std::string fileName = directory / "sampling.txt";
+
+    // 8 MB, so the file has several sections
+    WriteFile(fileName, RandomWords(70, 8 << 20));
+
+    InputOptions inputOptions;
+    const WordCounts fullCounts = ReadCounts(fileName, inputOptions);
+
+    // A budget above the file size samples every section, cut at line ends like a full read
+    inputOptions.SampleBytes = 1ull << 40;
+    REQUIRE(ReadCounts(fileName, inputOptions) == fullCounts);
+
+    inputOptions.SampleBytes = 1 << 20;
+    const size_t sampleBytes = CountedBytes(ReadCounts(fileName, inputOptions));
+    REQUIRE(sampleBytes > (1 << 20) * 3 / 4);
+    REQUIRE(sampleBytes < (3 << 20));
+
+    inputOptions.SampleBytes = 0;
+    inputOptions.SampleFraction = 0.0;
+    REQUIRE_THROWS_AS(ReadCounts(fileName, inputOptions), std::runtime_error);
+}
@@ -0,0 +1,198 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "BufferedStreamReader.h"
+#include "MultiThreadFileReader.h"
+#include "PreTokenizer.h"
+
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#endif
+
+//======================================================================
+//----------------------------------------------------------------------
+
+// Writes text to a pipe on another thread, returns the read end.
+static int OpenPipe(const std::string& text, std::thread& outWriter)
+{
+    int fds[2];
+#ifdef _WIN32
+    REQUIRE(_pipe(fds, 1 << 16, _O_BINARY) == 0);
+#else
+    REQUIRE(pipe(fds) == 0);
+#endif
+
+    outWriter = std::thread([text, fd = fds[1]]()
+    {
+        size_t written = 0;
+        while (written < text.size())
+        {
+            // Small writes, so the reader sees partial reads
+            const size_t length = std::min<size_t>(1000, text.size() - written);
+#ifdef _WIN32
+            written += _write(fd, text.data() + written, static_cast<unsigned int>(length));
+#else
+            written += write(fd, text.data() + written, length);
+#endif
+        }
+#ifdef _WIN32
+        _close(fd);
+#else
+        close(fd);
+#endif
+    });
+
+    return fds[0];
+}
+
+static void ClosePipe(const int fd, std::thread& writer)
+{
+    writer.join();
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+static std::vector<std::string> Split(const std::string_view text)
+{
+    std::vector<std::string> words;
+    PreTokenizer::SimpleTokenize(text, [&](const std::string_view word)
+    {
+        words.emplace_back(word);
+    });
+    return words;
+}
+
+//======================================================================
+
+TEST_CASE("Stream blocks end on pretoken boundaries", "[StreamReader][1]")
+{
+    const std::string text = RandomText(32, 200000);
+
+    std::thread writer;
+    const int fd = OpenPipe(text, writer);
+
+    // Large enough that every block has a split point, smaller ones may fall back to character cuts.
+    const size_t bufferSize = 1024;
+
+    std::string joined;
+    std::vector<std::string> blockWords;
+    {
+        BufferedStreamReader streamReader(fd, bufferSize);
+        for (std::string_view block = streamReader.Next(); !block.empty(); block = streamReader.Next())
+        {
+            REQUIRE(block.size() <= bufferSize);
+            joined += block;
+            for (auto& word : Split(block))
+            {
+                blockWords.push_back(std::move(word));
+            }
+        }
+
+        REQUIRE(streamReader.GetTotalBytes() == text.size());
+    }
+    ClosePipe(fd, writer);
+
+    REQUIRE(joined == text);
+    REQUIRE(blockWords == Split(text));
+}
+
+TEST_CASE("Stream lines longer than the buffer", "[StreamReader][1]")
+{
+    // No line end and no space, blocks are cut at character boundaries.
+    std::string text;
+    for (int i = 0; i < 1000; ++i)
+    {
+        text += "\xE4\xB8\xAD" "a";
+    }
+
+    std::thread writer;
+    const int fd = OpenPipe(text, writer);
+
+    std::string joined;
+    {
+        BufferedStreamReader streamReader(fd, 64);
+        for (std::string_view block = streamReader.Next(); !block.empty(); block = streamReader.Next())
+        {
+            REQUIRE(Unicode::IsValidUTF8(block));
+            joined += block;
+        }
+    }
+    ClosePipe(fd, writer);
+
+    REQUIRE(joined == text);
+}
+
+TEST_CASE("Stream lines are not split when cutting at line ends", "[StreamReader][1]")
+{
+    // Lines up to 80 times the buffer, as a large JSONL document would be.
+    std::mt19937 random(33);
+    std::string text;
+    for (int i = 0; i < 200; ++i)
+    {
+        text += std::string(random() % 5000, 'a') + "\n";
+    }
+
+    std::thread writer;
+    const int fd = OpenPipe(text, writer);
+
+    std::string joined;
+    {
+        BufferedStreamReader streamReader(fd, 64);
+        streamReader.SetCutAtLineEnds(true);
+        for (std::string_view block = streamReader.Next(); !block.empty(); block = streamReader.Next())
+        {
+            REQUIRE(block.back() == '\n');
+            joined += block;
+        }
+    }
+    ClosePipe(fd, writer);
+
+    REQUIRE(joined == text);
+}
+
+TEST_CASE("Read word counts from a stream", "[StreamReader][2]")
+{
+    const TempDirectory directory("stream");
+    const std::string fileName = directory / "stream.txt";
+
+    const std::string text = RandomText(33, 1 << 20);
+    WriteFile(fileName, text);
+
+    std::vector<MultiThreadFileReader::MapType> fileCounts;
+    MultiThreadFileReader fileReader;
+    fileReader.ReadText(fileName, fileCounts);
+
+    std::thread writer;
+    const int fd = OpenPipe(text, writer);
+
+    std::vector<MultiThreadFileReader::MapType> streamCounts;
+    {
+        MultiThreadFileReader streamReader;
+        streamReader.ReadStream(fd, streamCounts);
+        ClosePipe(fd, writer);
+    } // Words must outlive the reader
+
+    REQUIRE(streamCounts.size() == fileCounts.size());
+    for (size_t partition = 0; partition < fileCounts.size(); ++partition)
+    {
+        REQUIRE(streamCounts[partition].size() == fileCounts[partition].size());
+        for (const auto& [word, count] : fileCounts[partition])
+        {
+            const uint32_t* streamCount = streamCounts[partition].Find(word);
+            REQUIRE(streamCount != nullptr);
+            REQUIRE(*streamCount == count);
+        }
+    }
+}
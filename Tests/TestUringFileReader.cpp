@@ -0,0 +1,148 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "MultiThreadFileReader.h"
+#include "UringFileReader.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+// More shards than buffers, one larger than a buffer and an empty one.
+static std::vector<std::string> WriteShards(const std::filesystem::path& root)
+{
+    std::vector<std::string> texts;
+    for (uint32_t i = 0; i < 3 * UringFileReader::BufferCount; ++i)
+    {
+        texts.push_back(RandomText(i, 100 + i * 97));
+    }
+    texts.push_back(RandomText(1000, UringFileReader::BufferSize + 1000));
+    texts.push_back("");
+
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        std::ofstream(root / ("shard-" + std::to_string(1000 + i) + ".txt"), std::ios::binary) << texts[i];
+    }
+    return texts;
+}
+
+//======================================================================
+
+TEST_CASE("Read files through io_uring", "[UringFileReader][1]")
+{
+    if (!UringFileReader::IsAvailable())
+    {
+        WARN("io_uring is not available, skipped");
+        return;
+    }
+
+    const TempDirectory directory("uring_shards");
+    const std::filesystem::path& root = directory.GetPath();
+    const std::vector<std::string> texts = WriteShards(root);
+
+    std::vector<std::string> fileNames;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        fileNames.push_back((root / ("shard-" + std::to_string(1000 + i) + ".txt")).string());
+    }
+
+    // Every other file is handed back unread
+    UringFileReader reader(fileNames);
+    std::vector<std::string> readTexts(texts.size());
+    std::thread ringThread([&reader]() { reader.Run(); });
+
+    UringFileReader::File file;
+    while (reader.Next(file))
+    {
+        const bool consumed = file.Index % 2 == 0;
+        if (consumed)
+        {
+            readTexts[file.Index].assign(file.Data, file.Size);
+        }
+        reader.Release(file, consumed);
+    }
+    ringThread.join();
+
+    std::vector<size_t> expectedOtherFiles;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        const bool fits = !texts[i].empty() && texts[i].size() < UringFileReader::BufferSize;
+        if (fits && i % 2 == 0)
+        {
+            REQUIRE(readTexts[i] == texts[i]);
+        }
+        else if (!texts[i].empty())
+        {
+            expectedOtherFiles.push_back(i);
+        }
+    }
+    REQUIRE(reader.GetOtherFiles() == expectedOtherFiles);
+}
+
+TEST_CASE("Word counts of files read through io_uring", "[UringFileReader][2]")
+{
+    const TempDirectory directory("uring_counts");
+    const std::filesystem::path& root = directory.GetPath();
+    WriteShards(root);
+
+    std::vector<MultiThreadFileReader::MapType> expectedCounts;
+    MultiThreadFileReader mappedReader;
+    mappedReader.ReadText(std::vector<std::string>{ root.string() }, expectedCounts);
+
+    // Mapped where io_uring is not available, the counts are the same either way
+    InputOptions inputOptions;
+    inputOptions.UseIoUring = true;
+
+    std::vector<MultiThreadFileReader::MapType> wordCounts;
+    MultiThreadFileReader uringReader;
+    uringReader.SetInputOptions(inputOptions);
+    uringReader.ReadText(std::vector<std::string>{ root.string() }, wordCounts);
+
+    RequireSameCounts(expectedCounts, wordCounts);
+}
+
+TEST_CASE("Cancel reads through io_uring", "[UringFileReader][3]")
+{
+    if (!UringFileReader::IsAvailable())
+    {
+        WARN("io_uring is not available, skipped");
+        return;
+    }
+
+    const TempDirectory directory("uring_cancel");
+    const std::filesystem::path& root = directory.GetPath();
+    const std::vector<std::string> texts = WriteShards(root);
+
+    std::vector<std::string> fileNames;
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        fileNames.push_back((root / ("shard-" + std::to_string(1000 + i) + ".txt")).string());
+    }
+
+    // Cancelled while the ring still has requests for the other files in flight, Run must reap them
+    // before the reader frees its buffers.
+    for (int round = 0; round < 20; ++round)
+    {
+        UringFileReader reader(fileNames);
+        std::thread ringThread([&reader]() { reader.Run(); });
+
+        UringFileReader::File file;
+        if (reader.Next(file))
+        {
+            reader.Release(file, true);
+        }
+        reader.Cancel();
+        REQUIRE_FALSE(reader.Next(file));
+
+        ringThread.join();
+    }
+}
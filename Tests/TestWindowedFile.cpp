@@ -0,0 +1,133 @@
+//======================================================================
+//
+//======================================================================
+
+#include "catch.hpp"
+#include "TestHelpers.h"
+
+#include "MultiThreadFileReader.h"
+#include "WindowedFile.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+//======================================================================
+//----------------------------------------------------------------------
+
+// Counts read through windows of inputOptions must match the counts of the whole mapped file.
+static void RequireWindowedCounts(const std::string& fileName, InputOptions inputOptions)
+{
+    std::vector<MultiThreadFileReader::MapType> expectedCounts;
+    MultiThreadFileReader mappedReader;
+    InputOptions mappedOptions = inputOptions;
+    mappedOptions.ReadBackend = WindowedFile::Backend::Mmap;
+    mappedReader.SetInputOptions(mappedOptions);
+    mappedReader.ReadText(fileName, expectedCounts);
+
+    inputOptions.WindowBytes = 4096;
+
+    std::vector<MultiThreadFileReader::MapType> wordCounts;
+    MultiThreadFileReader windowedReader;
+    windowedReader.SetInputOptions(inputOptions);
+    windowedReader.ReadText(fileName, wordCounts);
+
+    RequireSameCounts(expectedCounts, wordCounts);
+}
+
+//======================================================================
+
+TEST_CASE("Map file windows", "[WindowedFile][1]")
+{
+    const TempDirectory directory("windowed");
+    const std::string fileName = directory / "windowed.txt";
+
+    const std::string text = RandomText(90, 1 << 20, true);
+    WriteFile(fileName, text);
+
+    WindowedFile file(fileName);
+    REQUIRE(file.GetSize() == text.size());
+
+    // Offsets that are not page aligned, windows clipped at the end of the file
+    std::mt19937 random(91);
+    for (int i = 0; i < 100; ++i)
+    {
+        const uint64_t offset = random() % text.size();
+        const size_t length = 1 + random() % 100000;
+
+        const WindowedFile::Window window = file.Read(offset, length);
+        REQUIRE(window.GetSize() == std::min<size_t>(length, text.size() - offset));
+        REQUIRE(std::memcmp(window.GetData(), text.data() + offset, window.GetSize()) == 0);
+    }
+
+    REQUIRE(file.Read(text.size(), 100).GetSize() == 0);
+    REQUIRE_THROWS_AS(WindowedFile(directory / "missing.txt"), std::runtime_error);
+}
+
+TEST_CASE("Read file windows into buffers", "[WindowedFile][3]")
+{
+    const TempDirectory directory("windowed");
+    const std::string fileName = directory / "windowed.txt";
+
+    const std::string text = RandomText(94, 1 << 20, true);
+    WriteFile(fileName, text);
+
+    for (const auto backend : { WindowedFile::Backend::Pread, WindowedFile::Backend::DirectIO })
+    {
+        WindowedFile file(fileName, backend);
+        REQUIRE(file.GetSize() == text.size());
+
+        std::mt19937 random(95);
+        for (int i = 0; i < 100; ++i)
+        {
+            const uint64_t offset = random() % text.size();
+            const size_t length = 1 + random() % 100000;
+
+            const WindowedFile::Window window = file.Read(offset, length);
+            REQUIRE(window.GetSize() == std::min<size_t>(length, text.size() - offset));
+            REQUIRE(std::memcmp(window.GetData(), text.data() + offset, window.GetSize()) == 0);
+        }
+    }
+
+    WriteFile(fileName, RandomText(96, 3 << 20, true));
+
+    InputOptions inputOptions;
+    inputOptions.ReadBackend = WindowedFile::Backend::Pread;
+    RequireWindowedCounts(fileName, inputOptions);
+
+    inputOptions.ReadBackend = WindowedFile::Backend::DirectIO;
+    RequireWindowedCounts(fileName, inputOptions);
+}
+
+TEST_CASE("Read word counts through windows", "[WindowedFile][2]")
+{
+    const TempDirectory directory("windowed");
+    const std::string fileName = directory / "windowed.txt";
+    const std::string jsonlFileName = directory / "windowed.jsonl";
+
+    WriteFile(fileName, RandomText(92, 3 << 20, true));
+
+    InputOptions inputOptions;
+    RequireWindowedCounts(fileName, inputOptions);
+
+    inputOptions.AdviseSections = true;
+    RequireWindowedCounts(fileName, inputOptions);
+
+    // Cut at line ends
+    std::string jsonl;
+    std::mt19937 random(93);
+    for (int document = 0; document < 50000; ++document)
+    {
+        std::string text;
+        for (uint32_t length = random() % 60; length > 0; --length)
+        {
+            text += static_cast<char>(random() % 3 == 0 ? ' ' : 'a' + random() % 26);
+        }
+        jsonl += "{\"id\": " + std::to_string(document) + ", \"text\": \"" + text + "\"}\n";
+    }
+    WriteFile(jsonlFileName, jsonl);
+
+    inputOptions.InputFormat = InputOptions::Format::Jsonl;
+    RequireWindowedCounts(jsonlFileName, inputOptions);
+}
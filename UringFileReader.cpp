@@ -0,0 +1,518 @@
+#include "UringFileReader.h"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#if SHARIF_BPE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#endif
+
+//-------------------------------------------------------------------------------------------------
+
+#if SHARIF_BPE_IO_URING
+
+namespace
+{
+	enum Operation : uint64_t
+	{
+		StatxOperation,
+		OpenOperation,
+		ReadOperation,
+		CloseOperation
+	};
+
+	uint64_t makeUserData(const uint32_t slot, const Operation operation)
+	{
+		return (static_cast<uint64_t>(slot) << 8) | operation;
+	}
+
+	int setupRing(const uint32_t entries, io_uring_params& params)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+	}
+}
+
+// The submission and completion queues shared with the kernel, see io_uring(7).
+struct UringFileReader::Ring
+{
+	int Fd = -1;
+
+	void* SqMapping = MAP_FAILED;
+	size_t SqMappingSize = 0;
+	void* CqMapping = MAP_FAILED;
+	size_t CqMappingSize = 0;
+	io_uring_sqe* Sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+	size_t SqesSize = 0;
+
+	unsigned* SqHead = nullptr;
+	unsigned* SqTail = nullptr;
+	unsigned SqMask = 0;
+	unsigned SqEntries = 0;
+	unsigned* SqArray = nullptr;
+
+	unsigned* CqHead = nullptr;
+	unsigned* CqTail = nullptr;
+	unsigned CqMask = 0;
+	io_uring_cqe* Cqes = nullptr;
+
+	unsigned Unsubmitted = 0;
+	unsigned InFlight = 0; // Queued and not completed yet
+	bool FixedBuffers = false;
+
+	explicit Ring(const uint32_t entries)
+	{
+		io_uring_params params = {};
+		Fd = setupRing(entries, params);
+		if (Fd < 0)
+		{
+			throw std::runtime_error("io_uring_setup failed: " + std::string(strerror(errno)));
+		}
+
+		SqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		CqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+		{
+			SqMappingSize = CqMappingSize = std::max(SqMappingSize, CqMappingSize);
+		}
+
+		SqMapping = mmap(nullptr, SqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+		CqMapping = (params.features & IORING_FEAT_SINGLE_MMAP) ? SqMapping
+			: mmap(nullptr, CqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+		SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		Sqes = static_cast<io_uring_sqe*>(mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES));
+
+		if (SqMapping == MAP_FAILED || CqMapping == MAP_FAILED || Sqes == MAP_FAILED)
+		{
+			const int err = errno;
+			release();
+			throw std::runtime_error("Failed to map io_uring queues: " + std::string(strerror(err)));
+		}
+
+		char* sq = static_cast<char*>(SqMapping);
+		SqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		SqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		SqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		SqEntries = params.sq_entries;
+		SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+		char* cq = static_cast<char*>(CqMapping);
+		CqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		CqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		CqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	}
+
+	~Ring()
+	{
+		release();
+	}
+
+	void release()
+	{
+		if (Sqes != MAP_FAILED)
+		{
+			munmap(Sqes, SqesSize);
+		}
+		if (CqMapping != MAP_FAILED && CqMapping != SqMapping)
+		{
+			munmap(CqMapping, CqMappingSize);
+		}
+		if (SqMapping != MAP_FAILED)
+		{
+			munmap(SqMapping, SqMappingSize);
+		}
+		if (Fd >= 0)
+		{
+			close(Fd);
+		}
+	}
+
+	// Registered buffers skip the page pinning of every read. Not an error if refused, e.g. by RLIMIT_MEMLOCK.
+	void RegisterBuffers(char* buffers, const uint32_t count, const size_t size)
+	{
+		std::vector<iovec> iovecs(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			iovecs[i] = { buffers + i * size, size };
+		}
+		FixedBuffers = syscall(__NR_io_uring_register, Fd, IORING_REGISTER_BUFFERS, iovecs.data(), count) == 0;
+	}
+
+	// The caller keeps at most SqEntries entries unsubmitted.
+	io_uring_sqe* NextSqe()
+	{
+		const unsigned tail = *SqTail;
+		const unsigned index = tail & SqMask;
+		io_uring_sqe* sqe = &Sqes[index];
+		std::memset(sqe, 0, sizeof(*sqe));
+		SqArray[index] = index;
+		std::atomic_ref<unsigned>(*SqTail).store(tail + 1, std::memory_order_release);
+		++Unsubmitted;
+		++InFlight;
+		return sqe;
+	}
+
+	// Submits the queued entries and waits for at least one completion.
+	void SubmitAndWait()
+	{
+		for (;;)
+		{
+			const long submitted = syscall(__NR_io_uring_enter, Fd, Unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (submitted >= 0)
+			{
+				Unsubmitted -= static_cast<unsigned>(submitted);
+				return;
+			}
+
+			if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			{
+				throw std::runtime_error("io_uring_enter failed: " + std::string(strerror(errno)));
+			}
+		}
+	}
+
+	template<typename OnCompletion>
+	void ForEachCompletion(OnCompletion&& onCompletion)
+	{
+		unsigned head = *CqHead;
+		const unsigned tail = std::atomic_ref<unsigned>(*CqTail).load(std::memory_order_acquire);
+		for (; head != tail; ++head)
+		{
+			const io_uring_cqe& cqe = Cqes[head & CqMask];
+			onCompletion(cqe.user_data, cqe.res);
+			--InFlight;
+		}
+		std::atomic_ref<unsigned>(*CqHead).store(head, std::memory_order_release);
+	}
+};
+
+struct UringFileReader::Slot
+{
+	size_t FileIndex = 0;
+	int Fd = -1;
+	size_t Size = 0;
+	struct statx Stat;
+};
+
+//-------------------------------------------------------------------------------------------------
+
+bool UringFileReader::IsAvailable()
+{
+	static const bool available = []()
+	{
+		io_uring_params params = {};
+		const int fd = setupRing(4, params);
+		if (fd < 0)
+		{
+			return false; // ENOSYS, or disabled by kernel.io_uring_disabled or seccomp
+		}
+
+		// Every operation used must be known to the kernel (5.6 and later).
+		constexpr size_t ProbeOps = 64;
+		std::vector<char> probeMemory(sizeof(io_uring_probe) + ProbeOps * sizeof(io_uring_probe_op));
+		io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeMemory.data());
+
+		bool supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, ProbeOps) == 0;
+		for (const int op : { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE })
+		{
+			supported = supported && op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+		}
+
+		close(fd);
+		return supported;
+	}();
+
+	return available;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+UringFileReader::UringFileReader(const std::vector<std::string>& fileNames)
+	: mFileNames(fileNames)
+	, mRing(std::make_unique<Ring>(BufferCount * 4))
+	, mSlots(BufferCount)
+{
+	mBuffers = static_cast<char*>(::operator new(BufferCount * BufferSize, std::align_val_t(4096)));
+	mRing->RegisterBuffers(mBuffers, BufferCount, BufferSize);
+
+	for (uint32_t slot = BufferCount; slot > 0; --slot)
+	{
+		mFreeSlots.push_back(slot - 1);
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+UringFileReader::~UringFileReader()
+{
+	// Unregistered with the ring, which is closed first
+	mRing.reset();
+	::operator delete(mBuffers, std::align_val_t(4096));
+}
+
+//-------------------------------------------------------------------------------------------------
+// Each file goes through statx, openat, then a read linked to its close. Sizes come first so files too
+// large for a buffer are never opened. Slots are taken as workers give them back.
+void UringFileReader::Run()
+{
+	size_t nextFile = 0;
+	uint32_t slotsInRing = 0;
+
+	// The kernel writes into mSlots and mBuffers until a request completes, so every request must
+	// complete before Run returns, also when cancelled. Files opened meanwhile are closed, not read.
+	auto drain = [this]()
+	{
+		while (mRing->InFlight > 0)
+		{
+			mRing->SubmitAndWait();
+			mRing->ForEachCompletion([](const uint64_t userData, const int32_t result)
+			{
+				if ((userData & 0xFF) == OpenOperation && result >= 0)
+				{
+					close(result);
+				}
+			});
+		}
+	};
+
+	try
+	{
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+
+				// Nothing to wait for in the ring: wait for a worker to give back a slot.
+				mCondition.wait(lock, [&]()
+				{
+					return mCancelled || slotsInRing > 0 || nextFile == mFileNames.size() || !mFreeSlots.empty();
+				});
+
+				if (mCancelled || (slotsInRing == 0 && nextFile == mFileNames.size()))
+				{
+					break;
+				}
+
+				while (nextFile < mFileNames.size() && !mFreeSlots.empty())
+				{
+					const uint32_t slot = mFreeSlots.back();
+					mFreeSlots.pop_back();
+
+					mSlots[slot].FileIndex = nextFile++;
+					io_uring_sqe* sqe = mRing->NextSqe();
+					sqe->opcode = IORING_OP_STATX;
+					sqe->fd = AT_FDCWD;
+					sqe->addr = reinterpret_cast<uint64_t>(mFileNames[mSlots[slot].FileIndex].c_str());
+					sqe->len = STATX_SIZE;
+					sqe->off = reinterpret_cast<uint64_t>(&mSlots[slot].Stat);
+					sqe->user_data = makeUserData(slot, StatxOperation);
+					++slotsInRing;
+				}
+			}
+
+			mRing->SubmitAndWait();
+
+			mRing->ForEachCompletion([&](const uint64_t userData, const int32_t result)
+			{
+				const uint32_t slot = static_cast<uint32_t>(userData >> 8);
+				Slot& state = mSlots[slot];
+
+				switch (static_cast<Operation>(userData & 0xFF))
+				{
+				case StatxOperation:
+				{
+					state.Size = result == 0 ? static_cast<size_t>(state.Stat.stx_size) : 0;
+					if (result != 0 || state.Size >= BufferSize)
+					{
+						--slotsInRing;
+						freeSlot(slot, true);
+						break;
+					}
+
+					if (state.Size == 0)
+					{
+						--slotsInRing;
+						freeSlot(slot, false);
+						break;
+					}
+
+					io_uring_sqe* sqe = mRing->NextSqe();
+					sqe->opcode = IORING_OP_OPENAT;
+					sqe->fd = AT_FDCWD;
+					sqe->addr = reinterpret_cast<uint64_t>(mFileNames[state.FileIndex].c_str());
+					sqe->open_flags = O_RDONLY | O_CLOEXEC;
+					sqe->user_data = makeUserData(slot, OpenOperation);
+					break;
+				}
+
+				case OpenOperation:
+				{
+					if (result < 0)
+					{
+						--slotsInRing;
+						freeSlot(slot, true);
+						break;
+					}
+
+					// The close is hard linked so it runs even if the read fails
+					state.Fd = result;
+					io_uring_sqe* read = mRing->NextSqe();
+					read->opcode = mRing->FixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+					read->fd = state.Fd;
+					read->addr = reinterpret_cast<uint64_t>(mBuffers + slot * BufferSize);
+					read->len = static_cast<uint32_t>(state.Size);
+					read->off = 0;
+					read->buf_index = mRing->FixedBuffers ? static_cast<uint16_t>(slot) : 0;
+					read->flags = IOSQE_IO_HARDLINK;
+					read->user_data = makeUserData(slot, ReadOperation);
+
+					io_uring_sqe* close = mRing->NextSqe();
+					close->opcode = IORING_OP_CLOSE;
+					close->fd = state.Fd;
+					close->user_data = makeUserData(slot, CloseOperation);
+					break;
+				}
+
+				case ReadOperation:
+				{
+					--slotsInRing;
+
+					// A short read means the file changed, leave it to the caller
+					if (result < 0 || static_cast<size_t>(result) != state.Size)
+					{
+						freeSlot(slot, true);
+						break;
+					}
+
+					std::lock_guard<std::mutex> lock(mMutex);
+					mReadySlots.push_back(slot);
+					mCondition.notify_all();
+					break;
+				}
+
+				case CloseOperation:
+					break;
+				}
+			});
+		}
+	}
+	catch (...)
+	{
+		Cancel();
+		try
+		{
+			drain();
+		}
+		catch (...)
+		{
+			// The ring itself failed, nothing more can be reaped
+		}
+		throw;
+	}
+
+	// The ring may still be closing the files of the last reads, or reading for a cancelled run.
+	drain();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	mFinished = true;
+	mCondition.notify_all();
+}
+
+#else
+
+struct UringFileReader::Ring
+{
+};
+
+struct UringFileReader::Slot
+{
+	size_t FileIndex = 0;
+	size_t Size = 0;
+};
+
+bool UringFileReader::IsAvailable()
+{
+	return false;
+}
+
+UringFileReader::UringFileReader(const std::vector<std::string>& fileNames)
+	: mFileNames(fileNames)
+{
+	throw std::runtime_error("io_uring is not available on this platform.");
+}
+
+UringFileReader::~UringFileReader() = default;
+
+void UringFileReader::Run()
+{
+}
+
+#endif
+
+//-------------------------------------------------------------------------------------------------
+
+bool UringFileReader::Next(File& outFile)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCondition.wait(lock, [this]() { return mCancelled || mFinished || !mReadySlots.empty(); });
+
+	if (mCancelled || mReadySlots.empty())
+	{
+		return false;
+	}
+
+	const uint32_t slot = mReadySlots.front();
+	mReadySlots.pop_front();
+
+	outFile = { mSlots[slot].FileIndex, mBuffers + slot * BufferSize, mSlots[slot].Size, slot };
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void UringFileReader::Release(const File& file, const bool consumed)
+{
+	freeSlot(file.Slot, !consumed);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void UringFileReader::Cancel()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	mCancelled = true;
+	mCondition.notify_all();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+std::vector<size_t> UringFileReader::GetOtherFiles() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	std::vector<size_t> otherFiles = mOtherFiles;
+	std::sort(otherFiles.begin(), otherFiles.end());
+	return otherFiles;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void UringFileReader::freeSlot(const uint32_t slot, const bool otherFile)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (otherFile)
+	{
+		mOtherFiles.push_back(mSlots[slot].FileIndex);
+	}
+	mFreeSlots.push_back(slot);
+	mCondition.notify_all();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define SHARIF_BPE_IO_URING 1
+#endif
+#endif
+
+#ifndef SHARIF_BPE_IO_URING
+#define SHARIF_BPE_IO_URING 0
+#endif
+
+// Reads many small files through one io_uring: the size, open, read and close of up to BufferCount
+// files are in flight at once, and whole files land in registered buffers that are handed to worker
+// threads. Corpora of thousands of shards spend most of their time in open, mmap, munmap and page
+// faults otherwise. Files larger than BufferSize, or that can not be read this way, are left to the
+// caller. Uses the raw system calls, liburing is not needed.
+//
+// One thread calls Run, workers call Next and Release until Next returns false.
+class UringFileReader
+{
+public:
+
+	static constexpr uint32_t BufferCount = 64;
+	static constexpr size_t BufferSize = 256 << 10;
+
+	// True if the kernel supports io_uring with the operations used here, probed once.
+	static bool IsAvailable();
+
+	explicit UringFileReader(const std::vector<std::string>& fileNames);
+	~UringFileReader();
+
+	UringFileReader(const UringFileReader&) = delete;
+	UringFileReader& operator=(const UringFileReader&) = delete;
+
+	struct File
+	{
+		size_t Index;     // In fileNames
+		const char* Data; // Valid until Release
+		size_t Size;
+		uint32_t Slot;
+	};
+
+	// Reads all files, returns when every file is read or left over. Throws std::runtime_error if the
+	// ring fails.
+	void Run();
+
+	// Waits for the next file read, false once all are done.
+	bool Next(File& outFile);
+
+	// Gives the buffer of file back. Files not consumed are left to the caller, as if they had not been read.
+	void Release(const File& file, const bool consumed);
+
+	// Stops Run and Next, for a worker that failed.
+	void Cancel();
+
+	// Indexes of the files left to the caller, sorted. Complete once Run returns.
+	std::vector<size_t> GetOtherFiles() const;
+
+private:
+
+	const std::vector<std::string>& mFileNames;
+
+	struct Ring;
+	std::unique_ptr<Ring> mRing;
+
+	struct Slot;
+	std::vector<Slot> mSlots;
+	char* mBuffers = nullptr;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mCondition;
+	std::vector<uint32_t> mFreeSlots;
+	std::deque<uint32_t> mReadySlots;
+	std::vector<size_t> mOtherFiles;
+	bool mFinished = false;
+	bool mCancelled = false;
+
+	void freeSlot(const uint32_t slot, const bool otherFile);
+};
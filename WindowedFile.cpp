@@ -0,0 +1,409 @@
+#include "WindowedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+//-------------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+WindowedFile::WindowedFile(const std::string& fileName, const Backend backend)
+	: mFileName(fileName)
+	, mBackend(backend)
+{
+	// Unbuffered reads have the same alignment rules as O_DIRECT
+	const DWORD flags = backend == Backend::DirectIO ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN;
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | flags, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Failed to open file '" + fileName + "'.");
+	}
+	mFile = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + fileName + "'.");
+	}
+	mSize = static_cast<uint64_t>(fileSize.QuadPart);
+
+	// Empty files can not be mapped, there is nothing to read either
+	if (mSize != 0 && backend == Backend::Mmap)
+	{
+		mMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mMapping == NULL)
+		{
+			CloseHandle(file);
+			throw std::runtime_error("Failed to create file mapping of '" + fileName + "'.");
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::~WindowedFile()
+{
+	if (mMapping != nullptr)
+	{
+		CloseHandle(mMapping);
+	}
+	CloseHandle(mFile);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t WindowedFile::getAlignment()
+{
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	return systemInfo.dwAllocationGranularity;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::Window WindowedFile::map(const uint64_t offset, const size_t size, const bool /*populate*/) const
+{
+	const uint64_t mappingOffset = offset & ~static_cast<uint64_t>(getAlignment() - 1);
+	const size_t mappingSize = static_cast<size_t>(offset - mappingOffset) + size;
+
+	void* mapping = MapViewOfFile(mMapping, FILE_MAP_READ, static_cast<DWORD>(mappingOffset >> 32), static_cast<DWORD>(mappingOffset), mappingSize);
+	if (mapping == nullptr)
+	{
+		throw std::runtime_error("Failed to map a window of '" + mFileName + "'.");
+	}
+
+	Window window;
+	window.mMapping = mapping;
+	window.mMappingSize = mappingSize;
+	window.mData = static_cast<const char*>(mapping) + (offset - mappingOffset);
+	window.mSize = size;
+	return window;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t WindowedFile::readAt(char* buffer, const size_t size, const uint64_t offset) const
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset + done);
+		overlapped.OffsetHigh = static_cast<DWORD>((offset + done) >> 32);
+
+		DWORD length = 0;
+		const DWORD request = static_cast<DWORD>(std::min<size_t>(size - done, 1u << 30));
+		if (!ReadFile(mFile, buffer + done, request, &length, &overlapped))
+		{
+			if (GetLastError() == ERROR_HANDLE_EOF)
+			{
+				break;
+			}
+			throw std::runtime_error("Failed to read '" + mFileName + "'.");
+		}
+
+		if (length == 0)
+		{
+			break;
+		}
+		done += length;
+	}
+	return done;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void WindowedFile::Window::release()
+{
+	if (mMapping != nullptr)
+	{
+		UnmapViewOfFile(mMapping);
+	}
+	if (mBuffer != nullptr)
+	{
+		giveBackBuffer(mBuffer, mBufferSize);
+	}
+}
+
+#else
+
+WindowedFile::WindowedFile(const std::string& fileName, const Backend backend)
+	: mFileName(fileName)
+	, mBackend(backend)
+{
+	if (backend == Backend::DirectIO)
+	{
+#ifdef O_DIRECT
+		mFd = open(fileName.c_str(), O_RDONLY | O_DIRECT);
+		if (mFd == -1 && errno == EINVAL)
+		{
+			fprintf(stderr, "'%s' does not support O_DIRECT, reading it through the page cache.\n", fileName.c_str());
+			mBackend = Backend::Pread;
+		}
+#else
+		fprintf(stderr, "O_DIRECT is not available, reading '%s' through the page cache.\n", fileName.c_str());
+		mBackend = Backend::Pread;
+#endif
+	}
+
+	if (mBackend != Backend::DirectIO)
+	{
+		mFd = open(fileName.c_str(), O_RDONLY);
+	}
+
+	if (mFd == -1)
+	{
+		throw std::runtime_error("Failed to open file '" + fileName + "': " + strerror(errno));
+	}
+
+	struct stat sb;
+	if (fstat(mFd, &sb) == -1)
+	{
+		const int err = errno;
+		close(mFd);
+		throw std::runtime_error("Failed to get file size: " + std::string(strerror(err)));
+	}
+	mSize = static_cast<uint64_t>(sb.st_size);
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+	if (mBackend == Backend::Pread)
+	{
+		posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::~WindowedFile()
+{
+	close(mFd);
+}
+
+//-------------------------------------------------------------------------------------------------
+
+size_t WindowedFile::getAlignment()
+{
+	static const size_t PageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return PageSize;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::Window WindowedFile::map(const uint64_t offset, const size_t size, const bool populate) const
+{
+	// Mappings start at a multiple of the page size.
+	const uint64_t mappingOffset = offset & ~static_cast<uint64_t>(getAlignment() - 1);
+	const size_t mappingSize = static_cast<size_t>(offset - mappingOffset) + size;
+
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	if (populate)
+	{
+		flags |= MAP_POPULATE;
+	}
+#else
+	(void)populate;
+#endif
+
+	void* mapping = mmap(nullptr, mappingSize, PROT_READ, flags, mFd, static_cast<off_t>(mappingOffset));
+	if (mapping == MAP_FAILED)
+	{
+		throw std::runtime_error("Failed to map a window of '" + mFileName + "': " + strerror(errno));
+	}
+
+	Window window;
+	window.mMapping = mapping;
+	window.mMappingSize = mappingSize;
+	window.mData = static_cast<const char*>(mapping) + (offset - mappingOffset);
+	window.mSize = size;
+	return window;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Reads until size bytes or the end of the file, returns the bytes read.
+size_t WindowedFile::readAt(char* buffer, const size_t size, const uint64_t offset) const
+{
+	size_t done = 0;
+	while (done < size)
+	{
+		const ssize_t length = pread(mFd, buffer + done, size - done, static_cast<off_t>(offset + done));
+		if (length < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw std::runtime_error("Failed to read '" + mFileName + "': " + strerror(errno));
+		}
+
+		if (length == 0)
+		{
+			break;
+		}
+		done += static_cast<size_t>(length);
+	}
+	return done;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void WindowedFile::Window::release()
+{
+	if (mMapping != nullptr)
+	{
+		munmap(mMapping, mMappingSize);
+	}
+	if (mBuffer != nullptr)
+	{
+		giveBackBuffer(mBuffer, mBufferSize);
+	}
+}
+
+#endif
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::Window WindowedFile::Read(const uint64_t offset, const size_t length, const bool populate) const
+{
+	if (offset >= mSize || length == 0)
+	{
+		return Window();
+	}
+
+	const size_t size = static_cast<size_t>(std::min<uint64_t>(length, mSize - offset));
+	return mBackend == Backend::Mmap ? map(offset, size, populate) : readBuffer(offset, size);
+}
+
+//-------------------------------------------------------------------------------------------------
+// The buffer covers whole aligned blocks around the range, as O_DIRECT needs. The last block may be
+// past the end of the file, reads stop there.
+WindowedFile::Window WindowedFile::readBuffer(const uint64_t offset, const size_t size) const
+{
+	const uint64_t bufferOffset = offset & ~static_cast<uint64_t>(DirectIOAlignment - 1);
+	const uint64_t bufferEnd = (offset + size + DirectIOAlignment - 1) & ~static_cast<uint64_t>(DirectIOAlignment - 1);
+	const size_t bufferSize = static_cast<size_t>(bufferEnd - bufferOffset);
+
+	Window window;
+	window.mBuffer = takeBuffer(bufferSize, window.mBufferSize);
+
+	char* buffer = static_cast<char*>(window.mBuffer);
+	const size_t readSize = readAt(buffer, bufferSize, bufferOffset);
+	if (readSize < static_cast<size_t>(offset - bufferOffset) + size)
+	{
+		throw std::runtime_error("Unexpected end of file in '" + mFileName + "'.");
+	}
+
+	window.mData = buffer + (offset - bufferOffset);
+	window.mSize = size;
+	return window;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+namespace
+{
+	struct SpareBuffer
+	{
+		void* Buffer = nullptr;
+		size_t Size = 0;
+
+		~SpareBuffer()
+		{
+			if (Buffer != nullptr)
+			{
+				::operator delete(Buffer, std::align_val_t(WindowedFile::DirectIOAlignment));
+			}
+		}
+	};
+
+	thread_local SpareBuffer tSpareBuffer;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+void* WindowedFile::takeBuffer(const size_t size, size_t& outSize)
+{
+	if (tSpareBuffer.Buffer != nullptr && tSpareBuffer.Size >= size)
+	{
+		outSize = tSpareBuffer.Size;
+		tSpareBuffer.Size = 0;
+		return std::exchange(tSpareBuffer.Buffer, nullptr);
+	}
+
+	outSize = size;
+	return ::operator new(size, std::align_val_t(DirectIOAlignment));
+}
+
+//-------------------------------------------------------------------------------------------------
+// Keeps the larger of the spare and the given buffer.
+void WindowedFile::giveBackBuffer(void* buffer, size_t size)
+{
+	if (tSpareBuffer.Buffer != nullptr && tSpareBuffer.Size < size)
+	{
+		std::swap(tSpareBuffer.Buffer, buffer);
+		std::swap(tSpareBuffer.Size, size);
+	}
+
+	if (tSpareBuffer.Buffer == nullptr)
+	{
+		tSpareBuffer.Buffer = buffer;
+		tSpareBuffer.Size = size;
+		return;
+	}
+
+	::operator delete(buffer, std::align_val_t(DirectIOAlignment));
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::Window::~Window()
+{
+	release();
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::Window::Window(Window&& other) noexcept
+	: mData(std::exchange(other.mData, nullptr))
+	, mSize(std::exchange(other.mSize, 0))
+	, mMapping(std::exchange(other.mMapping, nullptr))
+	, mMappingSize(std::exchange(other.mMappingSize, 0))
+	, mBuffer(std::exchange(other.mBuffer, nullptr))
+	, mBufferSize(std::exchange(other.mBufferSize, 0))
+{
+}
+
+//-------------------------------------------------------------------------------------------------
+
+WindowedFile::Window& WindowedFile::Window::operator=(Window&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		mData = std::exchange(other.mData, nullptr);
+		mSize = std::exchange(other.mSize, 0);
+		mMapping = std::exchange(other.mMapping, nullptr);
+		mMappingSize = std::exchange(other.mMappingSize, 0);
+		mBuffer = std::exchange(other.mBuffer, nullptr);
+		mBufferSize = std::exchange(other.mBufferSize, 0);
+	}
+	return *this;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file read one window at a time, for inputs too large to map at once or on storage where page
+// faults are slow. Only the windows alive at a time take address space and memory, so a reader
+// moving through a file of hundreds of GB holds a few windows per thread, not the whole file.
+// Windows can be read from many threads at once.
+class WindowedFile
+{
+public:
+
+	enum class Backend
+	{
+		Mmap,    // Windows are mapped, pages are faulted in as they are read
+		Pread,   // Windows are read into aligned buffers with large pread calls
+		DirectIO // Same as Pread with O_DIRECT, bypassing the page cache. Falls back to Pread where the
+		         // filesystem does not support it
+	};
+
+	explicit WindowedFile(const std::string& fileName, const Backend backend = Backend::Mmap);
+	~WindowedFile();
+
+	WindowedFile(const WindowedFile&) = delete;
+	WindowedFile& operator=(const WindowedFile&) = delete;
+
+	uint64_t GetSize() const { return mSize; }
+	Backend GetBackend() const { return mBackend; }
+
+	// A range of the file, mapped or in a buffer, released when destroyed.
+	class Window
+	{
+	public:
+
+		Window() = default;
+		~Window();
+
+		Window(Window&& other) noexcept;
+		Window& operator=(Window&& other) noexcept;
+
+		// Data starts at the requested offset, the mapping or buffer starts at an aligned offset before it.
+		const char* GetData() const { return mData; }
+		size_t GetSize() const { return mSize; }
+
+	private:
+
+		friend class WindowedFile;
+
+		const char* mData = nullptr;
+		size_t mSize = 0;
+		void* mMapping = nullptr;
+		size_t mMappingSize = 0;
+		void* mBuffer = nullptr;
+		size_t mBufferSize = 0;
+
+		void release();
+	};
+
+	// Reads [offset, offset + length), clipped to the end of the file. Throws std::runtime_error on failure.
+	// populate reads a mapped window in at once (MAP_POPULATE), buffers are always read at once.
+	Window Read(const uint64_t offset, const size_t length, const bool populate = false) const;
+
+	// Offsets, sizes and buffers of O_DIRECT reads are multiples of the logical block size, at most 4 KB.
+	static constexpr size_t DirectIOAlignment = 4096;
+
+private:
+
+	std::string mFileName;
+	uint64_t mSize = 0;
+	Backend mBackend;
+
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFd = -1;
+#endif
+
+	static size_t getAlignment();
+
+	Window map(const uint64_t offset, const size_t size, const bool populate) const;
+	Window readBuffer(const uint64_t offset, const size_t size) const;
+	size_t readAt(char* buffer, const size_t size, const uint64_t offset) const;
+
+	// Buffers are reused by the thread that released them, fresh ones fault in every page.
+	static void* takeBuffer(const size_t size, size_t& outSize);
+	static void giveBackBuffer(void* buffer, size_t size);
+};